@@ -0,0 +1,16 @@
+# Zstandard, a compressor with selectable compression levels
+
+include(LibFindMacros)
+
+find_path(Zstd_INCLUDE_DIR
+	NAMES zstd.h
+)
+
+find_library(Zstd_LIBRARY
+	NAMES zstd
+)
+
+set(Zstd_PROCESS_INCLUDES Zstd_INCLUDE_DIR)
+set(Zstd_PROCESS_LIBS Zstd_LIBRARY)
+
+libfind_process(Zstd)
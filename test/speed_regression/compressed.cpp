@@ -17,8 +17,11 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 
+#include <iomanip>
 #include <iostream>
+#include <boost/filesystem.hpp>
 #include <tpie/file_stream.h>
+#include <tpie/stats.h>
 #include <tpie/compressed/stream.h>
 
 struct file_stream {
@@ -47,7 +50,8 @@ size_t f(size_t prev, size_t n) {
 }
 
 void usage() {
-	std::cout << "Parameters: <file_stream|uncompressed|compressed> <read|write> <filename> <items>" << std::endl;
+	std::cout << "Parameters: <file_stream|uncompressed|compressed> <read|write> <filename> <items>\n"
+		<< "        or: schemes <items>" << std::endl;
 }
 
 template <typename Stream>
@@ -80,6 +84,56 @@ void go_class(const std::string & command, const std::string fileName, size_t it
 	else usage();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Write and read the same items with each compression scheme, reporting
+/// speed and compression ratio.
+///////////////////////////////////////////////////////////////////////////////
+void go_schemes(size_t items) {
+	struct scheme_info {
+		const char * name;
+		tpie::compression_scheme::type scheme;
+		int level;
+	};
+	const scheme_info schemes[] = {
+		{"none", tpie::compression_scheme::none, 0},
+		{"snappy", tpie::compression_scheme::snappy, 0},
+		{"lz4", tpie::compression_scheme::lz4, 0},
+		{"zstd-1", tpie::compression_scheme::zstd, 1},
+		{"zstd-3", tpie::compression_scheme::zstd, 3},
+		{"zstd-9", tpie::compression_scheme::zstd, 9},
+		{"zstd-19", tpie::compression_scheme::zstd, 19}
+	};
+	const double mb = items * sizeof(size_t) / (1024.0 * 1024.0);
+	std::cout << std::setw(10) << "Scheme"
+		<< std::setw(14) << "Write (MB/s)"
+		<< std::setw(14) << "Read (MB/s)"
+		<< std::setw(14) << "On disk (MB)"
+		<< std::setw(10) << "Ratio" << std::endl;
+	for (size_t i = 0; i < sizeof(schemes) / sizeof(schemes[0]); ++i) {
+		tpie::temp_file tf;
+		tpie::ptime t1 = tpie::ptime::now();
+		{
+			tpie::file_stream<size_t> s;
+			s.set_preferred_compression(schemes[i].scheme, schemes[i].level);
+			s.open(tf, tpie::access_read_write, 0, tpie::access_sequential, tpie::compression_all);
+			write(s, items);
+		}
+		tpie::ptime t2 = tpie::ptime::now();
+		{
+			tpie::file_stream<size_t> s;
+			s.open(tf, tpie::access_read);
+			read(s, items);
+		}
+		tpie::ptime t3 = tpie::ptime::now();
+		const double diskMb = boost::filesystem::file_size(tf.path()) / (1024.0 * 1024.0);
+		std::cout << std::setw(10) << schemes[i].name
+			<< std::setw(14) << mb / tpie::ptime::seconds(t1, t2)
+			<< std::setw(14) << mb / tpie::ptime::seconds(t2, t3)
+			<< std::setw(14) << diskMb
+			<< std::setw(10) << mb / diskMb << std::endl;
+	}
+}
+
 void go(std::string cls, std::string command, std::string fileName, std::string itemsString) {
 	size_t items;
 	std::stringstream(itemsString) >> items;
@@ -90,6 +144,14 @@ void go(std::string cls, std::string command, std::string fileName, std::string
 }
 
 int main(int argc, char ** argv) {
+	if (argc == 3 && std::string(argv[1]) == "schemes") {
+		size_t items;
+		std::stringstream(argv[2]) >> items;
+		tpie::tpie_init();
+		go_schemes(items);
+		tpie::tpie_finish();
+		return 0;
+	}
 	if (argc != 5) {
 		usage();
 		return 1;
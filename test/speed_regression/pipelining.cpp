@@ -21,6 +21,8 @@
 #include <cstdlib> // exit
 #include <tpie/tpie.h>
 #include <tpie/pipelining.h>
+#include <tpie/cpu_affinity.h>
+#include <tpie/job.h>
 #include <iostream>
 #include "testtime.h"
 #include <boost/filesystem/operations.hpp>
@@ -36,7 +38,8 @@ const size_t count_default=1024*1024*1024/sizeof(test_t);
 static std::string prog;
 
 static inline void usage() {
-	std::cout << "Usage: " << prog << " [times [count]]\n"
+	std::cout << "Usage: " << prog << " [--parallel] [times [count]]\n"
+		<< "--parallel: Measure parallel() with each worker placement\n"
 		<< "times: Number of trials\n"
 		<< "count: Number of elements in each trial"
 		<< std::endl;
@@ -54,7 +57,7 @@ struct number_generator_t : public node {
 		set_steps(count);
 	}
 
-	inline void operator()() {
+	virtual void go() override {
 		for (size_t i = 1; i <= count; ++i) {
 			dest.push(i);
 			step();
@@ -76,6 +79,59 @@ private:
 	test_t & output;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// Worker node updating a private table for each item. The table is
+/// allocated on the first push, that is, in the worker thread, so it is local
+/// to the worker only if the worker stays on one NUMA node. With unpinned
+/// workers, the scheduler may move a worker away from its table, and every
+/// update then crosses the socket interconnect.
+///////////////////////////////////////////////////////////////////////////////
+template <typename dest_t>
+struct scatter_t : public node {
+	typedef test_t item_type;
+	static const size_t tableSize = 4*1024*1024;
+
+	inline scatter_t(const dest_t & dest)
+		: dest(dest)
+	{
+		add_push_destination(dest);
+	}
+
+	inline void push(const test_t & item) {
+		if (table.size() == 0) table.resize(tableSize, 0);
+		test_t h = item;
+		for (size_t i = 0; i < 4; ++i) {
+			h = h * 6364136223846793005ull + 1442695040888963407ull;
+			table[(h >> 16) % tableSize] += item;
+		}
+		dest.push(item);
+	}
+
+private:
+	dest_t dest;
+	array<test_t> table;
+};
+
+static void parallel_test(size_t count) {
+	const worker_placement_type placements[] = {
+		unpinned_workers, pin_workers_to_cpus, pin_workers_to_numa_nodes
+	};
+	for (size_t i = 0; i < 3; ++i) {
+		test_realtime_t start;
+		test_realtime_t end;
+		test_t res = 0;
+		getTestRealtime(start);
+		pipeline p = pipe_begin<factory_1<number_generator_t, size_t> >(count)
+			| parallel(pipe_middle<factory_0<scatter_t> >(), arbitrary_order,
+					   default_worker_count(), 2048, placements[i])
+			| pipe_end<termfactory_1<number_sink_t, test_t &> >(termfactory_1<number_sink_t, test_t &>(res));
+		p();
+		getTestRealtime(end);
+		std::cout << (i ? " " : "") << testRealtimeDiff(start,end) << std::flush;
+	}
+	std::cout << std::endl;
+}
+
 inline static void do_write(size_t count) {
 	file_stream<test_t> s;
 	s.open("tmp");
@@ -114,6 +170,7 @@ static void test(size_t count) {
 int main(int argc, char **argv) {
 	size_t times = 10;
 	size_t count = count_default;
+	bool par = false;
 	prog = argv[0];
 
 	while (argc > 1) {
@@ -121,6 +178,8 @@ int main(int argc, char **argv) {
 
 		if (arg == "--help" || arg == "-h")
 			usage();
+		else if (arg == "--parallel")
+			par = true;
 
 		else break;
 
@@ -140,12 +199,21 @@ int main(int argc, char **argv) {
 		if (!count) usage();
 	}
 
-	std::cout << "Writing " << count << " items, reading them" << std::endl;
-
 	tpie::tpie_init();
+	tpie::get_memory_manager().set_limit(1024*1024*1024);
+
+	if (par) {
+		std::cout << "Running " << count << " items through " << default_worker_count()
+			<< " parallel workers on " << numa_node_count() << " NUMA nodes\n"
+			<< "Seconds with unpinned workers, workers pinned to processors, "
+			<< "and workers pinned to NUMA nodes" << std::endl;
+	} else {
+		std::cout << "Writing " << count << " items, reading them" << std::endl;
+	}
 
 	for (size_t i = 0; i < times || !times; ++i) {
-		::test(count);
+		if (par) parallel_test(count);
+		else ::test(count);
 	}
 
 	tpie::tpie_finish();
@@ -64,8 +64,9 @@ struct testinfo {
 			"Writing",
 			"Compressing",
 			"Uncompressing",
-			"Snappy-blocks",
+			"Compressed-blocks",
 			"None-blocks",
+			"Incompressible-blocks",
 			NULL};
 		for (size_t i = 0; labels[i]; ++i) {
 			m_sysinfo.printinfo(labels[i], get_user(i));
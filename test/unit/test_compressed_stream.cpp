@@ -19,7 +19,10 @@
 
 #include "common.h"
 #include <tpie/compressed/stream.h>
+#include <tpie/compressed/thread.h>
 #include <tpie/file_stream.h>
+#include <tpie/stats.h>
+#include <boost/filesystem.hpp>
 
 template <tpie::compression_flags flags>
 class tests {
@@ -850,6 +853,202 @@ static bool odd_block_size_test() {
 	return true;
 }
 
+static bool many_streams_test(size_t n) {
+	// Restart the compressor with several workers so that requests
+	// on different streams are handled concurrently.
+	tpie::tpie_finish(tpie::STREAMS);
+	tpie::set_compressor_thread_count(4);
+	tpie::tpie_init(tpie::STREAMS);
+
+	const size_t streams = 16;
+	tpie::array<tpie::file_stream<size_t> > s(streams);
+	for (size_t j = 0; j < streams; ++j)
+		s[j].open(0, tpie::access_sequential, tpie::compression_all);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < streams; ++j)
+			s[j].write(i * streams + j);
+	for (size_t j = 0; j < streams; ++j)
+		s[j].seek(0);
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t j = 0; j < streams; ++j) {
+			TEST_ASSERT(s[j].can_read());
+			size_t r = s[j].read();
+			if (r != i * streams + j) {
+				tpie::log_error() << "Stream " << j << ": Got " << r
+					<< ", expected " << i * streams + j << std::endl;
+				return false;
+			}
+		}
+	}
+	for (size_t j = 0; j < streams; ++j)
+		s[j].close();
+	return true;
+}
+
+static bool scheme_test(tpie::compression_scheme::type scheme, int level, size_t n) {
+	if (!tpie::compression_scheme_available(scheme)) {
+		tpie::log_info() << "Scheme " << scheme << " not built; skipping" << std::endl;
+		return true;
+	}
+	tpie::temp_file tf;
+	const tpie::stream_size_type compressedBlocks = tpie::get_user(7);
+	{
+		tpie::file_stream<size_t> s;
+		s.set_preferred_compression(scheme, level);
+		s.open(tf, tpie::access_read_write, 0, tpie::access_sequential, tpie::compression_all);
+		for (size_t i = 0; i < n; ++i) s.write(i / 3);
+		s.close();
+		if (scheme != tpie::compression_scheme::none) {
+			// The items are highly repetitive, so every codec must shrink them.
+			TEST_ASSERT(tpie::get_user(7) > compressedBlocks);
+			TEST_ASSERT(s.get_bytes_written() < n * sizeof(size_t) / 2);
+		}
+	}
+	tpie::file_stream<size_t> s;
+	s.open(tf);
+	for (size_t i = 0; i < n; ++i) {
+		TEST_ASSERT(s.can_read());
+		size_t r = s.read();
+		if (r != i / 3) {
+			tpie::log_error() << "Scheme " << scheme << ", level " << level
+				<< ": Got " << r << ", expected " << i / 3 << std::endl;
+			return false;
+		}
+	}
+	TEST_ASSERT(!s.can_read());
+	return true;
+}
+
+static bool schemes_test(size_t n) {
+	return scheme_test(tpie::compression_scheme::none, 0, n)
+		&& scheme_test(tpie::compression_scheme::snappy, 0, n)
+		&& scheme_test(tpie::compression_scheme::lz4, 0, n)
+		&& scheme_test(tpie::compression_scheme::lz4, 8, n)
+		&& scheme_test(tpie::compression_scheme::zstd, 0, n)
+		&& scheme_test(tpie::compression_scheme::zstd, 1, n)
+		&& scheme_test(tpie::compression_scheme::zstd, 19, n);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Item i of the incompressible test: Runs of random items
+/// interleaved with runs of compressible items.
+///////////////////////////////////////////////////////////////////////////////
+static size_t incompressible_item(size_t i, size_t runLength) {
+	if ((i / runLength) % 3 != 0) return i;
+	boost::uint64_t x = i + 1;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return static_cast<size_t>(x * 0x2545F4914F6CDD1Dull);
+}
+
+static bool incompressible_test(size_t n) {
+	tpie::temp_file tf;
+	size_t runLength;
+	{
+		tpie::file_stream<size_t> s;
+		s.open(tf, tpie::access_read_write, 0, tpie::access_sequential, tpie::compression_normal);
+		runLength = s.block_items();
+		for (size_t i = 0; i < n; ++i) s.write(incompressible_item(i, runLength));
+	}
+	tpie::file_stream<size_t> s;
+	s.open(tf);
+	for (size_t i = 0; i < n; ++i) {
+		TEST_ASSERT(s.can_read());
+		size_t r = s.read();
+		if (r != incompressible_item(i, runLength)) {
+			tpie::log_error() << "Got " << r << " at " << i << ", expected "
+				<< incompressible_item(i, runLength) << std::endl;
+			return false;
+		}
+	}
+	TEST_ASSERT(!s.can_read());
+	for (size_t i = n; i--;) {
+		TEST_ASSERT(s.can_read_back());
+		TEST_ASSERT(s.read_back() == incompressible_item(i, runLength));
+	}
+	s.close();
+
+	// A stream of only random items must be stored raw, whether or not the
+	// compressor keeps up, so it is no larger than its payload and headers.
+	// User stat 7 counts compressed blocks and 8 counts raw blocks.
+	tpie::stream_size_type compressedBlocks = tpie::get_user(7);
+	tpie::stream_size_type rawBlocks = tpie::get_user(8);
+	tpie::temp_file randomFile;
+	size_t blocks;
+	{
+		tpie::file_stream<size_t> rs;
+		rs.open(randomFile, tpie::access_read_write, 0, tpie::access_sequential, tpie::compression_normal);
+		blocks = (n + rs.block_items() - 1) / rs.block_items();
+		for (size_t i = 0; i < n; ++i) rs.write(incompressible_item(i, n));
+	}
+	compressedBlocks = tpie::get_user(7) - compressedBlocks;
+	rawBlocks = tpie::get_user(8) - rawBlocks;
+	tpie::log_debug() << "Random stream: " << blocks << " blocks, " << rawBlocks
+					  << " stored raw, " << compressedBlocks << " compressed" << std::endl;
+	TEST_ASSERT(compressedBlocks == 0);
+	TEST_ASSERT(rawBlocks == blocks);
+	const boost::uintmax_t payload = n * sizeof(size_t);
+	const boost::uintmax_t fileSize = boost::filesystem::file_size(randomFile.path());
+	TEST_ASSERT(fileSize >= payload);
+	TEST_ASSERT(fileSize <= payload + payload / 64);
+
+	// After an incompressible block, 1, 2, 4, ... up to 64 blocks are stored
+	// raw, and a block that compresses well ends the backoff.
+	tpie::compressor_response response;
+	tpie::compressor_thread_lock lock(tpie::the_compressor_thread());
+	TEST_ASSERT(!response.skip_compression());
+	for (size_t skip = 1; skip <= 128; skip *= 2) {
+		response.set_block_compressible(false);
+		for (size_t i = 0; i < std::min(skip, static_cast<size_t>(64)); ++i)
+			TEST_ASSERT(response.skip_compression());
+		TEST_ASSERT(!response.skip_compression());
+	}
+	response.set_block_compressible(true);
+	response.set_block_compressible(false);
+	TEST_ASSERT(response.skip_compression());
+	TEST_ASSERT(!response.skip_compression());
+	return true;
+}
+
+static bool direct_io_test(size_t n) {
+	tpie::set_direct_io_temp_files(true);
+	bool result = true;
+	for (int compressed = 0; compressed < 2 && result; ++compressed) {
+		tpie::compression_flags flags = compressed ? tpie::compression_normal : tpie::compression_none;
+		tpie::temp_file tf;
+		const tpie::stream_size_type requestsBefore = tpie::get_direct_io_requests();
+		{
+			tpie::file_stream<size_t> s;
+			s.open(tf, tpie::access_read_write, 0, tpie::access_sequential, flags);
+			// Block-sized writes go through O_DIRECT; the partial final
+			// block goes through the page cache.
+			for (size_t i = 0; i < n; ++i) s.write(i * 7);
+		}
+		tpie::file_stream<size_t> s;
+		s.open(tf, tpie::access_read, 0, tpie::access_sequential, flags);
+		for (size_t i = 0; i < n; ++i) {
+			if (!s.can_read() || s.read() != i * 7) {
+				tpie::log_error() << "Wrong item " << i << " (compressed = " << compressed << ")" << std::endl;
+				result = false;
+				break;
+			}
+		}
+		if (result && s.can_read()) result = false;
+		// Uncompressed blocks are aligned, so each full block is written
+		// and read through O_DIRECT.
+		const tpie::stream_size_type fullBlocks = n / s.block_items();
+		const tpie::stream_size_type requests = tpie::get_direct_io_requests() - requestsBefore;
+		if (result && !compressed && requests < 2 * fullBlocks) {
+			tpie::log_error() << "Only " << requests << " direct I/O requests for "
+							  << fullBlocks << " full blocks" << std::endl;
+			result = false;
+		}
+	}
+	tpie::set_direct_io_temp_files(false);
+	return result;
+}
+
 template <tpie::compression_flags flags>
 tpie::tests & add_tests(tpie::tests & t, std::string suffix) {
 	typedef tests<flags> T;
@@ -889,5 +1088,9 @@ int main(int argc, char ** argv) {
 		 (t, ""), "_u")
 		.test(backwards_file_stream_test, "backwards_fs", "n", static_cast<size_t>(1 << 23))
 		.test(odd_block_size_test, "odd_block_size")
+		.test(many_streams_test, "many_streams", "n", static_cast<size_t>(1 << 19))
+		.test(schemes_test, "schemes", "n", static_cast<size_t>(1 << 19))
+		.test(incompressible_test, "incompressible", "n", static_cast<size_t>(1 << 22))
+		.test(direct_io_test, "direct_io", "n", static_cast<size_t>((1 << 20) + 12345))
 		;
 }
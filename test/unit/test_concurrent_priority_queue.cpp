@@ -0,0 +1,165 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <boost/thread.hpp>
+#include <tpie/concurrent_priority_queue.h>
+#include <tpie/stats.h>
+
+#define TEST_ASSERT(cond) \
+do { \
+	if (!(cond)) { \
+		tpie::log_error() << "Test failed on line " << __LINE__ << ": " #cond << std::endl; \
+		return false; \
+	} \
+} while (0)
+
+typedef tpie::concurrent_priority_queue<boost::uint64_t> queue_type;
+
+class pq_producer {
+public:
+	pq_producer(queue_type & pq, size_t id, size_t n)
+		: pq(pq), id(id), n(n) {
+	}
+
+	void operator()() {
+		queue_type::producer p(pq);
+		for (size_t i = 0; i < n; ++i)
+			p.push((i * 98927 + id * 104639) % 1000003);
+	}
+
+private:
+	queue_type & pq;
+	size_t id;
+	size_t n;
+};
+
+static boost::uint64_t expected_sum(size_t p, size_t n) {
+	boost::uint64_t sum = 0;
+	for (size_t id = 0; id < p; ++id)
+		for (size_t i = 0; i < n; ++i)
+			sum += (i * 98927 + id * 104639) % 1000003;
+	return sum;
+}
+
+// Pop everything after the producers are done; the result must be sorted.
+bool basic_test(size_t p, size_t n) {
+	queue_type pq(static_cast<tpie::memory_size_type>(4*1024*1024));
+	boost::thread_group threads;
+	for (size_t i = 0; i < p; ++i)
+		threads.create_thread(pq_producer(pq, i, n));
+	threads.join_all();
+
+	TEST_ASSERT(pq.size() == p * n);
+	boost::uint64_t sum = 0;
+	boost::uint64_t prev = 0;
+	for (size_t i = 0; i < p * n; ++i) {
+		boost::uint64_t x;
+		TEST_ASSERT(pq.try_pop(x));
+		TEST_ASSERT(x >= prev);
+		sum += x;
+		prev = x;
+	}
+	TEST_ASSERT(pq.empty());
+	TEST_ASSERT(sum == expected_sum(p, n));
+	return true;
+}
+
+// Pop while the producers push; no element may be lost.
+bool concurrent_test(size_t p, size_t n) {
+	queue_type pq(static_cast<tpie::memory_size_type>(4*1024*1024));
+	boost::thread_group threads;
+	for (size_t i = 0; i < p; ++i)
+		threads.create_thread(pq_producer(pq, i, n));
+
+	boost::uint64_t sum = 0;
+	size_t popped = 0;
+	boost::uint64_t x;
+	while (popped < p * n / 2) {
+		if (!pq.try_pop(x)) {
+			boost::this_thread::yield();
+			continue;
+		}
+		sum += x;
+		++popped;
+	}
+	threads.join_all();
+	while (pq.try_pop(x)) {
+		sum += x;
+		++popped;
+	}
+	TEST_ASSERT(popped == p * n);
+	TEST_ASSERT(sum == expected_sum(p, n));
+	return true;
+}
+
+class small_flush_producer {
+public:
+	small_flush_producer(queue_type & pq, size_t id, size_t n, size_t flushEvery)
+		: pq(pq), id(id), n(n), flushEvery(flushEvery) {
+	}
+
+	void operator()() {
+		queue_type::producer p(pq);
+		for (size_t i = 0; i < n; ++i) {
+			p.push((i * 98927 + id * 104639) % 1000003);
+			if ((i + 1) % flushEvery == 0) p.flush();
+		}
+		p.flush();
+	}
+
+private:
+	queue_type & pq;
+	size_t id;
+	size_t n;
+	size_t flushEvery;
+};
+
+// Many small flushes that together fit in the insertion buffer must not
+// each take a group 0 slot, which would write them to disk.
+bool small_flush_test(size_t p, size_t flushEvery) {
+	queue_type pq(static_cast<tpie::memory_size_type>(4*1024*1024));
+	const size_t n = pq.max_run_size() / (2 * p);
+	const tpie::stream_size_type written = tpie::get_bytes_written();
+	boost::thread_group threads;
+	for (size_t i = 0; i < p; ++i)
+		threads.create_thread(small_flush_producer(pq, i, n, flushEvery));
+	threads.join_all();
+	TEST_ASSERT(tpie::get_bytes_written() == written);
+
+	TEST_ASSERT(pq.size() == p * n);
+	boost::uint64_t sum = 0;
+	boost::uint64_t prev = 0;
+	boost::uint64_t x;
+	while (pq.try_pop(x)) {
+		TEST_ASSERT(x >= prev);
+		sum += x;
+		prev = x;
+	}
+	TEST_ASSERT(sum == expected_sum(p, n));
+	return true;
+}
+
+int main(int argc, char ** argv) {
+	return tpie::tests(argc, argv)
+		.test(basic_test, "basic", "p", static_cast<size_t>(4), "n", static_cast<size_t>(500000))
+		.test(concurrent_test, "concurrent", "p", static_cast<size_t>(4), "n", static_cast<size_t>(500000))
+		.test(small_flush_test, "small_flush", "p", static_cast<size_t>(4), "flush_every", static_cast<size_t>(100))
+		;
+}
@@ -18,6 +18,8 @@
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 #include "common.h"
 #include <tpie/priority_queue.h>
+#include <tpie/compressed/scheme.h>
+#include <tpie/stats.h>
 #include <vector>
 #include "priority_queue.h"
 #include "../test_portability.h"
@@ -279,6 +281,95 @@ bool parameter_test(double kb, double blockSizeKB) {
 	return true;
 }
 
+bool bulk_test() {
+	// Little memory and small blocks, so that many slots and groups are used.
+	ami::priority_queue<boost::uint64_t> pq(static_cast<memory_size_type>(512*1024), 1.0f/64);
+	std::priority_queue<boost::uint64_t, vector<boost::uint64_t>, std::greater<boost::uint64_t> > pq2;
+	boost::rand48 rng(42);
+
+	// Time-forward processing: push messages to the future and pop the
+	// messages of the present.
+	boost::uint64_t now = 0;
+	vector<boost::uint64_t> items;
+	vector<boost::uint64_t> got;
+	for (size_t step = 0; step < 2000; ++step) {
+		items.resize(rng() % 1000);
+		for (size_t i = 0; i < items.size(); ++i) {
+			items[i] = now + rng() % 100000;
+			pq2.push(items[i]);
+		}
+		pq.push(items.begin(), items.end());
+
+		now += 50;
+		got.clear();
+		pq.pop_all_less_than(now, std::back_inserter(got));
+		for (size_t i = 0; i < got.size(); ++i) {
+			if (pq2.empty() || got[i] != pq2.top()) {
+				log_error() << "pop_all_less_than got " << got[i] << " at step " << step << endl;
+				return false;
+			}
+			pq2.pop();
+		}
+		if (!pq2.empty() && pq2.top() < now) {
+			log_error() << "pop_all_less_than left " << pq2.top() << " at step " << step << endl;
+			return false;
+		}
+		if (pq.size() != pq2.size()) {
+			log_error() << "Size is " << pq.size() << ", expected " << pq2.size() << endl;
+			return false;
+		}
+	}
+
+	while (!pq.empty()) {
+		got.clear();
+		pq.pop_n(777, std::back_inserter(got));
+		if (got.size() != std::min<size_t>(777, pq2.size())) {
+			log_error() << "pop_n popped " << got.size() << " items" << endl;
+			return false;
+		}
+		for (size_t i = 0; i < got.size(); ++i) {
+			if (got[i] != pq2.top()) {
+				log_error() << "pop_n got " << got[i] << ", expected " << pq2.top() << endl;
+				return false;
+			}
+			pq2.pop();
+		}
+	}
+	return pq2.empty();
+}
+
+// Run basic_pq_test and report the bytes read and written.
+bool compressed_run(compression_flags flags, stream_size_type & io) {
+	stream_size_type before = get_bytes_read() + get_bytes_written();
+	{
+		// Little memory and small blocks, so that the group buffers on disk
+		// are refilled many times.
+		ami::priority_queue<boost::uint64_t, bit_pertume_compare< std::greater<boost::uint64_t> > >
+			pq(static_cast<memory_size_type>(512*1024), 1.0f/64, flags);
+		if (!basic_pq_test(pq, 400000)) return false;
+	}
+	io = get_bytes_read() + get_bytes_written() - before;
+	return true;
+}
+
+bool compressed_test() {
+	stream_size_type plain;
+	stream_size_type compressed;
+	if (!compressed_run(compression_none, plain)) return false;
+	if (!compressed_run(compression_all, compressed)) return false;
+	log_debug() << "I/O without compression " << plain
+				<< ", with compression " << compressed << std::endl;
+	TEST_ENSURE(plain > 0, "No I/O without compression");
+	if (compression_scheme_available(compression_scheme::snappy)) {
+		TEST_ENSURE(compressed < plain, "Compression did not save I/O");
+	} else {
+		// The blocks are stored raw; only rewriting the group buffers and
+		// the block headers add I/O.
+		TEST_ENSURE(compressed < 2 * plain, "Too much I/O with compression");
+	}
+	return true;
+}
+
 template <typename T>
 bool remove_group_buffer_test(memory_size_type mmAvail, float blockFact, stream_size_type items, stream_size_type iterations) {
 	log_debug() << "blockFact = " << blockFact << "\nmmAvail = " << mmAvail << endl;
@@ -290,6 +381,8 @@ int main(int argc, char **argv) {
 	return tpie::tests(argc, argv, 128)
 		.test(basic_test, "basic")
 		.test(medium_instance, "medium")
+		.test(bulk_test, "bulk")
+		.test(compressed_test, "compressed")
 		.test(large_instance<false>, "large")
 		.test(large_cycle, "large_cycle")
 		.test(memory_test, "memory")
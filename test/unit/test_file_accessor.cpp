@@ -0,0 +1,247 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino+=(0 :
+// Copyright 2014 The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <tpie/array.h>
+#include <tpie/tempname.h>
+#include <tpie/file_accessor/file_accessor.h>
+#include <tpie/file_stream.h>
+#include <boost/thread.hpp>
+#ifdef TPIE_HAS_IO_URING
+#include <tpie/file_accessor/uring.h>
+#endif
+
+using namespace tpie;
+
+namespace {
+
+const memory_size_type preadChunk = 4096;
+const memory_size_type preadChunks = 64;
+
+struct pread_worker {
+	default_raw_file_accessor * fa;
+	memory_size_type first;
+	memory_size_type step;
+	bool * ok;
+
+	void operator()() {
+		std::vector<char> buf(preadChunk);
+		for (memory_size_type c = first; c < preadChunks; c += step) {
+			fa->pread_i(c * preadChunk, &buf[0], preadChunk);
+			for (memory_size_type i = 0; i < preadChunk; ++i)
+				if (buf[i] != static_cast<char>(c + i)) *ok = false;
+		}
+	}
+};
+
+} // unnamed namespace
+
+bool concurrent_pread_test() {
+	temp_file tmp;
+	default_raw_file_accessor fa;
+	fa.open_rw_new(tmp.path());
+	std::vector<char> buf(preadChunk);
+	// Write the chunks in reverse order to check that the file position
+	// does not matter.
+	for (memory_size_type c = preadChunks; c--;) {
+		for (memory_size_type i = 0; i < preadChunk; ++i) buf[i] = static_cast<char>(c + i);
+		fa.pwrite_i(c * preadChunk, &buf[0], preadChunk);
+	}
+	TEST_ENSURE_EQUALITY(preadChunk * preadChunks, fa.file_size_i(), "Wrong file size");
+
+	const memory_size_type threads = 4;
+	bool ok[threads];
+	boost::thread_group group;
+	for (memory_size_type t = 0; t < threads; ++t) {
+		ok[t] = true;
+		pread_worker w = {&fa, t, threads, &ok[t]};
+		group.create_thread(w);
+	}
+	group.join_all();
+	for (memory_size_type t = 0; t < threads; ++t)
+		TEST_ENSURE(ok[t], "Wrong data read by thread " << t);
+	return true;
+}
+
+bool memory_mapped_test(size_t n) {
+	temp_file tmp;
+	{
+		uncompressed_stream<size_t> s;
+		s.open(tmp);
+		for (size_t i = 0; i < n; ++i) s.write(i * 3);
+	}
+
+	uncompressed_stream<size_t> s;
+	s.set_memory_mapped(true);
+	s.open(tmp, access_read, 0, access_random);
+
+	// Random seeks followed by reads.
+	for (size_t k = 0; k < 1000; ++k) {
+		size_t i = (k * 7919) % n;
+		s.seek(i);
+		TEST_ENSURE_EQUALITY(i * 3, s.read(), "Wrong item after seek");
+	}
+
+	// Zero-copy views covering the entire stream.
+	s.seek(0);
+	size_t i = 0;
+	while (s.can_read()) {
+		array_view<const size_t> v = s.read_block_view();
+		TEST_ENSURE(v.size() > 0, "Empty block view");
+		for (size_t j = 0; j < v.size(); ++j, ++i)
+			TEST_ENSURE_EQUALITY(i * 3, v[j], "Wrong item in block view");
+	}
+	TEST_ENSURE_EQUALITY(n, i, "Wrong number of items in block views");
+	s.close();
+
+	// Compressed streams copy out of the mapping.
+	temp_file tmp2;
+	{
+		file_stream<size_t> fs;
+		fs.open(tmp2);
+		for (size_t j = 0; j < n; ++j) fs.write(j * 5);
+	}
+	file_stream<size_t> fs;
+	fs.set_memory_mapped(true);
+	fs.open(tmp2, access_read);
+	for (size_t j = 0; j < n; ++j)
+		TEST_ENSURE_EQUALITY(j * 5, fs.read(), "Wrong item in compressed stream");
+	TEST_ENSURE(!fs.can_read(), "Too many items in compressed stream");
+	return true;
+}
+
+#ifdef TPIE_HAS_IO_URING
+typedef file_accessor::stream_accessor<file_accessor::uring> uring_accessor;
+
+bool uring_test() {
+	temp_file tmp;
+	const memory_size_type blockSize = 4096;
+	const memory_size_type blockItems = blockSize / sizeof(int);
+	const memory_size_type blocks = 10;
+	array<int> block(blockItems);
+	{
+		uring_accessor fa;
+		fa.open(tmp.path(), false, true, sizeof(int), blockSize, 16, access_sequential, false);
+		for (memory_size_type b = 0; b < blocks; ++b) {
+			for (memory_size_type i = 0; i < blockItems; ++i) block[i] = static_cast<int>(b * blockItems + i);
+			fa.write_block(block.get(), b, b + 1 == blocks ? blockItems / 2 : blockItems);
+		}
+		int userData = 42;
+		fa.write_user_data(&userData, sizeof(userData));
+	}
+	uring_accessor fa;
+	fa.open(tmp.path(), true, false, sizeof(int), blockSize, 16, access_sequential, false);
+	TEST_ENSURE_EQUALITY((blocks - 1) * blockItems + blockItems / 2, fa.size(), "Wrong stream size");
+	int userData = 0;
+	TEST_ENSURE_EQUALITY(sizeof(userData), fa.read_user_data(&userData, sizeof(userData)), "Wrong user data size");
+	TEST_ENSURE_EQUALITY(42, userData, "Wrong user data");
+	for (memory_size_type b = blocks; b--;) {
+		memory_size_type expected = b + 1 == blocks ? blockItems / 2 : blockItems;
+		memory_size_type n = fa.read_block(block.get(), b, blockItems);
+		TEST_ENSURE_EQUALITY(expected, n, "Wrong item count");
+		for (memory_size_type i = 0; i < n; ++i)
+			TEST_ENSURE_EQUALITY(static_cast<int>(b * blockItems + i), block[i], "Wrong item");
+	}
+	return true;
+}
+
+bool uring_async_test() {
+	temp_file tmp;
+	const memory_size_type chunk = 8192;
+	const memory_size_type chunks = file_accessor::uring::queue_depth();
+	array<char> data(chunk * chunks);
+	for (memory_size_type i = 0; i < data.size(); ++i) data[i] = static_cast<char>(i * 7 + i / chunk);
+
+	file_accessor::uring fa;
+	fa.open_rw_new(tmp.path());
+	if (!fa.is_asynchronous())
+		tpie::log_warning() << "io_uring not available; testing the synchronous fallback" << std::endl;
+
+	array<file_accessor::uring::ticket_t> tickets(chunks);
+	for (memory_size_type i = 0; i < chunks; ++i)
+		tickets[i] = fa.submit_write(i * chunk, data.get() + i * chunk, chunk);
+	fa.flush();
+	for (memory_size_type i = chunks; i--;)
+		TEST_ENSURE_EQUALITY(chunk, fa.wait(tickets[i]), "Wrong write size");
+	TEST_ENSURE_EQUALITY(chunk * chunks, fa.file_size_i(), "Wrong file size");
+
+	array<char> readBack(chunk * chunks);
+	for (memory_size_type i = 0; i < chunks; ++i)
+		tickets[i] = fa.submit_read(i * chunk, readBack.get() + i * chunk, chunk);
+	bool tooMany = false;
+	try {
+		fa.submit_read(0, readBack.get(), chunk);
+	} catch (const tpie::exception &) {
+		tooMany = true;
+	}
+	TEST_ENSURE(tooMany, "Submitting more than queue_depth() requests should fail");
+	fa.wait_all();
+	TEST_ENSURE(readBack == data, "Wrong data read back");
+
+	// A read past the end of the file is short.
+	file_accessor::uring::ticket_t t = fa.submit_read(chunk * chunks - 100, readBack.get(), chunk);
+	TEST_ENSURE_EQUALITY(100, fa.wait(t), "Wrong size of read at end of file");
+	return true;
+}
+
+// Destroying the accessor while a failing request is outstanding must not
+// throw.
+bool uring_destroy_test() {
+	temp_file tmp;
+	array<char> data(4096, 'x');
+	array<char> readBack(4096);
+	{
+		file_accessor::uring fa;
+		fa.open_rw_new(tmp.path());
+		fa.write_i(data.get(), data.size());
+	}
+	file_accessor::uring fa;
+	fa.open_ro(tmp.path());
+	fa.submit_write(0, data.get(), data.size()); // fails with EBADF
+	fa.submit_read(0, readBack.get(), readBack.size());
+	fa.flush();
+	return true;
+}
+
+#else // TPIE_HAS_IO_URING
+
+bool uring_test() {
+	tpie::log_warning() << "ut-file_accessor: No io_uring support built in!" << std::endl;
+	return true;
+}
+
+bool uring_async_test() {
+	return uring_test();
+}
+
+bool uring_destroy_test() {
+	return uring_test();
+}
+
+#endif // TPIE_HAS_IO_URING
+
+int main(int argc, char ** argv) {
+	return tpie::tests(argc, argv)
+	.test(concurrent_pread_test, "concurrent_pread")
+	.test(memory_mapped_test, "memory_mapped", "n", static_cast<size_t>((1 << 20) + 12345))
+	.test(uring_test, "uring")
+	.test(uring_async_test, "uring_async")
+	.test(uring_destroy_test, "uring_destroy")
+	;
+}
@@ -29,7 +29,7 @@
 // clear                     TODO
 // empty                     TODO
 // get_array                 TODO
-// insert                    TODO
+// insert                    insert
 // make_safe                 TODO
 // pop                       basic
 // pop_and_push              TODO
@@ -53,6 +53,26 @@ bool large_cycle(){
 	return cyclic_pq_test(pq, x, 20000000);
 }
 
+// Small ranges are sifted up one element at a time, large ones make a
+// new heap; both must leave a valid heap.
+bool insert_test() {
+	const size_t n = 10000;
+	internal_priority_queue<size_t> pq(2*n);
+	std::vector<size_t> items;
+	for (size_t i = 0; i < n; ++i) items.push_back((i * 7919) % n);
+	pq.insert(items.begin(), items.end());
+	for (size_t i = 0; i < n; i += 10) {
+		std::vector<size_t> few(items.begin() + i, items.begin() + i + 10);
+		pq.insert(few.begin(), few.end());
+	}
+	TEST_ENSURE_EQUALITY(2*n, pq.size(), "Wrong size after insert");
+	for (size_t i = 0; i < 2*n; ++i) {
+		TEST_ENSURE_EQUALITY(i / 2, pq.top(), "Wrong top after insert");
+		pq.pop();
+	}
+	return true;
+}
+
 class my_memory_test: public memory_test {
 public:
 	internal_priority_queue<int> * a;
@@ -64,6 +84,7 @@ public:
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(basic_test, "basic")
+		.test(insert_test, "insert")
 		.test(large_cycle, "large_cycle")
 		.test(my_memory_test(), "memory");
 }
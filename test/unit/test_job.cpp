@@ -60,8 +60,64 @@ bool repeat_test() {
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Job that enqueues and joins a number of subjobs, recursively. With more
+/// nested joins than worker threads, this only finishes if join() runs
+/// pending jobs while waiting.
+///////////////////////////////////////////////////////////////////////////////
+class tree_job : public tpie::job {
+	size_t m_depth;
+	size_t m_fanout;
+	boost::atomic<size_t> * m_leaves;
+public:
+	tree_job(size_t depth, size_t fanout, boost::atomic<size_t> * leaves)
+		: m_depth(depth)
+		, m_fanout(fanout)
+		, m_leaves(leaves)
+	{
+	}
+
+	void operator()() {
+		if (m_depth == 0) {
+			++*m_leaves;
+			return;
+		}
+		tpie::array<tpie::auto_ptr<tree_job> > children(m_fanout);
+		for (size_t i = 0; i < m_fanout; ++i) {
+			children[i].reset(tpie::tpie_new<tree_job>(m_depth - 1, m_fanout, m_leaves));
+			children[i]->enqueue();
+		}
+		for (size_t i = 0; i < m_fanout; ++i) children[i]->join();
+	}
+};
+
+bool nested_join_test(size_t depth) {
+	const size_t fanout = 4;
+	boost::atomic<size_t> leaves(0);
+	tree_job root(depth, fanout, &leaves);
+	root.enqueue();
+	root.join();
+	size_t expected = 1;
+	for (size_t i = 0; i < depth; ++i) expected *= fanout;
+	TEST_ENSURE_EQUALITY(expected, leaves.load(), "Wrong number of leaf jobs run");
+	return true;
+}
+
+bool many_test(size_t n) {
+	tpie::array<size_t> counters(n, 0);
+	tpie::array<tpie::auto_ptr<test_job> > jobs(n);
+	for (size_t i = 0; i < n; ++i) jobs[i].reset(tpie::tpie_new<test_job>(&counters[i]));
+	for (size_t i = 0; i < n; ++i) jobs[i]->enqueue();
+	for (size_t i = 0; i < n; ++i) jobs[i]->join();
+	for (size_t i = 0; i < n; ++i)
+		TEST_ENSURE_EQUALITY(1, counters[i], "Job " << i << " did not run exactly once");
+	return true;
+}
+
 int main(int argc, char **argv) {
 	return tpie::tests(argc, argv)
 		.test(repeat_test, "repeat")
+		.test(nested_join_test, "nested_join", "depth", static_cast<size_t>(6))
+		.test(many_test, "many", "n", static_cast<size_t>(10000))
 		;
 }
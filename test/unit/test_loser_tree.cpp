@@ -0,0 +1,115 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <tpie/loser_tree.h>
+#include <tpie/mergeheap.h>
+#include <vector>
+#include <algorithm>
+
+using namespace tpie;
+
+typedef std::vector<std::vector<int> > runs_t;
+
+// Generate k sorted runs of varying length, some of them empty.
+static void make_runs(runs_t & runs, size_t k) {
+	runs.clear();
+	runs.resize(k);
+	for (size_t i = 0; i < k; ++i) {
+		size_t n = (i % 5 == 3) ? 0 : (i * 7919) % 100 + 1;
+		for (size_t j = 0; j < n; ++j) runs[i].push_back(rand() % 1000);
+		std::sort(runs[i].begin(), runs[i].end());
+	}
+}
+
+static bool check_output(const runs_t & runs, const std::vector<int> & output) {
+	std::vector<int> expected;
+	for (size_t i = 0; i < runs.size(); ++i)
+		expected.insert(expected.end(), runs[i].begin(), runs[i].end());
+	std::sort(expected.begin(), expected.end());
+	if (output != expected) {
+		log_error() << "Merged " << output.size() << " items, expected "
+					<< expected.size() << " items in sorted order" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool basic_test() {
+	for (size_t k = 1; k < 70; ++k) {
+		runs_t runs;
+		make_runs(runs, k);
+		std::vector<size_t> pos(k, 0);
+		loser_tree<int> tree(k);
+		for (size_t i = 0; i < k; ++i)
+			if (!runs[i].empty()) tree.unsafe_set(i, runs[i][pos[i]++]);
+		tree.make_safe();
+
+		std::vector<int> output;
+		while (!tree.empty()) {
+			size_t i = tree.top_index();
+			output.push_back(tree.top());
+			if (pos[i] < runs[i].size())
+				tree.pop_and_push(runs[i][pos[i]++]);
+			else
+				tree.pop();
+		}
+		if (!check_output(runs, output)) {
+			log_error() << "with " << k << " runs" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool merge_heap_test() {
+	const size_t k = 37;
+	runs_t runs;
+	make_runs(runs, k);
+	std::vector<size_t> pos(k, 0);
+	ami::merge_loser_tree_op<int> heap;
+	heap.allocate(k);
+	for (size_t i = 0; i < k; ++i)
+		if (!runs[i].empty()) heap.insert(&runs[i][pos[i]++], i);
+	heap.initialize();
+
+	std::vector<int> output;
+	while (heap.sizeofheap() > 0) {
+		size_t i = heap.get_min_run_id();
+		output.push_back(runs[i][pos[i]-1]);
+		heap.delete_min_and_insert(pos[i] < runs[i].size() ? &runs[i][pos[i]++] : 0);
+	}
+	heap.deallocate();
+	return check_output(runs, output);
+}
+
+class my_memory_test: public memory_test {
+public:
+	loser_tree<int> * a;
+	virtual void alloc() {a = tpie_new<loser_tree<int> >(123456);}
+	virtual void free() {tpie_delete(a);}
+	virtual size_type claimed_size() {return static_cast<size_type>(loser_tree<int>::memory_usage(123456));}
+};
+
+int main(int argc, char **argv) {
+	return tpie::tests(argc, argv)
+		.test(basic_test, "basic")
+		.test(merge_heap_test, "merge_heap")
+		.test(my_memory_test(), "memory");
+}
@@ -21,6 +21,8 @@
 #include <tpie/pipelining/merge_sorter.h>
 #include <tpie/parallel_sort.h>
 #include <tpie/sysinfo.h>
+#include <tpie/stats.h>
+#include <tpie/tpie.h>
 #include <boost/random.hpp>
 
 using namespace tpie;
@@ -150,6 +152,259 @@ bool tall_tree_test(size_t fanout, size_t height) {
 	return true;
 }
 
+bool pull_block_test(size_t runs) {
+	const memory_size_type runLength = get_block_size() / sizeof(size_t);
+	const memory_size_type items = runs * runLength;
+	merge_sorter<size_t, false> s;
+	s.set_parameters(runLength, 4);
+	s.begin();
+	boost::rand48 rng;
+	size_t pushedSum = 0;
+	for (size_t i = 0; i < items; ++i) {
+		// Long stretches of consecutive items exercise the galloping in
+		// merger::pull; the rest are random.
+		size_t x = (i % 1000 < 500) ? rng() % items : i;
+		pushedSum += x;
+		s.push(x);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	size_t prev = 0;
+	size_t pulledSum = 0;
+	memory_size_type pulled = 0;
+	while (s.can_pull()) {
+		array_view<const size_t> block = s.pull_block();
+		if (block.size() == 0) {
+			log_error() << "Got an empty block" << std::endl;
+			return false;
+		}
+		for (array_view<const size_t>::iterator i = block.begin(); i != block.end(); ++i) {
+			if (*i < prev) {
+				log_error() << "Out of order" << std::endl;
+				return false;
+			}
+			prev = *i;
+			pulledSum += *i;
+		}
+		pulled += block.size();
+	}
+	if (pulled != items || pulledSum != pushedSum) {
+		log_error() << "Pulled " << pulled << " items, expected " << items << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool parallel_merge_test(size_t jobs) {
+	const memory_size_type runLength = get_block_size() / sizeof(size_t);
+	const memory_size_type runs = 100;
+	const memory_size_type items = runs * runLength;
+	merge_sorter<size_t, false> s;
+	s.set_parallel_merge(jobs);
+	s.set_parameters(runLength, 4);
+	s.begin();
+	boost::rand48 rng;
+	size_t pushedSum = 0;
+	for (size_t i = 0; i < items; ++i) {
+		size_t x = rng() % items;
+		pushedSum += x;
+		s.push(x);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	size_t prev = 0;
+	size_t pulledSum = 0;
+	memory_size_type pulled = 0;
+	while (s.can_pull()) {
+		size_t x = s.pull();
+		if (x < prev) {
+			log_error() << "Out of order" << std::endl;
+			return false;
+		}
+		prev = x;
+		pulledSum += x;
+		++pulled;
+	}
+	if (pulled != items || pulledSum != pushedSum) {
+		log_error() << "Pulled " << pulled << " items, expected " << items << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// With direct I/O, the run files must be written and read through O_DIRECT.
+bool direct_io_test(size_t runs) {
+	const memory_size_type runLength = get_block_size() / sizeof(size_t);
+	const memory_size_type items = runs * runLength;
+	set_direct_io_temp_files(true);
+	const stream_size_type requestsBefore = get_direct_io_requests();
+	bool result = true;
+	{
+		merge_sorter<size_t, false> s;
+		s.set_parameters(runLength, 4);
+		s.begin();
+		boost::rand48 rng;
+		for (size_t i = 0; i < items; ++i) s.push(rng() % items);
+		s.end();
+		dummy_progress_indicator pi;
+		s.calc(pi);
+		size_t prev = 0;
+		memory_size_type pulled = 0;
+		while (s.can_pull()) {
+			size_t x = s.pull();
+			if (x < prev) {
+				log_error() << "Out of order" << std::endl;
+				result = false;
+				break;
+			}
+			prev = x;
+			++pulled;
+		}
+		if (result && pulled != items) {
+			log_error() << "Pulled " << pulled << " items, expected " << items << std::endl;
+			result = false;
+		}
+	}
+	set_direct_io_temp_files(false);
+	const stream_size_type requests = get_direct_io_requests() - requestsBefore;
+	log_debug() << requests << " direct I/O requests" << std::endl;
+	// Every run is written once and read at least once in whole blocks.
+	if (result && requests < 2 * runs) {
+		log_error() << "Only " << requests << " direct I/O requests" << std::endl;
+		result = false;
+	}
+	return result;
+}
+
+// The I/O predicted for a memory amount must match the I/O of a sort that
+// is given that memory. With less memory, runs are shorter than a block, and
+// appending them to the run files costs I/O that is not modelled.
+bool predict_io_test(size_t memory) {
+	const stream_size_type items = 1000000;
+	merge_sorter<size_t, false> s;
+	s.set_item_estimate(items);
+	const stream_size_type predicted = s.predict_io_phase_1(memory);
+	s.set_available_memory(memory);
+	const stream_size_type before = get_bytes_read() + get_bytes_written();
+	s.begin();
+	boost::rand48 rng;
+	for (stream_size_type i = 0; i < items; ++i) s.push(rng());
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	while (s.can_pull()) s.pull();
+	const stream_size_type actual = get_bytes_read() + get_bytes_written() - before;
+	log_debug() << "Predicted " << predicted << " b of I/O, actual " << actual << " b" << std::endl;
+	// Stream headers and partial blocks are not part of the prediction.
+	if (actual < predicted || actual > predicted + predicted / 10) {
+		log_error() << "Predicted " << predicted << " b of I/O, but the sort did "
+					<< actual << " b" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Without an item estimate, the run memory is split between two buffers.
+// An input that fills more than one buffer but fits in memory must still be
+// reported internally, and a larger input must be sorted through runs of the
+// shorter length. fill is relative to the memory left after a stream; other
+// structures use about a fourth of the rest at 16 MB.
+bool double_buffer_test(size_t memory, double fill) {
+	const stream_size_type memoryItems =
+		(memory - file_stream<size_t>::memory_usage()) / sizeof(size_t);
+	const stream_size_type items = static_cast<stream_size_type>(memoryItems * fill);
+	merge_sorter<size_t, false> s;
+	s.set_available_memory(memory);
+	s.begin();
+	boost::rand48 rng;
+	for (stream_size_type i = 0; i < items; ++i) s.push(rng());
+	s.end();
+	const bool internal = fill < 1.0;
+	if (internal && s.get_bytes_written() != 0) {
+		log_error() << "Wrote " << s.get_bytes_written() << " b for " << items
+					<< " items that fit in memory" << std::endl;
+		return false;
+	}
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	size_t prev = 0;
+	stream_size_type pulled = 0;
+	while (s.can_pull()) {
+		size_t x = s.pull();
+		if (x < prev) {
+			log_error() << "Out of order" << std::endl;
+			return false;
+		}
+		prev = x;
+		++pulled;
+	}
+	if (pulled != items) {
+		log_error() << "Pulled " << pulled << " items, expected " << items << std::endl;
+		return false;
+	}
+	if (!internal && s.get_bytes_written() < items * sizeof(size_t)) {
+		log_error() << "Wrote " << s.get_bytes_written() << " b for " << items
+					<< " items that do not fit in memory" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+struct radix_record {
+	boost::int64_t key;
+	size_t index;
+};
+
+struct radix_record_key {
+	typedef boost::int64_t key_type;
+
+	key_type operator()(const radix_record & r) const {
+		return r.key;
+	}
+};
+
+bool radix_test() {
+	const memory_size_type runLength = 100000;
+	const memory_size_type items = 5 * runLength + 123;
+	merge_sorter<radix_record, false, radix_less<radix_record_key> > s;
+	s.set_parameters(runLength, 4);
+	s.begin();
+	boost::rand48 rng;
+	for (size_t i = 0; i < items; ++i) {
+		radix_record r;
+		r.key = static_cast<boost::int64_t>(rng()) - (1 << 30);
+		r.index = i;
+		s.push(r);
+	}
+	s.end();
+	dummy_progress_indicator pi;
+	s.calc(pi);
+	std::vector<bool> seen(items);
+	boost::int64_t prev = std::numeric_limits<boost::int64_t>::min();
+	memory_size_type pulled = 0;
+	while (s.can_pull()) {
+		radix_record r = s.pull();
+		if (r.key < prev) {
+			log_error() << "Out of order" << std::endl;
+			return false;
+		}
+		if (r.index >= items || seen[r.index]) {
+			log_error() << "Bad item " << r.index << std::endl;
+			return false;
+		}
+		seen[r.index] = true;
+		prev = r.key;
+		++pulled;
+	}
+	if (pulled != items) {
+		log_error() << "Pulled " << pulled << " items, expected " << items << std::endl;
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	tests t(argc, argv);
 	return
@@ -157,5 +412,13 @@ int main(int argc, char ** argv) {
 		.test(sort_upper_bound_test, "sort_upper_bound")
 		.test(temp_file_usage_test, "temp_file_usage")
 		.test(tall_tree_test, "tall_tree", "fanout", static_cast<size_t>(6), "height", static_cast<size_t>(1))
+		.test(pull_block_test, "pull_block", "runs", static_cast<size_t>(20))
+		.test(pull_block_test, "pull_block_internal", "runs", static_cast<size_t>(1))
+		.test(parallel_merge_test, "parallel_merge", "jobs", static_cast<size_t>(4))
+		.test(radix_test, "radix")
+		.test(direct_io_test, "direct_io", "runs", static_cast<size_t>(20))
+		.test(predict_io_test, "predict_io", "memory", static_cast<size_t>(16*1024*1024))
+		.test(double_buffer_test, "double_buffer_internal", "memory", static_cast<size_t>(16*1024*1024), "fill", 0.55)
+		.test(double_buffer_test, "double_buffer_external", "memory", static_cast<size_t>(16*1024*1024), "fill", 3.5)
 		;
 }
@@ -285,6 +285,44 @@ bool large_item_test_chooser(size_t mb, size_t itemSize) {
 	return large_item_test_helper<0, 8>::go(mb, itemSize);
 }
 
+template <typename T>
+bool radix_test_type(size_t elements) {
+	boost::rand48 prng(42);
+	std::vector<T> v1(elements);
+	for (size_t i = 0; i < elements; ++i)
+		v1[i] = static_cast<T>((static_cast<boost::uint64_t>(prng()) << 32) ^ prng());
+	std::vector<T> v2(v1);
+
+	boost::posix_time::ptime start=boost::posix_time::microsec_clock::local_time();
+	std::sort(v1.begin(), v1.end());
+	boost::posix_time::ptime mid=boost::posix_time::microsec_clock::local_time();
+	tpie::parallel_sort(v2.begin(), v2.end(), radix_less<identity_radix_key<T> >());
+	boost::posix_time::ptime end=boost::posix_time::microsec_clock::local_time();
+	tpie::log_info() << sizeof(T) << "-byte keys: std::sort took " << mid-start
+					 << ", radix sort took " << end-mid << std::endl;
+
+	if (v1 != v2) {
+		tpie::log_error() << "std::sort and radix sort disagree" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool radix_test(size_t elements) {
+	// Few distinct keys make radix sort skip bytes.
+	std::vector<int> v(elements);
+	make_equal_elements_data(v);
+	radix_sort(v.begin(), v.end(), identity_radix_key<int>());
+	if (v[0] != 1 || v[elements-1] != 64 || !std::equal(v.begin()+1, v.end()-2, v.begin()+2)) {
+		tpie::log_error() << "Equal elements not sorted" << std::endl;
+		return false;
+	}
+	return radix_test_type<boost::uint64_t>(elements)
+		&& radix_test_type<boost::int64_t>(elements)
+		&& radix_test_type<boost::int32_t>(elements)
+		&& radix_test_type<boost::uint16_t>(elements);
+}
+
 template <size_t stdsort_limit>
 struct sort_tester {
 	bool operator()(size_t n) {
@@ -302,6 +340,7 @@ int main(int argc, char **argv) {
 		.test(adversarial<make_equal_elements_data>(), "equal_elements", "n", 1234567, "seconds", 1.0)
 		.test(bad_case, "bad_case", "n", 1024*1024, "seconds", 1.0)
 		.test(adversarial<make_random_data>(), "general2", "n", 1024*1024, "seconds", 1.0)
+		.test(radix_test, "radix", "n", 4*1024*1024)
 		.test(stress_test, "stress_test")
 		.test(large_item_test_chooser, "large_item", "mb", static_cast<size_t>(2048), "item-size", static_cast<size_t>(32))
 		;
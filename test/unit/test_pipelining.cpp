@@ -25,6 +25,7 @@
 #include <tpie/sysinfo.h>
 #include <tpie/pipelining/virtual.h>
 #include <tpie/progress_indicator_arrow.h>
+#include <boost/thread.hpp>
 
 using namespace tpie;
 using namespace tpie::pipelining;
@@ -416,6 +417,111 @@ bool sort_test(size_t elements) {
 	return result;
 }
 
+bool parallel_phases_test(size_t elements) {
+	bool result1 = false;
+	bool result2 = false;
+	pipeline p = sequence_generator(elements, true)
+		| fork(sort() | sequence_verifier(elements, &result1))
+		| sort() | sequence_verifier(elements, &result2);
+	p.set_parallel_phases();
+	p();
+	return result1 && result2;
+}
+
+// Throws out_of_space_exception when it ends in another thread than the one
+// that runs the pipeline.
+struct throw_in_thread_type : public node {
+	typedef size_t item_type;
+
+	throw_in_thread_type(boost::thread::id mainThread)
+		: mainThread(mainThread)
+	{
+	}
+
+	inline void push(size_t) {
+	}
+
+	virtual void end() override {
+		if (boost::this_thread::get_id() != mainThread)
+			throw out_of_space_exception("Phase in another thread");
+	}
+
+private:
+	boost::thread::id mainThread;
+};
+
+typedef pipe_end<termfactory_1<throw_in_thread_type, boost::thread::id> >
+	throw_in_thread;
+
+// An exception in a phase run by another thread must reach the caller with
+// its type.
+bool parallel_phases_exception_test() {
+	boost::thread::id mainThread = boost::this_thread::get_id();
+	pipeline p = sequence_generator(1000, true)
+		| fork(sort() | throw_in_thread(mainThread))
+		| sort() | throw_in_thread(mainThread);
+	p.set_parallel_phases();
+	try {
+		p();
+	} catch (const out_of_space_exception &) {
+		return true;
+	} catch (const std::exception & e) {
+		log_error() << "Caught the wrong exception type: " << e.what() << std::endl;
+		return false;
+	}
+	log_error() << "No exception was thrown" << std::endl;
+	return false;
+}
+
+// Verifies a sorted sequence and counts the calls it gets to push a range.
+struct range_verifier_type : public node {
+	typedef size_t item_type;
+
+	range_verifier_type(size_t * expect, size_t * ranges)
+		: expect(expect)
+		, ranges(ranges)
+	{
+	}
+
+	inline void push(size_t element) {
+		if (element != *expect) {
+			log_error() << "Got " << element << ", expected " << *expect << std::endl;
+			throw tpie::exception("Items out of order");
+		}
+		++*expect;
+	}
+
+	template <typename IT>
+	inline void push(IT begin, IT end) {
+		++*ranges;
+		for (IT i = begin; i != end; ++i) push(*i);
+	}
+
+private:
+	size_t * expect;
+	size_t * ranges;
+};
+
+typedef pipe_end<termfactory_2<range_verifier_type, size_t *, size_t *> >
+	range_verifier;
+
+// The sort output node must hand whole blocks to a destination that takes
+// push(begin, end).
+bool sort_range_push_test(size_t elements) {
+	size_t expect = 1;
+	size_t ranges = 0;
+	pipeline p = sequence_generator(elements, true)
+		| sort()
+		| range_verifier(&expect, &ranges);
+	p();
+	TEST_ENSURE_EQUALITY(elements + 1, expect, "Wrong number of items");
+	if (ranges == 0 || ranges >= elements) {
+		log_error() << "Got " << elements << " items in " << ranges << " ranges" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 bool sort_test_trivial() {
 	TEST_ENSURE(sort_test(0), "Cannot sort 0 elements");
 	TEST_ENSURE(sort_test(1), "Cannot sort 1 element");
@@ -1188,6 +1294,55 @@ bool parallel_ordered_test(size_t modulo) {
 	return result;
 }
 
+bool parallel_pinned_test(size_t modulo) {
+	const worker_placement_type placements[] = {pin_workers_to_cpus, pin_workers_to_numa_nodes};
+	for (size_t i = 0; i < 2; ++i) {
+		bool result = false;
+		pipeline p = sequence_generator(modulo-1, false)
+			| parallel(multiplicative_inverter(modulo) | multiplicative_inverter(modulo),
+					   maintain_order, 4, 64, placements[i])
+			| sequence_verifier(modulo-1, &result);
+		p();
+		if (!result) return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Progress indicator recording the distinct batch sizes shown by an adaptive
+/// parallel stage.
+///////////////////////////////////////////////////////////////////////////////
+class batch_size_recorder : public tpie::progress_indicator_base {
+public:
+	batch_size_recorder() : tpie::progress_indicator_base(0) {}
+
+	virtual void refresh() override {}
+
+	virtual void push_breadcrumb(const char * crumb, tpie::description_importance) override {
+		std::string s(crumb);
+		if (s.compare(0, 6, "Batch ") == 0
+			&& std::find(batchSizes.begin(), batchSizes.end(), s) == batchSizes.end())
+			batchSizes.push_back(s);
+	}
+
+	std::vector<std::string> batchSizes;
+};
+
+bool parallel_adaptive_test(size_t modulo) {
+	bool result = false;
+	pipeline p = sequence_generator(modulo-1, false)
+		| parallel(multiplicative_inverter(modulo) | multiplicative_inverter(modulo),
+				   maintain_order, 4, adaptive_buffer_size)
+		| sequence_verifier(modulo-1, &result);
+	batch_size_recorder pi;
+	p(modulo-1, pi);
+	// The batches start small and grow, since the workers are fast.
+	TEST_ENSURE(pi.batchSizes.size() >= 2, "Batch size did not change");
+	for (size_t i = 0; i < pi.batchSizes.size(); ++i)
+		log_debug() << pi.batchSizes[i] << std::endl;
+	return result;
+}
+
 template <typename dest_t>
 class Monotonic : public node {
 	dest_t dest;
@@ -1684,10 +1839,13 @@ int main(int argc, char ** argv) {
 	.test(sort_test_trivial, "sorttrivial")
 	.test(sort_test_small, "sort")
 	.test(sort_test_large, "sortbig")
+	.test(sort_range_push_test, "sort_range_push", "n", static_cast<size_t>(300*1024))
 	.test(operator_test, "operators")
 	.test(uniq_test, "uniq")
 	.multi_test(memory_test_multi, "memory")
 	.test(fork_test, "fork")
+	.test(parallel_phases_test, "parallel_phases", "n", static_cast<size_t>(300*1024))
+	.test(parallel_phases_exception_test, "parallel_phases_exception")
 	.test(merger_memory_test, "merger_memory", "n", static_cast<size_t>(10))
 	.test(fetch_forward_test, "fetch_forward")
 	.test(virtual_test, "virtual")
@@ -1699,6 +1857,8 @@ int main(int argc, char ** argv) {
 	.test(push_iterator_test, "push_iterator")
 	.test(parallel_test, "parallel", "modulo", static_cast<size_t>(20011))
 	.test(parallel_ordered_test, "parallel_ordered", "modulo", static_cast<size_t>(20011))
+	.test(parallel_pinned_test, "parallel_pinned", "modulo", static_cast<size_t>(20011))
+	.test(parallel_adaptive_test, "parallel_adaptive", "modulo", static_cast<size_t>(20011))
 	.test(parallel_step_test, "parallel_step")
 	.test(parallel_multiple_test, "parallel_multiple")
 	.test(parallel_own_buffer_test, "parallel_own_buffer")
@@ -164,9 +164,120 @@ bool get_phase_graph_test() {
 	return true;
 }
 
+bool get_phase_waves_test() {
+	const size_t N = 7;
+	evac_node nodes[N];
+
+	node_map::ptr nodeMap = nodes[0].get_node_map();
+	for (size_t i = 1; i < N; ++i) nodes[i].get_node_map()->union_set(nodeMap);
+	nodeMap = nodeMap->find_authority();
+
+	std::map<node *, size_t> phaseMap;
+	for (size_t i = 0; i < N; ++i) phaseMap[&nodes[i]] = i;
+
+	graph<size_t> phaseGraph;
+	for (size_t i = 0; i < N; ++i) phaseGraph.add_node(i);
+
+	phaseGraph.add_edge(0, 1);
+	phaseGraph.add_edge(0, 2);
+	phaseGraph.add_edge(1, 3);
+	phaseGraph.add_edge(2, 3);
+	phaseGraph.add_edge(3, 4);
+	phaseGraph.add_edge(3, 5);
+	phaseGraph.add_edge(4, 6);
+	phaseGraph.add_edge(5, 6);
+
+	// 0 -- 1 ---- 3 -- 4 ---- 6
+	//  \         / \         /
+	//   `---- 2 ´   `---- 5 ´
+	//
+	// 1 and 2 may run at the same time, and so may 4 and 5.
+
+	const size_t expect[N] = {0, 1, 1, 2, 3, 3, 4};
+
+	std::vector<bool> evacuateWhenDone;
+	std::vector<std::vector<node *> > phases;
+	std::vector<std::vector<size_t> > waves;
+	{
+		runtime rt(nodeMap);
+		rt.get_phases(phaseMap, phaseGraph, evacuateWhenDone, phases);
+		rt.get_phase_waves(phaseMap, phaseGraph, phases, waves);
+	}
+
+	if (waves.size() != 5) {
+		log_error() << "Expected 5 waves, got " << waves.size() << std::endl;
+		return false;
+	}
+	for (size_t w = 0; w < waves.size(); ++w) {
+		for (size_t j = 0; j < waves[w].size(); ++j) {
+			size_t phase = phaseMap[phases[waves[w][j]][0]];
+			if (expect[phase] != w) {
+				log_error() << "Phase " << phase << " is in wave " << w
+							<< ", expected " << expect[phase] << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Node that reads and writes a fixed amount
+// unless it has a certain amount of memory.
+class io_cost_node : public node {
+public:
+	io_cost_node(memory_size_type enough, stream_size_type cost)
+		: m_enough(enough)
+		, m_cost(cost)
+	{
+		set_memory_fraction(1.0);
+	}
+
+	virtual stream_size_type get_io_cost(memory_size_type memory) override {
+		return memory >= m_enough ? 0 : m_cost;
+	}
+
+private:
+	memory_size_type m_enough;
+	stream_size_type m_cost;
+};
+
+bool reserve_io_memory_test() {
+	const memory_size_type MB = 1024*1024;
+	// Splitting by the memory fractions gives 5 MB to each node, which is
+	// enough for the first node only. The second node saves more I/O.
+	io_cost_node small(3*MB, 100*MB);
+	io_cost_node large(8*MB, 1000*MB);
+	evac_node other;
+	other.set_memory_fraction(1.0);
+
+	std::vector<std::vector<node *> > phases(1);
+	phases[0].push_back(&small);
+	phases[0].push_back(&large);
+	phases[0].push_back(&other);
+	runtime::assign_memory(phases, 10*MB);
+
+	memory_size_type assigned = small.get_available_memory()
+		+ large.get_available_memory() + other.get_available_memory();
+	log_debug() << "Assigned " << small.get_available_memory() << ", "
+				<< large.get_available_memory() << " and "
+				<< other.get_available_memory() << std::endl;
+	if (assigned > 10*MB) {
+		log_error() << "Assigned " << assigned << " bytes in total" << std::endl;
+		return false;
+	}
+	if (large.get_available_memory() < 8*MB) {
+		log_error() << "The node with the most I/O got "
+					<< large.get_available_memory() << " bytes" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	return tpie::tests(argc, argv)
 	.test(evacuate_test, "evacuate")
 	.test(get_phase_graph_test, "get_phase_graph")
+	.test(get_phase_waves_test, "get_phase_waves")
+	.test(reserve_io_memory_test, "reserve_io_memory")
 	;
 }
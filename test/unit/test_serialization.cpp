@@ -257,6 +257,38 @@ bool stream_reopen_test() {
 	return true;
 }
 
+bool stream_seek_test() {
+	// Spans several blocks, and some items start at a block boundary.
+	const memory_size_type N = 3 * serialization_writer::block_size() / sizeof(memory_size_type) + 100;
+	temp_file f;
+	{
+		serialization_writer wr;
+		wr.open(f);
+		for (memory_size_type i = 0; i < N; ++i) wr.serialize(i);
+		wr.close();
+	}
+	serialization_reader rd;
+	rd.open(f);
+	memory_size_type x;
+	const memory_size_type starts[] = {
+		N / 2, 0, serialization_writer::block_size() / sizeof(memory_size_type),
+		1, 2 * serialization_writer::block_size() / sizeof(memory_size_type) - 1, N - 1 };
+	for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); ++i) {
+		rd.seek(starts[i] * sizeof(memory_size_type));
+		for (memory_size_type j = starts[i]; j < std::min(N, starts[i] + 3); ++j) {
+			TEST_ENSURE(rd.can_read(), "Expected can_read()");
+			TEST_ENSURE(rd.offset() == j * sizeof(memory_size_type), "Wrong offset");
+			rd.unserialize(x);
+			TEST_ENSURE_EQUALITY(j, x, "Wrong item after seek");
+		}
+	}
+	TEST_ENSURE(!rd.can_read(), "Expected !can_read()");
+	rd.seek(N * sizeof(memory_size_type));
+	TEST_ENSURE(!rd.can_read(), "Expected !can_read() at the end");
+	rd.close();
+	return true;
+}
+
 bool stream_reverse_test() {
 	bool result = true;
 
@@ -363,6 +395,7 @@ int main(int argc, char ** argv) {
 		.test(stream_test, "stream")
 		.test(stream_dtor_test, "stream_dtor")
 		.test(stream_reopen_test, "stream_reopen")
+		.test(stream_seek_test, "stream_seek")
 		.test(stream_reverse_test, "stream_reverse")
 		.test(stream_temp_test, "stream_temp")
 		;
@@ -0,0 +1,117 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino+=(0 :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include "common.h"
+#include <tpie/serialization_priority_queue.h>
+#include <boost/random.hpp>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+using namespace tpie;
+
+typedef serialization_priority_queue<std::string> queue_type;
+typedef std::priority_queue<std::string, std::vector<std::string>,
+							std::greater<std::string> > reference_type;
+
+// Strings of 0 to 200 characters, so the items of a run vary in size.
+static std::string random_string(boost::rand48 & rng) {
+	std::string s(rng() % 201, 'a');
+	for (size_t i = 0; i < s.size(); ++i) s[i] = static_cast<char>('a' + rng() % 26);
+	return s;
+}
+
+// Push all items, then pop them in sorted order.
+bool basic_test(size_t n) {
+	queue_type pq(queue_type::minimum_memory());
+	boost::rand48 rng(42);
+	std::vector<std::string> items;
+	for (size_t i = 0; i < n; ++i) {
+		items.push_back(random_string(rng));
+		pq.push(items.back());
+	}
+	std::sort(items.begin(), items.end());
+
+	TEST_ENSURE_EQUALITY(n, pq.size(), "Wrong size");
+	for (size_t i = 0; i < n; ++i) {
+		TEST_ENSURE(!pq.empty(), "Queue empty too soon");
+		TEST_ENSURE_EQUALITY(items[i], pq.top(), "Wrong top at " << i);
+		pq.pop();
+	}
+	TEST_ENSURE(pq.empty(), "Queue not empty");
+	return true;
+}
+
+// Mix pushes and pops, pushing more than popping until the end, and compare
+// with an internal priority queue.
+bool interleaved_test(size_t n) {
+	queue_type pq(queue_type::minimum_memory());
+	reference_type ref;
+	boost::rand48 rng(43);
+	for (size_t i = 0; i < n; ++i) {
+		if (rng() % 3 == 0 && !ref.empty()) {
+			TEST_ENSURE_EQUALITY(ref.top(), pq.top(), "Wrong top at " << i);
+			pq.pop();
+			ref.pop();
+		} else {
+			std::string s = random_string(rng);
+			pq.push(s);
+			ref.push(s);
+		}
+		TEST_ENSURE_EQUALITY(ref.size(), pq.size(), "Wrong size at " << i);
+	}
+	while (!ref.empty()) {
+		TEST_ENSURE_EQUALITY(ref.top(), pq.top(), "Wrong top");
+		pq.pop();
+		ref.pop();
+	}
+	TEST_ENSURE(pq.empty(), "Queue not empty");
+	return true;
+}
+
+// With twice the minimum memory, the fanout is six rather than two, and
+// enough runs are written to merge level 0 into level 1.
+bool fanout_test(size_t n) {
+	queue_type pq(2 * queue_type::minimum_memory());
+	// Distinct fixed-width keys in a scrambled order, so the expected order
+	// is known without storing the items.
+	char key[16];
+	for (size_t i = 0; i < n; ++i) {
+		sprintf(key, "%09lu", static_cast<unsigned long>((i * 7919) % n));
+		pq.push(key);
+	}
+	TEST_ENSURE_EQUALITY(n, pq.size(), "Wrong size");
+	for (size_t i = 0; i < n; ++i) {
+		sprintf(key, "%09lu", static_cast<unsigned long>(i));
+		TEST_ENSURE_EQUALITY(std::string(key), pq.top(), "Wrong top at " << i);
+		pq.pop();
+	}
+	TEST_ENSURE(pq.empty(), "Queue not empty");
+	return true;
+}
+
+int main(int argc, char ** argv) {
+	return tpie::tests(argc, argv)
+		.test(basic_test, "basic", "n", static_cast<size_t>(500000))
+		.test(interleaved_test, "interleaved", "n", static_cast<size_t>(1000000))
+		.test(fanout_test, "fanout", "n", static_cast<size_t>(2000000))
+		;
+}
@@ -28,6 +28,9 @@
 #include <tpie/file_stream.h>
 #include <tpie/util.h>
 #include <tpie/stats.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
 
 using namespace tpie;
 
@@ -75,7 +78,91 @@ bool simple_test(size_type size) {
 	return true;
 }
 
+bool stream_test(size_type size) {
+	stream_size_type asize=size*sizeof(uint64_t);
+	temp_file tf;
+	file_stream<uint64_t> s;
+	s.open(tf);
+	for(size_t i=0; i < size; ++i) s.write(i);
+	s.close();
+	if (!test_about(s.get_bytes_read(), 0, "stream bytes read")) return false;
+	if (!test_about(s.get_bytes_written(), asize, "stream bytes written")) return false;
+
+	// Reopening starts the counters over.
+	s.open(tf);
+	for(size_t i=0; i < size; ++i) s.read();
+	s.close();
+	if (!test_about(s.get_bytes_read(), asize, "stream bytes read")) return false;
+	if (!test_about(s.get_bytes_written(), 0, "stream bytes written")) return false;
+	return true;
+}
+
+class incrementer {
+public:
+	incrementer(size_t count) : count(count) {}
+
+	void operator()() {
+		for (size_t i = 0; i < count; ++i) {
+			increment_bytes_read(1);
+			increment_bytes_written(2);
+		}
+	}
+
+private:
+	size_t count;
+};
+
+bool threads_test(size_t threads, size_t count) {
+	stream_size_type read = get_bytes_read();
+	stream_size_type written = get_bytes_written();
+	boost::thread_group group;
+	for (size_t i = 0; i < threads; ++i) group.create_thread(incrementer(count));
+	group.join_all();
+	if (get_bytes_read() - read != threads*count) {
+		log_error() << "Counted " << get_bytes_read() - read << " bytes read, expected " << threads*count << std::endl;
+		return false;
+	}
+	if (get_bytes_written() - written != 2*threads*count) {
+		log_error() << "Counted " << get_bytes_written() - written << " bytes written, expected " << 2*threads*count << std::endl;
+		return false;
+	}
+	return true;
+}
+
+class shard_recorder {
+public:
+	shard_recorder(size_t & shard) : shard(shard) {}
+
+	void operator()() {
+		increment_bytes_read(0);
+		shard = bits::stats_shard();
+	}
+
+private:
+	size_t & shard;
+};
+
+// Every thread must update its own shard of the counters; hashing the thread
+// id used to put all threads on the same shard.
+bool shards_test(size_t threads) {
+	std::vector<size_t> shards(threads);
+	boost::thread_group group;
+	for (size_t i = 0; i < threads; ++i) group.create_thread(shard_recorder(shards[i]));
+	group.join_all();
+	std::sort(shards.begin(), shards.end());
+	for (size_t i = 1; i < threads; ++i) {
+		if (shards[i-1] == shards[i]) {
+			log_error() << "Two of " << threads << " threads share shard " << shards[i] << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 int main(int argc, char ** argv) {
 	return tpie::tests(argc, argv)
-		.test(simple_test, "simple", "size", 1024*1024*10);
+		.test(simple_test, "simple", "size", 1024*1024*10)
+		.test(stream_test, "stream", "size", 1024*1024)
+		.test(threads_test, "threads", "threads", 8, "count", 100000)
+		.test(shards_test, "shards", "threads", 16);
 }
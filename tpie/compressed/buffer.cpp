@@ -19,9 +19,40 @@
 
 #include <tpie/compressed/stream.h>
 #include <tpie/compressed/buffer.h>
+#ifdef WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
 
 namespace tpie {
 
+/*static*/ char * compressor_buffer::allocate_storage(memory_size_type capacity) {
+	if (capacity == 0) return 0;
+	get_memory_manager().register_allocation(capacity);
+	void * storage;
+#ifdef WIN32
+	storage = _aligned_malloc(capacity, ALIGNMENT);
+	if (storage == 0) {
+#else
+	if (posix_memalign(&storage, ALIGNMENT, capacity) != 0) {
+#endif
+		get_memory_manager().register_deallocation(capacity);
+		throw std::bad_alloc();
+	}
+	return static_cast<char *>(storage);
+}
+
+/*static*/ void compressor_buffer::free_storage(char * storage, memory_size_type capacity) {
+	if (storage == 0) return;
+#ifdef WIN32
+	_aligned_free(storage);
+#else
+	free(storage);
+#endif
+	get_memory_manager().register_deallocation(capacity);
+}
+
 class stream_buffer_pool::impl {
 public:
 	typedef boost::shared_ptr<compressor_buffer> buffer_t;
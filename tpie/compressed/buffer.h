@@ -24,6 +24,7 @@
 /// \file compressed/buffer.h  Buffers for compressed streams.
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <boost/noncopyable.hpp>
 #include <tpie/array.h>
 #include <tpie/tpie_assert.h>
 #include <tpie/compressed/thread.h>
@@ -79,20 +80,29 @@ struct compressor_buffer_state {
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief  A buffer for elements belonging to a specific stream block.
+///
+/// The storage is aligned to ALIGNMENT bytes, so that whole blocks may be
+/// read and written with direct I/O.
 ///////////////////////////////////////////////////////////////////////////////
-class compressor_buffer {
-private:
-	typedef array<char> storage_t;
+class compressor_buffer : public boost::noncopyable {
+public:
+	static const memory_size_type ALIGNMENT = 4096;
 
-	storage_t m_storage;
+private:
+	char * m_storage;
+	memory_size_type m_capacity;
 	memory_size_type m_size;
 	compressor_buffer_state::type m_state;
 	stream_size_type m_readOffset;
 	memory_size_type m_blockSize;
 
+	static char * allocate_storage(memory_size_type capacity);
+	static void free_storage(char * storage, memory_size_type capacity);
+
 public:
 	compressor_buffer(memory_size_type capacity)
-		: m_storage(capacity)
+		: m_storage(allocate_storage(capacity))
+		, m_capacity(capacity)
 		, m_size(0)
 		, m_state(compressor_buffer_state::dirty)
 		, m_readOffset(1111111111111111111ull)
@@ -100,6 +110,10 @@ public:
 	{
 	}
 
+	~compressor_buffer() {
+		free_storage(m_storage, m_capacity);
+	}
+
 	compressor_buffer_state::type get_state() const {
 		return m_state;
 	}
@@ -131,14 +145,14 @@ public:
 	/// \brief  Get pointer to buffer storage.
 	///////////////////////////////////////////////////////////////////////////////
 	char * get() {
-		return m_storage.get();
+		return m_storage;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
 	/// \brief  Get pointer to buffer storage.
 	///////////////////////////////////////////////////////////////////////////////
 	const char * get() const {
-		return m_storage.get();
+		return m_storage;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
@@ -152,7 +166,7 @@ public:
 	/// \brief  Get maximal byte size of buffer.
 	///////////////////////////////////////////////////////////////////////////////
 	memory_size_type capacity() const {
-		return m_storage.size();
+		return m_capacity;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////
@@ -166,7 +180,13 @@ public:
 	/// \brief  Resize internal buffer, clearing all elements.
 	///////////////////////////////////////////////////////////////////////////////
 	void set_capacity(memory_size_type capacity) {
-		m_storage.resize(capacity);
+		if (capacity != m_capacity) {
+			free_storage(m_storage, m_capacity);
+			m_storage = 0;
+			m_capacity = 0;
+			m_storage = allocate_storage(capacity);
+			m_capacity = capacity;
+		}
 		m_size = 0;
 	}
 
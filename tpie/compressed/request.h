@@ -32,6 +32,7 @@
 #include <tpie/file_accessor/byte_stream_accessor.h>
 #include <tpie/compressed/predeclare.h>
 #include <tpie/compressed/direction.h>
+#include <tpie/compressed/scheme.h>
 
 namespace tpie {
 
@@ -57,6 +58,11 @@ public:
 		, m_endOfStream(false)
 		, m_nextReadOffset(0)
 		, m_nextBlockSize(0)
+		, m_skipCompression(0)
+		, m_incompressibleBackoff(0)
+		, m_readAheadOffset(std::numeric_limits<stream_size_type>::max())
+		, m_readAheadDirection(read_direction::forward)
+		, m_readAheadHeader(0)
 	{
 	}
 
@@ -73,6 +79,7 @@ public:
 	// write, stream
 	void clear_block_info() {
 		m_blockNumber = std::numeric_limits<stream_size_type>::max();
+		clear_read_ahead();
 	}
 
 	// write, thread -- must have lock!
@@ -80,6 +87,8 @@ public:
 						stream_size_type readOffset,
 						memory_size_type blockSize)
 	{
+		// The file has changed, so a block header read ahead may be stale.
+		clear_read_ahead();
 		if (m_blockNumber != std::numeric_limits<stream_size_type>::max()
 			&& blockNumber < m_blockNumber)
 		{
@@ -130,6 +139,66 @@ public:
 		return m_readOffset;
 	}
 
+	// write, stream
+	void reset_compressibility() {
+		m_skipCompression = m_incompressibleBackoff = 0;
+	}
+
+	// write, thread -- must have lock!
+	// Returns true if the next block should be stored without compression,
+	// since recent blocks did not compress well.
+	bool skip_compression() {
+		if (m_skipCompression == 0) return false;
+		--m_skipCompression;
+		return true;
+	}
+
+	// write, thread -- must have lock!
+	// Record whether a block that was compressed turned out to compress well.
+	// After an incompressible block, the following blocks are stored raw,
+	// doubling the number of blocks skipped each time it happens in a row.
+	void set_block_compressible(bool compressible) {
+		if (compressible) {
+			m_incompressibleBackoff = 0;
+		} else {
+			if (m_incompressibleBackoff == 0)
+				m_incompressibleBackoff = 1;
+			else if (2 * m_incompressibleBackoff <= MAX_INCOMPRESSIBLE_BACKOFF)
+				m_incompressibleBackoff *= 2;
+			m_skipCompression = m_incompressibleBackoff;
+		}
+	}
+
+	// read, thread -- must have lock!
+	// Remember a block header that was read along with another block.
+	// When reading forward, this is the header of the block starting at
+	// the given offset; when reading backward, it is the trailer of the
+	// block ending at the given offset.
+	void set_read_ahead(stream_size_type offset,
+						read_direction::type direction,
+						uint32_t header)
+	{
+		m_readAheadOffset = offset;
+		m_readAheadDirection = direction;
+		m_readAheadHeader = header;
+	}
+
+	// read, thread -- must have lock!
+	bool get_read_ahead(stream_size_type offset,
+						read_direction::type direction,
+						uint32_t & header)
+	{
+		if (m_readAheadOffset != offset || m_readAheadDirection != direction)
+			return false;
+		header = m_readAheadHeader;
+		return true;
+	}
+
+	// any
+	void clear_read_ahead() {
+		m_readAheadOffset = std::numeric_limits<stream_size_type>::max();
+	}
+
 	// read, stream
 	bool done() {
 		return m_done;
@@ -160,6 +229,15 @@ private:
 	bool m_endOfStream;
 	stream_size_type m_nextReadOffset;
 	memory_size_type m_nextBlockSize;
+
+	// Adaptive compression of written blocks
+	static const memory_size_type MAX_INCOMPRESSIBLE_BACKOFF = 64;
+	memory_size_type m_skipCompression;
+	memory_size_type m_incompressibleBackoff;
+	// Block header read ahead by the thread
+	stream_size_type m_readAheadOffset;
+	read_direction::type m_readAheadDirection;
+	uint32_t m_readAheadHeader;
 };
 
 #ifdef __GNUC__
@@ -229,6 +307,16 @@ public:
 		m_response->set_next_block_offset(offset);
 	}
 
+	// must have lock!
+	bool get_read_ahead(uint32_t & header) {
+		return m_response->get_read_ahead(m_readOffset, m_readDirection, header);
+	}
+
+	// must have lock!
+	void set_read_ahead(stream_size_type offset, uint32_t header) {
+		m_response->set_read_ahead(offset, m_readDirection, header);
+	}
+
 private:
 	buffer_t m_buffer;
 	file_accessor_t * m_fileAccessor;
@@ -247,6 +335,8 @@ public:
 				  stream_size_type writeOffset,
 				  memory_size_type blockItems,
 				  stream_size_type blockNumber,
+				  compression_scheme::type compressionScheme,
+				  int compressionLevel,
 				  compressor_response * response)
 		: request_base(response)
 		, m_buffer(buffer)
@@ -255,6 +345,8 @@ public:
 		, m_writeOffset(writeOffset)
 		, m_blockItems(blockItems)
 		, m_blockNumber(blockNumber)
+		, m_compressionScheme(compressionScheme)
+		, m_compressionLevel(compressionLevel)
 	{
 	}
 
@@ -282,6 +374,18 @@ public:
 		return m_writeOffset;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  The compression scheme the stream wants this block written
+	/// with, if the block is compressed at all.
+	///////////////////////////////////////////////////////////////////////////
+	compression_scheme::type get_compression_scheme() {
+		return m_compressionScheme;
+	}
+
+	int get_compression_level() {
+		return m_compressionLevel;
+	}
+
 	// must have lock!
 	void set_block_info(stream_size_type readOffset,
 						memory_size_type blockSize)
@@ -289,6 +393,16 @@ public:
 		m_response->set_block_info(m_blockNumber, readOffset, blockSize);
 	}
 
+	// must have lock!
+	bool skip_compression() {
+		return m_response->skip_compression();
+	}
+
+	// must have lock!
+	void set_block_compressible(bool compressible) {
+		m_response->set_block_compressible(compressible);
+	}
+
 	// must have lock!
 	void update_recorded_size() {
 		if (m_tempFile != NULL) m_tempFile->update_recorded_size(m_fileAccessor->file_size());
@@ -306,6 +420,8 @@ private:
 	const stream_size_type m_writeOffset;
 	const memory_size_type m_blockItems;
 	const stream_size_type m_blockNumber;
+	const compression_scheme::type m_compressionScheme;
+	const int m_compressionLevel;
 };
 
 class compressor_request_kind {
@@ -383,13 +499,16 @@ public:
 									  stream_size_type writeOffset,
 									  memory_size_type blockItems,
 									  stream_size_type blockNumber,
+									  compression_scheme::type compressionScheme,
+									  int compressionLevel,
 									  compressor_response * response)
 	{
 		destruct();
 		m_kind = compressor_request_kind::WRITE;
 		return *new (m_payload) write_request(buffer, fileAccessor, tempFile,
 											  writeOffset, blockItems,
-											  blockNumber, response);
+											  blockNumber, compressionScheme,
+											  compressionLevel, response);
 	}
 
 	write_request & set_write_request(const write_request & other) {
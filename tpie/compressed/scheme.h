@@ -24,6 +24,8 @@
 /// \file compressed/scheme.h  Compression scheme virtual interface.
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <tpie/config.h>
+
 namespace tpie {
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -36,11 +38,16 @@ enum compression_flags {
 	 * it will support seek(n) and truncate(n) for arbitrary n. */
 	compression_none = 0,
 	/** Compress some blocks
-	 * according to available resources (time, memory). */
+	 * according to available resources (time, memory).
+	 * A block is stored raw when the compressor is falling behind the disk,
+	 * or when the block (or recent blocks of the stream) did not compress
+	 * well. */
 	compression_normal = 1,
 	/** Compress all blocks according to the preferred compression scheme
-	 * which can be set using
-	 * tpie::the_compressor_thread().set_preferred_compression(). */
+	 * which can be set for all streams using
+	 * tpie::the_compressor_thread().set_preferred_compression()
+	 * or for a single stream using
+	 * tpie::file_stream::set_preferred_compression(). */
 	compression_all = 2
 };
 
@@ -51,7 +58,9 @@ class compression_scheme {
 public:
 	enum type {
 		none = 0,
-		snappy = 1
+		snappy = 1,
+		lz4 = 2,
+		zstd = 3
 	};
 
 	///////////////////////////////////////////////////////////////////////////
@@ -66,8 +75,11 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Compress data from \c src into \c dest, returning its size in
 	/// \c destSize.
+	///
+	/// \param level  Scheme-specific compression level, or 0 to use the
+	/// default level of the scheme. Schemes without levels ignore it.
 	///////////////////////////////////////////////////////////////////////////
-	virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize) const = 0;
+	virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int level) const = 0;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Get the uncompressed size of the compressed block at \c src.
@@ -85,6 +97,8 @@ protected:
 
 const compression_scheme & get_compression_scheme_none();
 const compression_scheme & get_compression_scheme_snappy();
+const compression_scheme & get_compression_scheme_lz4();
+const compression_scheme & get_compression_scheme_zstd();
 
 inline const compression_scheme & get_compression_scheme(compression_scheme::type t) {
 	switch (t) {
@@ -92,10 +106,45 @@ inline const compression_scheme & get_compression_scheme(compression_scheme::typ
 			return get_compression_scheme_none();
 		case compression_scheme::snappy:
 			return get_compression_scheme_snappy();
+		case compression_scheme::lz4:
+			return get_compression_scheme_lz4();
+		case compression_scheme::zstd:
+			return get_compression_scheme_zstd();
 	}
 	return get_compression_scheme_none();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Whether TPIE was built with the codec of the given scheme.
+///
+/// Without it, get_compression_scheme returns the \c none scheme instead.
+///////////////////////////////////////////////////////////////////////////////
+inline bool compression_scheme_available(compression_scheme::type t) {
+	switch (t) {
+		case compression_scheme::none:
+			return true;
+		case compression_scheme::snappy:
+#ifdef TPIE_HAS_SNAPPY
+			return true;
+#else // TPIE_HAS_SNAPPY
+			return false;
+#endif // TPIE_HAS_SNAPPY
+		case compression_scheme::lz4:
+#ifdef TPIE_HAS_LZ4
+			return true;
+#else // TPIE_HAS_LZ4
+			return false;
+#endif // TPIE_HAS_LZ4
+		case compression_scheme::zstd:
+#ifdef TPIE_HAS_ZSTD
+			return true;
+#else // TPIE_HAS_ZSTD
+			return false;
+#endif // TPIE_HAS_ZSTD
+	}
+	return false;
+}
+
 }
 
 #endif // TPIE_COMPRESSED_SCHEME_H
@@ -0,0 +1,114 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <cstring>
+#include <tpie/config.h>
+#ifdef TPIE_HAS_LZ4
+#include <lz4.h>
+#endif // TPIE_HAS_LZ4
+#include <tpie/exception.h>
+#include <tpie/tpie_log.h>
+#include <tpie/types.h>
+#include <tpie/compressed/scheme.h>
+#include <tpie/stats.h>
+
+#ifdef TPIE_HAS_LZ4
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// LZ4 block format does not store the uncompressed length,
+/// so we prepend it to the compressed block.
+///////////////////////////////////////////////////////////////////////////////
+typedef tpie::uint64_t length_header_t;
+
+class compression_scheme_impl : public tpie::compression_scheme {
+public:
+
+virtual size_t max_compressed_length(size_t srcSize) const override {
+	return sizeof(length_header_t) + LZ4_compressBound(static_cast<int>(srcSize));
+}
+
+// A positive level is used as the LZ4 acceleration factor.
+virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int level) const override {
+	tpie::stat_timer t(5); // Time compressing
+	length_header_t length = srcSize;
+	memcpy(dest, &length, sizeof(length));
+	const int capacity = LZ4_compressBound(static_cast<int>(srcSize));
+	const int compressedSize =
+		LZ4_compress_fast(src, dest + sizeof(length), static_cast<int>(srcSize),
+						  capacity, level > 0 ? level : 1);
+	if (compressedSize <= 0)
+		throw tpie::stream_exception("Internal error; LZ4_compress_fast failed");
+	*destSize = sizeof(length) + static_cast<size_t>(compressedSize);
+}
+
+virtual size_t uncompressed_length(const char * src, size_t srcSize) const override {
+	if (srcSize < sizeof(length_header_t))
+		throw tpie::stream_exception("Internal error; LZ4 block is too short");
+	length_header_t length;
+	memcpy(&length, src, sizeof(length));
+	return static_cast<size_t>(length);
+}
+
+virtual void uncompress(char * dest, const char * src, size_t srcSize) const override {
+	tpie::stat_timer t(6); // Time uncompressing
+	const size_t length = uncompressed_length(src, srcSize);
+	const int res =
+		LZ4_decompress_safe(src + sizeof(length_header_t), dest,
+							static_cast<int>(srcSize - sizeof(length_header_t)),
+							static_cast<int>(length));
+	if (res < 0 || static_cast<size_t>(res) != length)
+		throw tpie::stream_exception("Internal error; LZ4_decompress_safe failed");
+}
+
+};
+
+compression_scheme_impl the_compression_scheme;
+
+} // unnamed namespace
+
+namespace tpie {
+
+const compression_scheme & get_compression_scheme_lz4() {
+	return the_compression_scheme;
+}
+
+} // namespace tpie
+
+#else // TPIE_HAS_LZ4
+
+namespace {
+	bool warned = false;
+}
+
+namespace tpie {
+
+const compression_scheme & get_compression_scheme_lz4() {
+	if (!warned) {
+		log_warning() << "get_compression_scheme_lz4: "
+			<< "No LZ4 support; return none instead." << std::endl;
+		warned = true;
+	}
+	return get_compression_scheme_none();
+}
+
+} // namespace tpie
+
+#endif // TPIE_HAS_LZ4
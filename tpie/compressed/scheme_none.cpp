@@ -30,7 +30,7 @@ virtual size_t max_compressed_length(size_t srcSize) const override {
 	return srcSize;
 }
 
-virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize) const override {
+virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int /*level*/) const override {
 	memcpy(dest, src, srcSize);
 	*destSize = srcSize;
 }
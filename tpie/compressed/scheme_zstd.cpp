@@ -0,0 +1,98 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#include <tpie/config.h>
+#ifdef TPIE_HAS_ZSTD
+#include <zstd.h>
+#endif // TPIE_HAS_ZSTD
+#include <tpie/exception.h>
+#include <tpie/tpie_log.h>
+#include <tpie/compressed/scheme.h>
+#include <tpie/stats.h>
+
+#ifdef TPIE_HAS_ZSTD
+
+namespace {
+
+class compression_scheme_impl : public tpie::compression_scheme {
+public:
+
+virtual size_t max_compressed_length(size_t srcSize) const override {
+	return ZSTD_compressBound(srcSize);
+}
+
+virtual void compress(char * dest, const char * src, size_t srcSize, size_t * destSize, int level) const override {
+	tpie::stat_timer t(5); // Time compressing
+	if (level == 0) level = ZSTD_CLEVEL_DEFAULT;
+	size_t res = ZSTD_compress(dest, ZSTD_compressBound(srcSize), src, srcSize, level);
+	if (ZSTD_isError(res))
+		throw tpie::stream_exception(std::string("Internal error; ZSTD_compress failed: ")
+									 + ZSTD_getErrorName(res));
+	*destSize = res;
+}
+
+virtual size_t uncompressed_length(const char * src, size_t srcSize) const override {
+	unsigned long long destSize = ZSTD_getFrameContentSize(src, srcSize);
+	if (destSize == ZSTD_CONTENTSIZE_UNKNOWN || destSize == ZSTD_CONTENTSIZE_ERROR)
+		throw tpie::stream_exception("Internal error; ZSTD_getFrameContentSize failed");
+	return static_cast<size_t>(destSize);
+}
+
+virtual void uncompress(char * dest, const char * src, size_t srcSize) const override {
+	tpie::stat_timer t(6); // Time uncompressing
+	const size_t destSize = uncompressed_length(src, srcSize);
+	size_t res = ZSTD_decompress(dest, destSize, src, srcSize);
+	if (ZSTD_isError(res) || res != destSize)
+		throw tpie::stream_exception("Internal error; ZSTD_decompress failed");
+}
+
+};
+
+compression_scheme_impl the_compression_scheme;
+
+} // unnamed namespace
+
+namespace tpie {
+
+const compression_scheme & get_compression_scheme_zstd() {
+	return the_compression_scheme;
+}
+
+} // namespace tpie
+
+#else // TPIE_HAS_ZSTD
+
+namespace {
+	bool warned = false;
+}
+
+namespace tpie {
+
+const compression_scheme & get_compression_scheme_zstd() {
+	if (!warned) {
+		log_warning() << "get_compression_scheme_zstd: "
+			<< "No Zstandard support; return none instead." << std::endl;
+		warned = true;
+	}
+	return get_compression_scheme_none();
+}
+
+} // namespace tpie
+
+#endif // TPIE_HAS_ZSTD
@@ -176,9 +176,73 @@ public:
 
 	void close();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Choose the compression scheme and level for blocks written
+	/// to this stream.
+	///
+	/// By default, a stream uses the preferred compression of the compressor
+	/// thread. The choice is kept when the stream is closed and reopened.
+	/// Only affects streams opened with compression_normal or compression_all.
+	/// A level of 0 selects the default level of the scheme.
+	///////////////////////////////////////////////////////////////////////////
+	void set_preferred_compression(compression_scheme::type scheme, int level = 0) {
+		m_hasPreferredCompression = true;
+		m_preferredCompression = scheme;
+		m_preferredCompressionLevel = level;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Enable or disable memory mapping of streams opened read-only.
+	///
+	/// When enabled, blocks are copied out of a read-only mapping of the file
+	/// instead of being read with a system call per block. Takes effect on
+	/// the next open.
+	///////////////////////////////////////////////////////////////////////////
+	void set_memory_mapped(bool memoryMapped) {
+		m_byteStreamAccessor.set_memory_mapped(memoryMapped);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Number of bytes read from disk since the file currently or
+	/// most recently open was opened.
+	///
+	/// Blocks are read by the compressor thread, so blocks that have been
+	/// requested but not yet read are not included.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const {
+		return m_byteStreamAccessor.get_bytes_read();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Number of bytes written to disk since the file currently or
+	/// most recently open was opened.
+	///
+	/// Blocks are written by the compressor thread, so blocks that are still
+	/// queued for writing are not included until the stream is closed.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_written() const {
+		return m_byteStreamAccessor.get_bytes_written();
+	}
+
 protected:
 	void finish_requests(compressor_thread_lock & l);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Compression scheme to request for the next written block.
+	///////////////////////////////////////////////////////////////////////////
+	compression_scheme::type preferred_compression(compressor_thread_lock & l) {
+		if (m_hasPreferredCompression) return m_preferredCompression;
+		return compressor().get_preferred_compression(l);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Compression level to request for the next written block.
+	///////////////////////////////////////////////////////////////////////////
+	int preferred_compression_level(compressor_thread_lock & l) {
+		if (m_hasPreferredCompression) return m_preferredCompressionLevel;
+		return compressor().get_preferred_compression_level(l);
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// Blocks to take the compressor lock.
 	///
@@ -310,6 +374,13 @@ protected:
 	stream_position m_nextPosition;
 
 	stream_size_type m_nextReadOffset;
+
+	/** Whether set_preferred_compression has been called on this stream. */
+	bool m_hasPreferredCompression;
+	/** Compression scheme chosen with set_preferred_compression. */
+	compression_scheme::type m_preferredCompression;
+	/** Compression level chosen with set_preferred_compression. */
+	int m_preferredCompressionLevel;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1123,6 +1194,8 @@ private:
 							writeOffset,
 							blockItems,
 							blockNumber,
+							preferred_compression(lock),
+							preferred_compression_level(lock),
 							&m_response);
 		compressor().request(r);
 		m_bufferDirty = false;
@@ -48,6 +48,9 @@ compressed_stream_base::compressed_stream_base(memory_size_type itemSize,
 	, m_offset(0)
 	, m_nextPosition(/* not a position */)
 	, m_nextReadOffset(0)
+	, m_hasPreferredCompression(false)
+	, m_preferredCompression(compression_scheme::none)
+	, m_preferredCompressionLevel(0)
 {
 	// Empty constructor.
 }
@@ -73,6 +76,7 @@ void compressed_stream_base::open_inner(const std::string & path,
 {
 	m_canRead = accessType == access_read || accessType == access_read_write;
 	m_canWrite = accessType == access_write || accessType == access_read_write;
+	m_byteStreamAccessor.set_direct_io(m_tempFile != 0 && get_direct_io_temp_files());
 	m_byteStreamAccessor.open(path, m_canRead, m_canWrite, m_itemSize,
 							  m_blockSize, userDataSize, cacheHint,
 							  compressionFlags);
@@ -82,6 +86,7 @@ void compressed_stream_base::open_inner(const std::string & path,
 	m_lastBlockReadOffset = m_byteStreamAccessor.get_last_block_read_offset();
 	m_currentFileSize = m_byteStreamAccessor.file_size();
 	m_response.clear_block_info();
+	m_response.reset_compressibility();
 
 	this->post_open();
 }
@@ -17,7 +17,13 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 
+#include <cstdlib>
 #include <queue>
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+#include <tpie/job.h>
+#include <tpie/tpie.h>
+#include <tpie/memory.h>
 #include <tpie/compressed/thread.h>
 #include <tpie/compressed/request.h>
 #include <tpie/compressed/buffer.h>
@@ -32,6 +38,15 @@ public:
 	{
 	}
 
+	explicit block_header(tpie::uint32_t payload)
+		: m_payload(payload)
+	{
+	}
+
+	tpie::uint32_t get_payload() const {
+		return m_payload;
+	}
+
 	tpie::memory_size_type get_block_size() const {
 		return static_cast<tpie::memory_size_type>(m_payload & BLOCK_SIZE_MASK);
 	}
@@ -75,6 +90,13 @@ private:
 	tpie::uint32_t m_payload;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// With compression_normal, a compressed block must be at least
+/// 1/MIN_COMPRESSION_SAVINGS smaller than the uncompressed block;
+/// otherwise the block is stored raw.
+///////////////////////////////////////////////////////////////////////////////
+const tpie::memory_size_type MIN_COMPRESSION_SAVINGS = 8;
+
 }
 
 namespace tpie {
@@ -86,14 +108,63 @@ namespace tpie {
 class compressor_thread::impl {
 public:
 	impl()
-		: m_done(false)
+		: m_workerCount(0)
+		, m_done(false)
 		, m_preferredCompression(compression_scheme::snappy)
+		, m_preferredCompressionLevel(0)
 	{
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Allocate the per-worker request queues.
+	///
+	/// Must not be called while any worker is running.
+	///////////////////////////////////////////////////////////////////////////
+	void set_worker_count(memory_size_type workers) {
+		if (workers == 0) workers = 1;
+		m_workers.reset(new worker[workers]);
+		m_workerCount = workers;
+		m_done = false;
+	}
+
+	memory_size_type worker_count() const {
+		return m_workerCount;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Allocate the scratch buffer of each worker up front, large
+	/// enough for blocks of the given uncompressed size written with the
+	/// preferred compression scheme.
+	///
+	/// Allocating here rather than on the first request keeps the scratch
+	/// out of the memory that callers measure and budget for while they
+	/// run. Must be called after set_worker_count and before the workers
+	/// run.
+	///////////////////////////////////////////////////////////////////////////
+	void init_scratch(memory_size_type blockSize) {
+		const memory_size_type scratchSize =
+			get_compression_scheme(m_preferredCompression).max_compressed_length(blockSize)
+			+ 3 * sizeof(block_header);
+		for (memory_size_type i = 0; i < m_workerCount; ++i) {
+			if (m_workers[i].m_scratch.size() < scratchSize)
+				m_workers[i].m_scratch.resize(scratchSize);
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Free the scratch buffers of the workers.
+	///
+	/// Must not be called while any worker is running.
+	///////////////////////////////////////////////////////////////////////////
+	void finish_scratch() {
+		for (memory_size_type i = 0; i < m_workerCount; ++i)
+			m_workers[i].m_scratch.resize(0);
+	}
+
 	void stop(compressor_thread_lock & /*lock*/) {
 		m_done = true;
-		m_newRequest.notify_one();
+		for (memory_size_type i = 0; i < m_workerCount; ++i)
+			m_workers[i].m_newRequest.notify_one();
 	}
 
 	bool request_valid(const compressor_request & r) {
@@ -107,37 +178,51 @@ public:
 		tp_assert(false, "Unknown request type");
 	}
 
-	void run() {
+	void run(memory_size_type workerIndex) {
+		tp_assert(workerIndex < m_workerCount, "run: workerIndex out of bounds");
+		worker & w = m_workers[workerIndex];
 		while (true) {
 			compressor_thread_lock::lock_t lock(mutex());
-			m_idle = false;
-			while (!m_done && m_requests.empty()) {
-				m_idle = true;
-				m_newRequest.wait(lock);
+			w.m_idle = false;
+			while (!m_done && w.m_requests.empty()) {
+				w.m_idle = true;
+				w.m_newRequest.wait(lock);
 			}
-			if (m_done && m_requests.empty()) break;
+			if (m_done && w.m_requests.empty()) break;
 			{
-				compressor_request r = m_requests.front();
-				m_requests.pop();
+				compressor_request r = w.m_requests.front();
+				w.m_requests.pop();
 				lock.unlock();
 
 				switch (r.kind()) {
 					case compressor_request_kind::NONE:
 						throw exception("Invalid request");
 					case compressor_request_kind::READ:
-						process_read_request(r.get_read_request());
+						process_read_request(r.get_read_request(), w.m_scratch);
 						break;
 					case compressor_request_kind::WRITE:
-						process_write_request(r.get_write_request());
+						process_write_request(r.get_write_request(), w.m_idle, w.m_scratch);
 						break;
 				}
+				lock.lock();
 			}
-			lock.lock();
 			m_requestDone.notify_all();
 		}
 	}
 
 private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Get at least the given number of bytes of scratch space.
+	///
+	/// Scratch buffers are allocated by init_scratch and reused between
+	/// requests, so this only reallocates when a block or compression scheme
+	/// needs more room than the preferred scheme did.
+	///////////////////////////////////////////////////////////////////////////
+	static char * get_scratch(array<char> & scratch, memory_size_type size) {
+		if (scratch.size() < size) scratch.resize(size);
+		return scratch.get();
+	}
+
 	void checked_read(read_request & rr, stream_size_type readOffset, void * buf, memory_size_type count) {
 		memory_size_type nRead = rr.file_accessor().read(readOffset, buf, count);
 		if (nRead != count) {
@@ -145,7 +230,7 @@ private:
 		}
 	}
 
-	void process_read_request(read_request & rr) {
+	void process_read_request(read_request & rr, array<char> & scratch) {
 		stat_timer t(3); // Time reading
 		const bool useCompression = rr.file_accessor().get_compressed();
 		const bool backward = rr.get_read_direction() == read_direction::backward;
@@ -169,37 +254,71 @@ private:
 		block_header blockHeader;
 		block_header blockTrailer;
 		memory_size_type blockSize;
-		array<char> scratch;
 		char * compressed;
 		stream_size_type nextReadOffset;
+
+		// The header (trailer when reading backward) of this block may have
+		// been read along with the previous block.
+		bool haveHeader;
+		tpie::uint32_t cachedHeader;
+		{
+			compressor_thread_lock::lock_t lock(mutex());
+			haveHeader = rr.get_read_ahead(cachedHeader);
+		}
+
+		// Header of the following block (trailer of the preceding block when
+		// reading backward) that we read along with this block.
+		bool haveReadAhead = false;
+		block_header readAhead;
+
 		if (backward) {
-			readOffset -= sizeof(blockTrailer);
-			checked_read(rr, readOffset, &blockTrailer, sizeof(blockTrailer));
+			if (haveHeader) {
+				blockTrailer = block_header(cachedHeader);
+			} else {
+				checked_read(rr, readOffset - sizeof(blockTrailer), &blockTrailer, sizeof(blockTrailer));
+			}
 			blockSize = blockTrailer.get_block_size();
 			if (blockSize == 0) {
 				throw exception("Block size was unexpectedly zero");
 			}
-			scratch.resize(sizeof(blockHeader) + blockSize);
-			readOffset -= scratch.size();
-			checked_read(rr, readOffset, scratch.get(), scratch.size());
-			compressed = scratch.get() + sizeof(blockHeader);
-			memcpy(&blockHeader,
-				   reinterpret_cast<block_header *>(scratch.get()),
-				   sizeof(blockHeader));
+			const memory_size_type blockBytes = sizeof(blockHeader) + blockSize;
+			readOffset -= sizeof(blockTrailer) + blockBytes;
+			const memory_size_type extra = (readOffset >= sizeof(readAhead)) ? sizeof(readAhead) : 0;
+			char * scratchBuffer = get_scratch(scratch, extra + blockBytes);
+			checked_read(rr, readOffset - extra, scratchBuffer, extra + blockBytes);
+			if (extra > 0) {
+				memcpy(&readAhead, scratchBuffer, sizeof(readAhead));
+				haveReadAhead = true;
+			}
+			memcpy(&blockHeader, scratchBuffer + extra, sizeof(blockHeader));
+			compressed = scratchBuffer + extra + sizeof(blockHeader);
 			nextReadOffset = readOffset;
 		} else {
-			checked_read(rr, readOffset, &blockHeader, sizeof(blockHeader));
+			if (haveHeader) {
+				blockHeader = block_header(cachedHeader);
+			} else {
+				checked_read(rr, readOffset, &blockHeader, sizeof(blockHeader));
+			}
 			blockSize = blockHeader.get_block_size();
 			if (blockSize == 0) {
 				throw exception("Block size was unexpectedly zero");
 			}
-			scratch.resize(blockSize + sizeof(blockTrailer));
-			checked_read(rr, readOffset + sizeof(blockHeader), scratch.get(), scratch.size());
-			compressed = scratch.get();
-			memcpy(&blockTrailer,
-				   reinterpret_cast<block_header *>(scratch.get() + scratch.size()) - 1,
-				   sizeof(blockTrailer));
-			nextReadOffset = readOffset + sizeof(blockHeader) + scratch.size();
+			const memory_size_type blockBytes = blockSize + sizeof(blockTrailer);
+			char * scratchBuffer = get_scratch(scratch, blockBytes + sizeof(readAhead));
+			// At the end of the file, the read comes up short of the next header.
+			memory_size_type nRead = rr.file_accessor().read(readOffset + sizeof(blockHeader),
+															 scratchBuffer,
+															 blockBytes + sizeof(readAhead));
+			if (nRead < blockBytes) {
+				throw exception("read failed to read right amount");
+			}
+			if (nRead == blockBytes + sizeof(readAhead)) {
+				memcpy(&readAhead, scratchBuffer + blockBytes, sizeof(readAhead));
+				haveReadAhead = true;
+			}
+			compressed = scratchBuffer;
+			memcpy(&blockTrailer, scratchBuffer + blockSize, sizeof(blockTrailer));
+			nextReadOffset = readOffset + sizeof(blockHeader) + blockBytes;
 		}
 		if (blockHeader != blockTrailer) {
 			throw exception("Block trailer is different from the block header");
@@ -218,10 +337,13 @@ private:
 		rr.buffer()->set_size(uncompressedLength);
 		rr.buffer()->set_block_size(sizeof(blockHeader) + blockSize + sizeof(blockTrailer));
 		rr.buffer()->set_read_offset(readOffset);
+		if (haveReadAhead) {
+			rr.set_read_ahead(nextReadOffset, readAhead.get_payload());
+		}
 		rr.set_next_block_offset(nextReadOffset);
 	}
 
-	void process_write_request(write_request & wr) {
+	void process_write_request(write_request & wr, bool idle, array<char> & scratch) {
 		stat_timer t(4); // Time writing
 		size_t inputLength = wr.buffer()->size();
 		if (!wr.file_accessor().get_compressed()) {
@@ -238,28 +360,56 @@ private:
 			wr.file_accessor().get_compression_flags() != compression_all;
 		block_header blockHeader;
 		block_header & blockTrailer = blockHeader;
-		compression_scheme::type schemeType = m_preferredCompression;
-		if (adaptiveCompression && !m_idle) {
+		compression_scheme::type schemeType = wr.get_compression_scheme();
+		// Blocks must record the scheme that actually wrote them.
+		if (!compression_scheme_available(schemeType))
 			schemeType = compression_scheme::none;
+		if (adaptiveCompression && schemeType != compression_scheme::none) {
+			if (!idle) {
+				// Requests are queueing up, so compression is slower than
+				// writing to disk; store this block raw.
+				schemeType = compression_scheme::none;
+			} else {
+				// Recent blocks of this stream did not compress well.
+				compressor_thread_lock::lock_t lock(mutex());
+				if (wr.skip_compression()) schemeType = compression_scheme::none;
+			}
 		}
-		if (schemeType == compression_scheme::snappy)
-			increment_user(7, 1);
-		if (schemeType == compression_scheme::none)
-			increment_user(8, 1);
+		const bool tryCompression = schemeType != compression_scheme::none;
 		const compression_scheme & compressionScheme = get_compression_scheme(schemeType);
 		const memory_size_type maxBlockSize = compressionScheme.max_compressed_length(inputLength);
 		if (maxBlockSize > blockHeader.max_block_size())
 			throw exception("process_write_request: MaxCompressedLength > max_block_size");
-		array<char> scratch(sizeof(blockHeader) + maxBlockSize + sizeof(blockTrailer));
+		char * scratchBuffer = get_scratch(scratch, sizeof(blockHeader) + maxBlockSize + sizeof(blockTrailer));
 		memory_size_type blockSize;
-		compressionScheme.compress(scratch.get() + sizeof(blockHeader),
+		compressionScheme.compress(scratchBuffer + sizeof(blockHeader),
 								   reinterpret_cast<const char *>(wr.buffer()->get()),
 								   inputLength,
-								   &blockSize);
+								   &blockSize,
+								   wr.get_compression_level());
+		bool compressible = true;
+		if (adaptiveCompression && tryCompression
+			&& blockSize + inputLength / MIN_COMPRESSION_SAVINGS > inputLength)
+		{
+			// Not worth the time spent uncompressing; store the block raw.
+			// By the pigeonhole principle, scratch has room for it.
+			compressible = false;
+			schemeType = compression_scheme::none;
+			get_compression_scheme_none().compress(scratchBuffer + sizeof(blockHeader),
+												   reinterpret_cast<const char *>(wr.buffer()->get()),
+												   inputLength,
+												   &blockSize,
+												   0);
+			increment_user(9, 1);
+		}
+		if (schemeType == compression_scheme::none)
+			increment_user(8, 1);
+		else
+			increment_user(7, 1);
 		blockHeader.set_block_size(blockSize);
 		blockHeader.set_compression_scheme(schemeType);
-		memcpy(scratch.get(), &blockHeader, sizeof(blockHeader));
-		memcpy(scratch.get() + sizeof(blockHeader) + blockSize, &blockTrailer, sizeof(blockTrailer));
+		memcpy(scratchBuffer, &blockHeader, sizeof(blockHeader));
+		memcpy(scratchBuffer + sizeof(blockHeader) + blockSize, &blockTrailer, sizeof(blockTrailer));
 		const memory_size_type writeSize = sizeof(blockHeader) + blockSize + sizeof(blockTrailer);
 		if (!wr.should_append()) {
 			//log_debug() << "Truncate to " << wr.write_offset() << std::endl;
@@ -268,6 +418,8 @@ private:
 		}
 		{
 			compressor_thread_lock::lock_t lock(mutex());
+			if (adaptiveCompression && tryCompression)
+				wr.set_block_compressible(compressible);
 			wr.buffer()->transition_state(compressor_buffer_state::writing,
 										  compressor_buffer_state::clean);
 			wr.buffer()->set_block_size(writeSize);
@@ -277,7 +429,7 @@ private:
 			const stream_size_type newSize = offset + writeSize;
 			wr.update_recorded_size(newSize);
 		}
-		wr.file_accessor().append(scratch.get(), writeSize);
+		wr.file_accessor().append(scratchBuffer, writeSize);
 	}
 
 public:
@@ -285,12 +437,13 @@ public:
 		return m_mutex;
 	}
 
-	void request(const compressor_request & r) {
+	void request(compressor_request & r) {
 		tp_assert(request_valid(r), "Invalid request");
 
-		m_requests.push(r);
-		m_requests.back().get_request_base().initiate_request();
-		m_newRequest.notify_one();
+		worker & w = worker_for(r);
+		w.m_requests.push(r);
+		w.m_requests.back().get_request_base().initiate_request();
+		w.m_newRequest.notify_one();
 	}
 
 	void wait_for_request_done(compressor_thread_lock & l) {
@@ -299,20 +452,73 @@ public:
 		m_requestDone.wait(l.get_lock());
 	}
 
-	void set_preferred_compression(compressor_thread_lock &, compression_scheme::type scheme) {
+	void set_preferred_compression(compressor_thread_lock &, compression_scheme::type scheme, int level) {
 		m_preferredCompression = scheme;
+		m_preferredCompressionLevel = level;
+	}
+
+	compression_scheme::type get_preferred_compression(compressor_thread_lock &) {
+		return m_preferredCompression;
+	}
+
+	int get_preferred_compression_level(compressor_thread_lock &) {
+		return m_preferredCompressionLevel;
 	}
 
 private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Request queue of a single compressor worker.
+	///////////////////////////////////////////////////////////////////////////
+	struct worker {
+		worker()
+			: m_idle(false)
+		{
+		}
+
+		std::queue<compressor_request> m_requests;
+		boost::condition_variable m_newRequest;
+
+		// Whether the worker was idle prior to handling the current request.
+		bool m_idle;
+
+		// Compression buffer, only used by the worker's own thread, so it is
+		// kept between requests without locking.
+		array<char> m_scratch;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Find the worker that handles requests on the given file.
+	///
+	/// All requests on a single file accessor go to the same worker, so the
+	/// requests of a stream are handled in the order they were issued.
+	/// Requests on different streams are spread across the workers.
+	///////////////////////////////////////////////////////////////////////////
+	worker & worker_for(compressor_request & r) {
+		tp_assert(m_workerCount > 0, "worker_for: Compressor not initialized");
+		const void * key = 0;
+		switch (r.kind()) {
+			case compressor_request_kind::NONE:
+				break;
+			case compressor_request_kind::READ:
+				key = &r.get_read_request().file_accessor();
+				break;
+			case compressor_request_kind::WRITE:
+				key = &r.get_write_request().file_accessor();
+				break;
+		}
+		// Fibonacci hashing of the accessor address.
+		boost::uint64_t h = static_cast<boost::uint64_t>(reinterpret_cast<size_t>(key));
+		h = (h ^ (h >> 17)) * 0x9E3779B97F4A7C15ull;
+		return m_workers[static_cast<memory_size_type>((h >> 32) % m_workerCount)];
+	}
+
 	mutex_t m_mutex;
-	std::queue<compressor_request> m_requests;
-	boost::condition_variable m_newRequest;
+	boost::scoped_array<worker> m_workers;
+	memory_size_type m_workerCount;
 	boost::condition_variable m_requestDone;
 	bool m_done;
 	compression_scheme::type m_preferredCompression;
-
-	// Whether the thread was idle prior to handling the current request.
-	bool m_idle;
+	int m_preferredCompressionLevel;
 };
 
 } // namespace tpie
@@ -320,11 +526,12 @@ private:
 namespace {
 
 tpie::compressor_thread the_compressor_thread;
-boost::thread the_compressor_thread_handle;
+boost::thread_group * the_compressor_thread_handles = 0;
 bool compressor_thread_already_finished = false;
+tpie::memory_size_type the_compressor_thread_count = 0;
 
-void run_the_compressor_thread() {
-	the_compressor_thread.run();
+void run_the_compressor_thread(tpie::memory_size_type workerIndex) {
+	the_compressor_thread.run(workerIndex);
 }
 
 } // unnamed namespace
@@ -335,18 +542,35 @@ compressor_thread & the_compressor_thread() {
 	return ::the_compressor_thread;
 }
 
+memory_size_type get_compressor_thread_count() {
+	if (the_compressor_thread_count == 0) {
+		const char * v = getenv("TPIE_COMPRESSOR_THREADS");
+		if (v != NULL) the_compressor_thread_count = atol(v);
+		if (the_compressor_thread_count == 0) the_compressor_thread_count = default_worker_count();
+	}
+	return the_compressor_thread_count;
+}
+
+void set_compressor_thread_count(memory_size_type threads) {
+	the_compressor_thread_count = threads;
+}
+
 void init_compressor() {
-	if (the_compressor_thread_handle.get_id() != boost::thread::id()) {
+	if (the_compressor_thread_handles != 0) {
 		log_debug() << "Attempted to initiate compressor thread twice" << std::endl;
 		return;
 	}
-	boost::thread t(run_the_compressor_thread);
-	the_compressor_thread_handle.swap(t);
+	const memory_size_type workers = get_compressor_thread_count();
+	the_compressor_thread().set_worker_count(workers);
+	the_compressor_thread().init_scratch(get_block_size());
+	the_compressor_thread_handles = new boost::thread_group();
+	for (memory_size_type i = 0; i < the_compressor_thread().worker_count(); ++i)
+		the_compressor_thread_handles->create_thread(boost::bind(run_the_compressor_thread, i));
 	compressor_thread_already_finished = false;
 }
 
 void finish_compressor() {
-	if (the_compressor_thread_handle.get_id() == boost::thread::id()) {
+	if (the_compressor_thread_handles == 0) {
 		if (compressor_thread_already_finished) {
 			log_debug() << "Compressor thread already finished" << std::endl;
 		} else {
@@ -358,9 +582,10 @@ void finish_compressor() {
 		compressor_thread_lock lock(the_compressor_thread());
 		the_compressor_thread().stop(lock);
 	}
-	the_compressor_thread_handle.join();
-	boost::thread t;
-	the_compressor_thread_handle.swap(t);
+	the_compressor_thread_handles->join_all();
+	the_compressor_thread().finish_scratch();
+	delete the_compressor_thread_handles;
+	the_compressor_thread_handles = 0;
 	compressor_thread_already_finished = true;
 }
 
@@ -381,8 +606,24 @@ void compressor_thread::request(compressor_request & r) {
 	pimpl->request(r);
 }
 
-void compressor_thread::run() {
-	pimpl->run();
+void compressor_thread::set_worker_count(memory_size_type workers) {
+	pimpl->set_worker_count(workers);
+}
+
+void compressor_thread::init_scratch(memory_size_type blockSize) {
+	pimpl->init_scratch(blockSize);
+}
+
+void compressor_thread::finish_scratch() {
+	pimpl->finish_scratch();
+}
+
+memory_size_type compressor_thread::worker_count() const {
+	return pimpl->worker_count();
+}
+
+void compressor_thread::run(memory_size_type workerIndex) {
+	pimpl->run(workerIndex);
 }
 
 void compressor_thread::wait_for_request_done(compressor_thread_lock & l) {
@@ -393,8 +634,16 @@ void compressor_thread::stop(compressor_thread_lock & lock) {
 	pimpl->stop(lock);
 }
 
-void compressor_thread::set_preferred_compression(compressor_thread_lock & lock, compression_scheme::type scheme) {
-	pimpl->set_preferred_compression(lock, scheme);
+void compressor_thread::set_preferred_compression(compressor_thread_lock & lock, compression_scheme::type scheme, int level /*= 0*/) {
+	pimpl->set_preferred_compression(lock, scheme, level);
+}
+
+compression_scheme::type compressor_thread::get_preferred_compression(compressor_thread_lock & lock) {
+	return pimpl->get_preferred_compression(lock);
+}
+
+int compressor_thread::get_preferred_compression_level(compressor_thread_lock & lock) {
+	return pimpl->get_preferred_compression_level(lock);
 }
 
 }
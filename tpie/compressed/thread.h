@@ -21,7 +21,7 @@
 #define TPIE_COMPRESSED_THREAD_H
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \file compressed/thread.h  Interface to the compressor thread.
+/// \file compressed/thread.h  Interface to the compressor thread pool.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <boost/thread.hpp>
@@ -33,6 +33,33 @@
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Get the number of compressor worker threads.
+///
+/// This can be changed by setting the TPIE_COMPRESSOR_THREADS environment
+/// variable or by calling set_compressor_thread_count.
+///
+/// The default is default_worker_count().
+///////////////////////////////////////////////////////////////////////////////
+memory_size_type get_compressor_thread_count();
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Set the number of compressor worker threads.
+///
+/// The new count takes effect the next time the STREAMS subsystem is
+/// initialized with tpie_init.
+///////////////////////////////////////////////////////////////////////////////
+void set_compressor_thread_count(memory_size_type threads);
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Pool of worker threads that perform compressed stream I/O.
+///
+/// Every request on a given stream is handled by the same worker,
+/// so requests on a single stream are processed in the order they are made.
+/// Requests on different streams are processed concurrently.
+/// All workers share a single mutex which protects the request queues and
+/// the stream state; compression and file I/O happens without the lock.
+///////////////////////////////////////////////////////////////////////////////
 class compressor_thread {
 	class impl;
 	impl * pimpl;
@@ -54,11 +81,47 @@ public:
 
 	void wait_for_request_done(compressor_thread_lock & l);
 
-	void run();
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Set the number of workers.
+	///
+	/// Must be called before any worker is started with run().
+	///////////////////////////////////////////////////////////////////////////
+	void set_worker_count(memory_size_type workers);
+
+	memory_size_type worker_count() const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Allocate the scratch buffer that each worker uses for
+	/// reading and writing compressed blocks of the given size.
+	///////////////////////////////////////////////////////////////////////////
+	void init_scratch(memory_size_type blockSize);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Free the scratch buffers of the workers. Workers must be
+	/// stopped.
+	///////////////////////////////////////////////////////////////////////////
+	void finish_scratch();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Worker thread entry point.
+	///
+	/// Handles requests on the given worker's queue until stop() is called.
+	///////////////////////////////////////////////////////////////////////////
+	void run(memory_size_type workerIndex);
 
 	void stop(compressor_thread_lock & lock);
 
-	void set_preferred_compression(compressor_thread_lock &, compression_scheme::type);
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Set the compression scheme and level used by streams that have
+	/// not chosen their own with file_stream::set_preferred_compression.
+	///
+	/// A level of 0 selects the default level of the scheme.
+	///////////////////////////////////////////////////////////////////////////
+	void set_preferred_compression(compressor_thread_lock &, compression_scheme::type, int level = 0);
+
+	compression_scheme::type get_preferred_compression(compressor_thread_lock &);
+
+	int get_preferred_compression_level(compressor_thread_lock &);
 };
 
 class compressor_thread_lock {
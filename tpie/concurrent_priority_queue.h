@@ -0,0 +1,248 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file concurrent_priority_queue.h
+/// \brief External memory priority queue with concurrent producers.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_CONCURRENT_PRIORITY_QUEUE_H__
+#define __TPIE_CONCURRENT_PRIORITY_QUEUE_H__
+
+#include <tpie/priority_queue.h>
+#include <tpie/array.h>
+#include <tpie/exception_ptr.h>
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \class concurrent_priority_queue
+/// \brief External memory priority queue that any number of threads may push
+/// to and pop from.
+///
+/// Each pushing thread uses its own producer object, which collects elements
+/// in a private buffer of max_run_size() elements. When the buffer is full,
+/// the producer sorts it in its own thread and hands it to the shared
+/// priority_queue as a run in group 0, so the shared queue is only locked
+/// for one linear-time merge per buffer. A flush of less than half a buffer
+/// would waste most of a group 0 slot, so those elements are pushed to the
+/// insertion buffer of the shared queue instead.
+///
+/// Elements in the buffer of a producer are not seen by consumers before
+/// the producer is flushed, which happens when its buffer is full, when
+/// flush() is called and when the producer is destroyed. Call flush()
+/// before destroying a producer to get any error in the pushing thread. An
+/// error while a producer is destroyed is instead rethrown by the next
+/// call to try_pop, pop_n, pop_all_less_than, size or empty.
+///
+/// Each producer allocates as much memory as the insertion buffer of the
+/// shared queue, which is not part of the memory given to the queue.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename Comparator = std::less<T> >
+class concurrent_priority_queue {
+public:
+	typedef priority_queue<T, Comparator> queue_type;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor.
+	///
+	/// \param f Factor of memory that the shared priority queue is allowed to
+	/// use.
+	/// \param b Block factor
+	/// \param compressionFlags Compression of the temporary files.
+	///////////////////////////////////////////////////////////////////////////
+	concurrent_priority_queue(double f=1.0, float b=0.0625,
+							  compression_flags compressionFlags=compression_none)
+		: m_queue(f, b, compressionFlags)
+	{
+	}
+
+#ifndef DOXYGEN
+	// \param mmavail Number of bytes the shared priority queue is allowed to
+	// use.
+	// \param b Block factor
+	// \param compressionFlags Compression of the temporary files.
+	concurrent_priority_queue(memory_size_type mm_avail, float b=0.0625,
+							  compression_flags compressionFlags=compression_none)
+		: m_queue(mm_avail, b, compressionFlags)
+	{
+	}
+#endif
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Push handle of a single thread.
+	///
+	/// A producer must only be used by one thread at a time, and it must be
+	/// destroyed before the queue.
+	///////////////////////////////////////////////////////////////////////////
+	class producer {
+	public:
+		producer(concurrent_priority_queue & pq)
+			: m_pq(pq)
+			, m_comp(pq.m_queue.get_comparator())
+			, m_buffer(pq.max_run_size())
+			, m_size(0)
+		{
+		}
+
+		~producer() {
+			try {
+				flush();
+			} catch (...) {
+				// Throwing from a destructor would terminate the program.
+				m_pq.set_error(tpie::current_exception());
+			}
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Insert an element into the queue.
+		///////////////////////////////////////////////////////////////////////
+		void push(const T & x) {
+			if (m_size == m_buffer.size()) flush();
+			m_buffer[m_size++] = x;
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Make the pushed elements visible to the consumer.
+		///////////////////////////////////////////////////////////////////////
+		void flush() {
+			if (m_size == 0) return;
+			// The buffer is emptied first, so that the elements are not
+			// pushed again by the destructor if the queue throws.
+			memory_size_type size = m_size;
+			m_size = 0;
+			if (2*size < m_buffer.size()) {
+				m_pq.push(m_buffer.get(), m_buffer.get() + size);
+			} else {
+				std::sort(m_buffer.begin(), m_buffer.find(size), m_comp);
+				m_pq.push_sorted_run(m_buffer.get(), size);
+			}
+		}
+
+	private:
+		concurrent_priority_queue & m_pq;
+		Comparator m_comp;
+		array<T> m_buffer;
+		memory_size_type m_size;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the top element from the priority queue.
+	///
+	/// There is no separate top() and pop(), since a producer may flush a new
+	/// top element between the two calls.
+	///
+	/// \param x Receives the removed element
+	/// \returns False if no flushed elements remain, in which case x is
+	/// unchanged
+	///////////////////////////////////////////////////////////////////////////
+	bool try_pop(T & x) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		rethrow_error();
+		if (m_queue.empty()) return false;
+		x = m_queue.top();
+		m_queue.pop();
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Pop up to n elements in priority order.
+	/// \sa priority_queue::pop_n
+	///////////////////////////////////////////////////////////////////////////
+	template <typename OutputIterator>
+	OutputIterator pop_n(stream_size_type n, OutputIterator out) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		rethrow_error();
+		return m_queue.pop_n(n, out);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Pop the elements that precede key in priority order.
+	/// \sa priority_queue::pop_all_less_than
+	///////////////////////////////////////////////////////////////////////////
+	template <typename OutputIterator>
+	OutputIterator pop_all_less_than(const T & key, OutputIterator out) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		rethrow_error();
+		return m_queue.pop_all_less_than(key, out);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of elements that have been flushed and not popped.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type size() {
+		boost::mutex::scoped_lock lock(m_mutex);
+		rethrow_error();
+		return m_queue.size();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether no flushed elements remain.
+	///////////////////////////////////////////////////////////////////////////
+	bool empty() {
+		boost::mutex::scoped_lock lock(m_mutex);
+		rethrow_error();
+		return m_queue.empty();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Size of the buffer of each producer.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type max_run_size() const {
+		return m_queue.max_run_size();
+	}
+
+private:
+	void push_sorted_run(T * arr, memory_size_type len) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_queue.push_sorted_run(arr, len);
+	}
+
+	void push(T * begin, T * end) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_queue.push(begin, end);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remember an error of a producer destructor. Only the first
+	/// error is kept.
+	///////////////////////////////////////////////////////////////////////////
+	void set_error(const boost::exception_ptr & error) {
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (!m_error) m_error = error;
+	}
+
+	// Must be called with m_mutex locked.
+	void rethrow_error() {
+		if (!m_error) return;
+		boost::exception_ptr error = m_error;
+		m_error = boost::exception_ptr();
+		boost::rethrow_exception(error);
+	}
+
+	boost::mutex m_mutex;
+	queue_type m_queue;
+	boost::exception_ptr m_error;
+};
+
+} // namespace tpie
+
+#endif // __TPIE_CONCURRENT_PRIORITY_QUEUE_H__
@@ -5,6 +5,7 @@
 
 #cmakedefine TPIE_HAVE_UNISTD_H
 #cmakedefine TPIE_HAVE_SYS_UNISTD_H
+#cmakedefine TPIE_HAS_IO_URING
 
 #cmakedefine TPIE_DEPRECATED_WARNINGS
 #cmakedefine TPIE_PARALLEL_SORT
@@ -75,6 +76,8 @@
 #endif
 
 #cmakedefine TPIE_HAS_SNAPPY
+#cmakedefine TPIE_HAS_LZ4
+#cmakedefine TPIE_HAS_ZSTD
 
 #ifdef _WIN32
 #ifndef NOMINMAX
@@ -0,0 +1,185 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#include <tpie/cpu_affinity.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace tpie {
+
+namespace {
+
+#ifdef __linux__
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Parse a sysfs list such as "0-3,8-11" into its elements.
+///////////////////////////////////////////////////////////////////////////////
+bool read_sysfs_list(const std::string & path, std::vector<memory_size_type> & out) {
+	out.clear();
+	std::ifstream f(path.c_str());
+	std::string line;
+	if (!std::getline(f, line)) return false;
+	std::string::size_type i = 0;
+	while (i < line.size()) {
+		std::string::size_type j = line.find(',', i);
+		if (j == std::string::npos) j = line.size();
+		std::string range = line.substr(i, j - i);
+		std::string::size_type dash = range.find('-');
+		memory_size_type a = strtoul(range.c_str(), 0, 10);
+		memory_size_type b = a;
+		if (dash != std::string::npos) b = strtoul(range.c_str() + dash + 1, 0, 10);
+		for (memory_size_type x = a; x <= b; ++x) out.push_back(x);
+		i = j + 1;
+	}
+	return !out.empty();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The NUMA nodes that have processors.
+///////////////////////////////////////////////////////////////////////////////
+std::vector<memory_size_type> numa_nodes() {
+	std::vector<memory_size_type> nodes;
+	std::vector<memory_size_type> online;
+	std::vector<memory_size_type> cpus;
+	if (!read_sysfs_list("/sys/devices/system/node/online", online)) return nodes;
+	for (size_t i = 0; i < online.size(); ++i) {
+		std::stringstream path;
+		path << "/sys/devices/system/node/node" << online[i] << "/cpulist";
+		if (read_sysfs_list(path.str(), cpus)) nodes.push_back(online[i]);
+	}
+	return nodes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The processors the calling thread is allowed to run on, which may
+/// be fewer than the online processors under taskset or cgroups.
+///////////////////////////////////////////////////////////////////////////////
+std::vector<memory_size_type> allowed_cpus() {
+	std::vector<memory_size_type> cpus;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+	for (memory_size_type i = 0; i < CPU_SETSIZE; ++i) {
+		if (CPU_ISSET(i, &set)) cpus.push_back(i);
+	}
+	return cpus;
+}
+
+bool set_affinity(const std::vector<memory_size_type> & cpus) {
+	if (cpus.empty()) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus.size(); ++i) {
+		if (cpus[i] < CPU_SETSIZE) CPU_SET(cpus[i], &set);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+#endif // __linux__
+
+} // unnamed namespace
+
+memory_size_type cpu_count() {
+#ifdef __linux__
+	memory_size_type allowed = allowed_cpus().size();
+	if (allowed) return allowed;
+#endif // __linux__
+	memory_size_type n = boost::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+#ifdef _WIN32
+
+memory_size_type numa_node_count() {
+	ULONG highest;
+	if (!GetNumaHighestNodeNumber(&highest)) return 1;
+	return highest + 1;
+}
+
+bool pin_thread_to_cpu(memory_size_type cpu) {
+	cpu %= std::min<memory_size_type>(cpu_count(), sizeof(DWORD_PTR) * 8);
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
+bool pin_thread_to_numa_node(memory_size_type node) {
+	ULONGLONG mask;
+	if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node % numa_node_count()), &mask)) return false;
+	if (mask == 0) return false;
+	return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask)) != 0;
+}
+
+#elif defined(__linux__)
+
+memory_size_type numa_node_count() {
+	memory_size_type n = numa_nodes().size();
+	return n ? n : 1;
+}
+
+bool pin_thread_to_cpu(memory_size_type cpu) {
+	std::vector<memory_size_type> allowed = allowed_cpus();
+	if (allowed.empty()) return false;
+	std::vector<memory_size_type> cpus(1, allowed[cpu % allowed.size()]);
+	return set_affinity(cpus);
+}
+
+bool pin_thread_to_numa_node(memory_size_type node) {
+	std::vector<memory_size_type> nodes = numa_nodes();
+	if (nodes.empty()) return false;
+	std::stringstream path;
+	path << "/sys/devices/system/node/node" << nodes[node % nodes.size()] << "/cpulist";
+	std::vector<memory_size_type> nodeCpus;
+	if (!read_sysfs_list(path.str(), nodeCpus)) return false;
+	// Only use the processors of the node the thread is allowed to run on.
+	std::vector<memory_size_type> allowed = allowed_cpus();
+	std::vector<memory_size_type> cpus;
+	std::sort(nodeCpus.begin(), nodeCpus.end());
+	std::set_intersection(nodeCpus.begin(), nodeCpus.end(),
+						  allowed.begin(), allowed.end(), std::back_inserter(cpus));
+	return set_affinity(cpus);
+}
+
+#else
+
+memory_size_type numa_node_count() {
+	return 1;
+}
+
+bool pin_thread_to_cpu(memory_size_type) {
+	return false;
+}
+
+bool pin_thread_to_numa_node(memory_size_type) {
+	return false;
+}
+
+#endif
+
+} // namespace tpie
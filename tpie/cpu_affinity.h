@@ -0,0 +1,72 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+#ifndef __TPIE_CPU_AFFINITY_H__
+#define __TPIE_CPU_AFFINITY_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file cpu_affinity.h  Binding threads to processors and NUMA nodes.
+///
+/// Memory is placed on the NUMA node of the thread that first touches it, so
+/// a thread that is bound to a node before it allocates and fills its buffers
+/// keeps its memory accesses local to its socket.
+///
+/// On platforms without support, the pinning functions return false and
+/// leave the thread where it is.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <tpie/types.h>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Number of processors that threads can be pinned to.
+///
+/// On Linux, these are the processors in the affinity mask of the calling
+/// thread, so a process restricted by taskset or cgroups only counts the
+/// processors it may use.
+///////////////////////////////////////////////////////////////////////////////
+memory_size_type cpu_count();
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Number of NUMA nodes that have processors; one on machines
+/// without NUMA.
+///////////////////////////////////////////////////////////////////////////////
+memory_size_type numa_node_count();
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Restrict the calling thread to a single processor.
+/// \param cpu  Index into the processors counted by cpu_count(); taken
+/// modulo cpu_count().
+/// \returns  Whether the thread was pinned.
+///////////////////////////////////////////////////////////////////////////////
+bool pin_thread_to_cpu(memory_size_type cpu);
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Restrict the calling thread to the processors of a NUMA node
+/// that it is allowed to run on.
+/// \param node  Node index; taken modulo numa_node_count().
+/// \returns  Whether the thread was pinned.
+///////////////////////////////////////////////////////////////////////////////
+bool pin_thread_to_numa_node(memory_size_type node);
+
+} // namespace tpie
+
+#endif // __TPIE_CPU_AFFINITY_H__
@@ -0,0 +1,72 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+// 
+// This file is part of TPIE.
+// 
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+// 
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file exception_ptr.h  Passing exceptions between threads.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_EXCEPTION_PTR_H__
+#define __TPIE_EXCEPTION_PTR_H__
+#include <tpie/exception.h>
+#include <boost/exception_ptr.hpp>
+#include <new>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Capture the exception being handled, so that another thread can
+/// rethrow it with boost::rethrow_exception.
+///
+/// boost::current_exception only keeps the type of exceptions thrown through
+/// boost::throw_exception, and turns any other exception into its standard
+/// base class. The TPIE exception types are copied here, so that the
+/// rethrown exception can still be caught as, e.g., out_of_space_exception.
+///
+/// Must be called from a catch block.
+///////////////////////////////////////////////////////////////////////////////
+inline boost::exception_ptr current_exception() {
+	try {
+		throw;
+	} catch (const out_of_space_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const io_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const invalid_file_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const end_of_stream_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const stream_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const invalid_argument_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const job_manager_exception & e) {
+		return boost::copy_exception(e);
+	} catch (const exception & e) {
+		return boost::copy_exception(e);
+	} catch (const std::bad_alloc & e) {
+		return boost::copy_exception(e);
+	} catch (...) {
+		return boost::current_exception();
+	}
+}
+
+} // namespace tpie
+
+#endif // __TPIE_EXCEPTION_PTR_H__
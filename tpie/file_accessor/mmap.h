@@ -0,0 +1,81 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file mmap.h  Read-only memory mapping of a file
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_FILE_ACCESSOR_MMAP_H
+#define _TPIE_FILE_ACCESSOR_MMAP_H
+
+#include <tpie/types.h>
+#include <tpie/cache_hint.h>
+
+namespace tpie {
+namespace file_accessor {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Read-only mapping of an entire file into the address space.
+///
+/// Used by the posix file accessor in memory mapped mode. The mapping is
+/// advised according to the cache hint of the file accessor. The mapping
+/// does not follow changes to the file size, so it must only be used for
+/// files that are not written while mapped.
+///////////////////////////////////////////////////////////////////////////////
+
+class memory_map {
+public:
+	inline memory_map();
+	inline ~memory_map() {unmap();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map the first size bytes of the given file.
+	///
+	/// \returns Whether the file could be mapped. If not, for instance if the
+	/// file is larger than the address space, the caller should fall back
+	/// to reading the file.
+	///////////////////////////////////////////////////////////////////////////
+	inline bool map(int fd, stream_size_type size, cache_hint cacheHint);
+
+	inline void unmap();
+
+	bool is_mapped() const {return m_data != 0;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Pointer to the mapped bytes at the given file offset.
+	///
+	/// \returns A pointer that stays valid until unmap is called, or 0 if
+	/// the range is not mapped.
+	///////////////////////////////////////////////////////////////////////////
+	const char * get(stream_size_type offset, memory_size_type size) const {
+		if (m_data == 0 || offset > m_size || size > m_size - offset) return 0;
+		return m_data + offset;
+	}
+
+private:
+	const char * m_data;
+	stream_size_type m_size;
+};
+
+}
+}
+
+#include <tpie/file_accessor/mmap.inl>
+
+#endif //_TPIE_FILE_ACCESSOR_MMAP_H
@@ -0,0 +1,66 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include <tpie/file_accessor/mmap.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <limits>
+
+namespace tpie {
+namespace file_accessor {
+
+memory_map::memory_map()
+	: m_data(0)
+	, m_size(0)
+{
+}
+
+bool memory_map::map(int fd, stream_size_type size, cache_hint cacheHint) {
+	unmap();
+	if (size == 0 || size > std::numeric_limits<size_t>::max()) return false;
+	void * data = ::mmap(0, static_cast<size_t>(size), PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) return false;
+
+	int advice;
+	switch (cacheHint) {
+		case access_sequential:
+			advice = MADV_SEQUENTIAL;
+			break;
+		case access_random:
+			advice = MADV_RANDOM;
+			break;
+		default:
+			advice = MADV_NORMAL;
+			break;
+	}
+	::madvise(data, static_cast<size_t>(size), advice);
+
+	m_data = static_cast<const char *>(data);
+	m_size = size;
+	return true;
+}
+
+void memory_map::unmap() {
+	if (m_data == 0) return;
+	::munmap(const_cast<char *>(m_data), static_cast<size_t>(m_size));
+	m_data = 0;
+	m_size = 0;
+}
+
+}
+}
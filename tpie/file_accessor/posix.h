@@ -25,17 +25,41 @@
 #define _TPIE_FILE_ACCESSOR_POSIX_H
 
 #include <tpie/file_accessor/stream_accessor_base.h>
+#include <tpie/file_accessor/mmap.h>
+#include <tpie/stats.h>
 namespace tpie {
 namespace file_accessor {
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief POSIX-style file accessor.
+///
+/// In direct I/O mode, the file is opened a second time with O_DIRECT, and
+/// positional reads and writes whose offset, size and buffer address are
+/// multiples of DIRECT_IO_ALIGNMENT go through that descriptor, bypassing
+/// the page cache. Other requests, such as the stream header or a partial
+/// final block, use the ordinary descriptor. If the file system does not
+/// support O_DIRECT, all requests use the ordinary descriptor. To keep the
+/// two descriptors coherent, a write through the ordinary descriptor is
+/// written back at once, and a write through the O_DIRECT descriptor drops
+/// the cached pages of its range.
+///
+/// In memory mapped mode, a file opened read-only is mapped into the address
+/// space, and reads are served from the mapping. map_i gives direct access
+/// to the mapped bytes, so that callers may avoid the copy altogether.
 ///////////////////////////////////////////////////////////////////////////////
 
 class posix {
-private:
+public:
+	static const memory_size_type DIRECT_IO_ALIGNMENT = 4096;
+
+protected:
 	int m_fd;
+	int m_directFd;
+	bool m_directIo;
+	bool m_memoryMapped;
+	memory_map m_map;
 	cache_hint m_cacheHint;
+	file_io_stats m_stats;
 
 public:
 	inline posix();
@@ -49,6 +73,18 @@ public:
 	inline void read_i(void * data, memory_size_type size);
 	inline void write_i(const void * data, memory_size_type size);
 	inline void seek_i(stream_size_type offset);
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Read size bytes at the given offset without moving the file
+	/// position. Unlike seek_i followed by read_i, this may be called by
+	/// several threads on the same file at once.
+	///////////////////////////////////////////////////////////////////////////
+	inline void pread_i(stream_size_type offset, void * data, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Write size bytes at the given offset without moving the file
+	/// position.
+	///////////////////////////////////////////////////////////////////////////
+	inline void pwrite_i(stream_size_type offset, const void * data, memory_size_type size);
 	inline stream_size_type file_size_i();
 	inline void close_i();
 	inline void truncate_i(stream_size_type bytes);
@@ -62,8 +98,76 @@ public:
 
 	inline void set_cache_hint(cache_hint cacheHint);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable direct I/O. Takes effect on the next open.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_direct_io(bool directIo);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether aligned requests currently bypass the page cache.
+	///////////////////////////////////////////////////////////////////////////
+	bool is_direct_io() const {return m_directFd != -1;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable memory mapping of files opened read-only.
+	/// Takes effect on the next open.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_memory_mapped(bool memoryMapped);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether the open file is currently memory mapped.
+	///////////////////////////////////////////////////////////////////////////
+	bool is_memory_mapped() const {return m_map.is_mapped();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Get a pointer to size bytes at the given offset of the mapped
+	/// file, or 0 if the file is not memory mapped. The pointer is valid
+	/// until the file is closed.
+	///////////////////////////////////////////////////////////////////////////
+	inline const char * map_i(stream_size_type offset, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes read through this accessor since reset_stats
+	/// was called.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const {return m_stats.bytes_read();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes written through this accessor since reset_stats
+	/// was called.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_written() const {return m_stats.bytes_written();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of requests sent to the O_DIRECT descriptor since
+	/// reset_stats was called.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_direct_io_requests() const {return m_stats.direct_io_requests();}
+
+	void reset_stats() {m_stats.reset();}
+
+protected:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The descriptor to use for a positional request.
+	///////////////////////////////////////////////////////////////////////////
+	inline int fd_for(stream_size_type offset, const void * data, memory_size_type size) const;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Count a request that is sent to the given descriptor.
+	///////////////////////////////////////////////////////////////////////////
+	void count_request(int fd) {
+		if (fd == m_directFd) m_stats.record_direct_io();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Keep the descriptors coherent after size bytes at offset were
+	/// written through fd.
+	///////////////////////////////////////////////////////////////////////////
+	inline void written(int fd, stream_size_type offset, memory_size_type size);
+
 private:
 	inline void give_advice();
+	inline void open_direct(const std::string & path, int flags);
 };
 
 }
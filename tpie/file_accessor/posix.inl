@@ -20,6 +20,7 @@
 #include <string.h>
 #include <tpie/exception.h>
 #include <tpie/file_count.h>
+#include <tpie/util.h>
 #include <tpie/file_accessor/posix.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -38,6 +39,9 @@ void posix::throw_errno() {
 
 posix::posix()
 	: m_fd(0)
+	, m_directFd(-1)
+	, m_directIo(false)
+	, m_memoryMapped(false)
 	, m_cacheHint(access_normal)
 {
 }
@@ -46,6 +50,60 @@ inline void posix::set_cache_hint(cache_hint cacheHint) {
 	m_cacheHint = cacheHint;
 }
 
+inline void posix::set_direct_io(bool directIo) {
+	m_directIo = directIo;
+}
+
+inline void posix::set_memory_mapped(bool memoryMapped) {
+	m_memoryMapped = memoryMapped;
+}
+
+inline const char * posix::map_i(stream_size_type offset, memory_size_type size) {
+	const char * data = m_map.get(offset, size);
+	if (data != 0) m_stats.record_read(size);
+	return data;
+}
+
+inline void posix::open_direct(const std::string & path, int flags) {
+	if (!m_directIo) return;
+#ifdef O_DIRECT
+	// The file system may not support O_DIRECT, in which case we
+	// simply use the page cache.
+	m_directFd = ::open(path.c_str(), flags | O_DIRECT);
+#else // O_DIRECT
+	unused(path);
+	unused(flags);
+#endif // O_DIRECT
+}
+
+inline int posix::fd_for(stream_size_type offset, const void * data, memory_size_type size) const {
+	if (m_directFd == -1) return m_fd;
+	if (offset % DIRECT_IO_ALIGNMENT != 0
+		|| size % DIRECT_IO_ALIGNMENT != 0
+		|| reinterpret_cast<size_t>(data) % DIRECT_IO_ALIGNMENT != 0)
+		return m_fd;
+	return m_directFd;
+}
+
+inline void posix::written(int fd, stream_size_type offset, memory_size_type size) {
+	if (m_directFd == -1 || size == 0) return;
+	if (fd == m_directFd) {
+		// Pages of the range cached by the ordinary descriptor are stale.
+#ifndef __MACH__
+		::posix_fadvise(m_fd, offset, size, POSIX_FADV_DONTNEED);
+#endif // __MACH__
+		return;
+	}
+	// A direct read of the range must not miss the dirty pages.
+#ifdef SYNC_FILE_RANGE_WRITE
+	if (::sync_file_range(m_fd, offset, size, SYNC_FILE_RANGE_WAIT_BEFORE
+						  | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == -1)
+		throw_errno();
+#else // SYNC_FILE_RANGE_WRITE
+	if (::fdatasync(m_fd) == -1) throw_errno();
+#endif // SYNC_FILE_RANGE_WRITE
+}
+
 inline void posix::give_advice() {
 #ifndef __MACH__
 	int advice;
@@ -76,12 +134,44 @@ inline void posix::read_i(void * data, memory_size_type size) {
 		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
 		throw io_exception(ss.str());
 	}
-	increment_bytes_read(size);
+	m_stats.record_read(size);
 }
 
 inline void posix::write_i(const void * data, memory_size_type size) {
 	if (::write(m_fd, data, size) != (memory_offset_type)size) throw_errno();
-	increment_bytes_written(size);
+	m_stats.record_write(size);
+	if (m_directFd != -1) {
+		off_t end = ::lseek(m_fd, 0, SEEK_CUR);
+		if (end == -1) throw_errno();
+		written(m_fd, static_cast<stream_size_type>(end) - size, size);
+	}
+}
+
+inline void posix::pread_i(stream_size_type offset, void * data, memory_size_type size) {
+	const char * mapped = map_i(offset, size);
+	if (mapped != 0) {
+		memcpy(data, mapped, size);
+		return;
+	}
+	int fd = fd_for(offset, data, size);
+	count_request(fd);
+	memory_offset_type bytesRead = ::pread(fd, data, size, offset);
+	if (bytesRead == -1)
+		throw_errno();
+	if (bytesRead != static_cast<memory_offset_type>(size)) {
+		std::stringstream ss;
+		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
+		throw io_exception(ss.str());
+	}
+	m_stats.record_read(size);
+}
+
+inline void posix::pwrite_i(stream_size_type offset, const void * data, memory_size_type size) {
+	int fd = fd_for(offset, data, size);
+	count_request(fd);
+	if (::pwrite(fd, data, size, offset) != (memory_offset_type)size) throw_errno();
+	m_stats.record_write(size);
+	written(fd, offset, size);
 }
 
 inline void posix::seek_i(stream_size_type size) {
@@ -98,6 +188,7 @@ inline stream_size_type posix::file_size_i() {
 void posix::open_wo(const std::string & path) {
 	m_fd = ::open(path.c_str(), O_RDWR | O_TRUNC | O_CREAT,  S_IRUSR | S_IWUSR);
 	if (m_fd == -1) throw_errno();
+	open_direct(path, O_RDWR);
 	give_advice();
 }
 
@@ -105,6 +196,9 @@ void posix::open_ro(const std::string & path) {
 	m_fd = ::open(path.c_str(), O_RDONLY);
 	if (m_fd == -1) throw_errno();
 	give_advice();
+	// If the file cannot be mapped, we fall back to ordinary reads.
+	if (m_memoryMapped && m_map.map(m_fd, file_size_i(), m_cacheHint)) return;
+	open_direct(path, O_RDONLY);
 }
 
 bool posix::try_open_rw(const std::string & path) {
@@ -113,6 +207,7 @@ bool posix::try_open_rw(const std::string & path) {
 		if (errno != ENOENT) throw_errno();
 		return false;
 	}
+	open_direct(path, O_RDWR);
 	give_advice();
 	return true;
 }
@@ -120,6 +215,7 @@ bool posix::try_open_rw(const std::string & path) {
 void posix::open_rw_new(const std::string & path) {
 	m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
 	if (m_fd == -1) throw_errno();
+	open_direct(path, O_RDWR);
 	give_advice();
 }
 
@@ -128,10 +224,15 @@ bool posix::is_open() const {
 }
 
 void posix::close_i() {
+	m_map.unmap();
 	if (m_fd != 0) {
 		::close(m_fd);
 	}
 	m_fd=0;
+	if (m_directFd != -1) {
+		::close(m_directFd);
+	}
+	m_directFd=-1;
 }
 
 void posix::truncate_i(stream_size_type bytes) {
@@ -33,26 +33,34 @@ public:
 										memory_size_type itemCount) override
 	{
 		stream_size_type loc = this->header_size() + blockNumber*this->block_size();
-		this->m_fileAccessor.seek_i(loc);
 		stream_size_type offset = blockNumber*this->block_items();
 		if (offset + itemCount > this->size()) itemCount = static_cast<memory_size_type>(this->size() - offset);
 		memory_size_type z=itemCount*this->item_size();
-		this->m_fileAccessor.read_i(data, z);
+		this->m_fileAccessor.pread_i(loc, data, z);
 		return itemCount;
 	}
 
+	virtual const char * map_block(stream_size_type blockNumber,
+								   memory_size_type itemCount) override
+	{
+		stream_size_type loc = this->header_size() + blockNumber*this->block_size();
+		// Items are only accessed in place if the block is suitably aligned
+		// for any item type; otherwise, they are copied by read_block.
+		if (loc % 16 != 0) return 0;
+		return this->m_fileAccessor.map_i(loc, itemCount*this->item_size());
+	}
+
 	virtual void write_block(const void * data,
 							 stream_size_type blockNumber,
 							 memory_size_type itemCount) override
 	{
 		stream_size_type loc = this->header_size() + blockNumber*this->block_size();
-		// Here, we may seek beyond the file size.
-		// However, lseek(2) specifies that the file will be padded with zeroes in this case,
+		// Here, we may write beyond the file size.
+		// However, pwrite(2) specifies that the file will be padded with zeroes in this case,
 		// and on Windows, the file is padded with arbitrary garbage (which is ok).
-		this->m_fileAccessor.seek_i(loc);
 		stream_size_type offset = blockNumber*this->block_items();
 		memory_size_type z=itemCount*this->item_size();
-		this->m_fileAccessor.write_i(data, z);
+		this->m_fileAccessor.pwrite_i(loc, data, z);
 		if (offset+itemCount > this->size()) this->set_size(offset+itemCount);
 	}
 };
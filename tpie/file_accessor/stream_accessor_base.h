@@ -131,6 +131,39 @@ public:
 
 	inline void close();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable direct I/O, bypassing the OS page cache for
+	/// aligned block reads and writes. Takes effect on the next open.
+	///////////////////////////////////////////////////////////////////////////
+	void set_direct_io(bool directIo) { m_fileAccessor.set_direct_io(directIo); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable memory mapping of streams opened read-only.
+	/// Takes effect on the next open.
+	///////////////////////////////////////////////////////////////////////////
+	void set_memory_mapped(bool memoryMapped) { m_fileAccessor.set_memory_mapped(memoryMapped); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes read from disk, including the header, since the
+	/// file currently or most recently open was opened.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const { return m_fileAccessor.get_bytes_read(); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes written to disk, including the header, since the
+	/// file currently or most recently open was opened.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_written() const { return m_fileAccessor.get_bytes_written(); }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Get a pointer to the given number of items at the beginning of
+	/// the given block in the memory mapped file.
+	/// \returns A pointer that is valid until the stream is closed, or 0 if
+	/// the block cannot be accessed directly, in which case the caller must
+	/// use read_block instead.
+	///////////////////////////////////////////////////////////////////////////
+	virtual const char * map_block(stream_size_type /*blockNumber*/, memory_size_type /*itemCount*/) { return 0; }
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Read the given number of items from the given block into the
 	/// given buffer.
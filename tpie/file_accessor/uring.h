@@ -0,0 +1,172 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file uring.h  Linux io_uring file accessor
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TPIE_FILE_ACCESSOR_URING_H
+#define _TPIE_FILE_ACCESSOR_URING_H
+
+#include <tpie/file_accessor/posix.h>
+
+namespace tpie {
+namespace file_accessor {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief File accessor that submits reads and writes through a Linux
+/// io_uring.
+///
+/// Besides the synchronous interface of the posix accessor, this accessor
+/// lets the caller keep up to queue_depth() reads and writes in flight:
+/// submit_read and submit_write queue a request and return a ticket, and
+/// wait blocks until the request with the given ticket is done. Queued
+/// requests are submitted to the kernel in one batch when flush or wait is
+/// called. Requests in flight may complete in any order, so the caller must
+/// not have overlapping reads and writes outstanding at the same time.
+///
+/// If the kernel does not support io_uring or its read and write opcodes
+/// (Linux 5.6), requests are carried out synchronously with pread and pwrite
+/// instead.
+///
+/// This is a standalone accessor for code that issues its own requests.
+/// stream_accessor and the compressed stream request queue still use the
+/// default raw file accessor, so file_stream and compressed streams do not
+/// keep several requests in flight.
+///////////////////////////////////////////////////////////////////////////////
+
+class uring : public posix {
+public:
+	typedef memory_size_type ticket_t;
+
+	inline uring();
+	inline ~uring();
+
+	inline void open_ro(const std::string & path);
+	inline void open_wo(const std::string & path);
+	inline bool try_open_rw(const std::string & path);
+	inline void open_rw_new(const std::string & path);
+
+	inline void read_i(void * data, memory_size_type size);
+	inline void write_i(const void * data, memory_size_type size);
+	inline void seek_i(stream_size_type offset);
+	inline void pread_i(stream_size_type offset, void * data, memory_size_type size);
+	inline void pwrite_i(stream_size_type offset, const void * data, memory_size_type size);
+	inline stream_size_type file_size_i();
+	inline void close_i();
+	inline void truncate_i(stream_size_type bytes);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Queue a read of size bytes at the given file offset.
+	///
+	/// The buffer must stay valid until wait has been called on the returned
+	/// ticket. At most queue_depth() requests may be outstanding.
+	///////////////////////////////////////////////////////////////////////////
+	inline ticket_t submit_read(stream_size_type offset, void * data, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Queue a write of size bytes at the given file offset.
+	///
+	/// The buffer must stay valid until wait has been called on the returned
+	/// ticket. At most queue_depth() requests may be outstanding.
+	///////////////////////////////////////////////////////////////////////////
+	inline ticket_t submit_write(stream_size_type offset, const void * data, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Submit the queued requests to the kernel without waiting.
+	///////////////////////////////////////////////////////////////////////////
+	inline void flush();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the given request to finish.
+	///
+	/// \returns The number of bytes transferred. For reads, this is less
+	/// than the requested size only if end of file was reached.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type wait(ticket_t ticket);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for all outstanding requests to finish.
+	///////////////////////////////////////////////////////////////////////////
+	inline void wait_all();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Maximum number of outstanding requests.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type queue_depth() {return QUEUE_DEPTH;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether requests are handled by io_uring, as opposed to
+	/// the synchronous fallback.
+	///////////////////////////////////////////////////////////////////////////
+	bool is_asynchronous() const {return m_ringFd != -1;}
+
+private:
+	static const memory_size_type QUEUE_DEPTH = 32;
+
+	struct slot {
+		int fd;
+		char * data;
+		stream_size_type offset;
+		memory_size_type size;
+		memory_offset_type result;
+		bool write;
+		bool busy;
+		bool done;
+	};
+
+	static inline bool supports_read_write(int ringFd);
+	inline void setup_ring();
+	inline void teardown_ring();
+	inline void drain();
+	inline ticket_t submit(stream_size_type offset, char * data, memory_size_type size, bool write);
+	inline void enter(unsigned int minComplete);
+	inline void reap();
+	inline memory_offset_type finish_synchronously(slot & s, memory_size_type done);
+
+	slot m_slots[QUEUE_DEPTH];
+	memory_size_type m_outstanding;
+	unsigned int m_unsubmitted;
+
+	stream_size_type m_position;
+
+	int m_ringFd;
+	void * m_sqRing;
+	memory_size_type m_sqRingSize;
+	void * m_cqRing;
+	memory_size_type m_cqRingSize;
+	void * m_sqes;
+	memory_size_type m_sqesSize;
+
+	unsigned int * m_sqHead;
+	unsigned int * m_sqTail;
+	unsigned int m_sqMask;
+	unsigned int * m_sqArray;
+	unsigned int * m_cqHead;
+	unsigned int * m_cqTail;
+	unsigned int m_cqMask;
+	void * m_cqes;
+};
+
+}
+}
+
+#include <tpie/file_accessor/uring.inl>
+
+#endif //_TPIE_FILE_ACCESSOR_URING_H
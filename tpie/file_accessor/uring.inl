@@ -0,0 +1,361 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+#include <tpie/config.h>
+#include <string.h>
+#include <tpie/exception.h>
+#include <tpie/stats.h>
+#include <tpie/file_accessor/uring.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sstream>
+
+namespace tpie {
+namespace file_accessor {
+
+uring::uring()
+	: m_outstanding(0)
+	, m_unsubmitted(0)
+	, m_position(0)
+	, m_ringFd(-1)
+	, m_sqRing(0)
+	, m_cqRing(0)
+	, m_sqes(0)
+{
+	for (memory_size_type i = 0; i < QUEUE_DEPTH; ++i) m_slots[i].busy = false;
+}
+
+bool uring::supports_read_write(int ringFd) {
+	// IORING_OP_READ and IORING_OP_WRITE appeared in Linux 5.6 along with
+	// IORING_REGISTER_PROBE, so an older kernel fails the probe itself.
+	const unsigned int maxOps = 256;
+	char buf[sizeof(io_uring_probe) + maxOps * sizeof(io_uring_probe_op)];
+	memset(buf, 0, sizeof(buf));
+	io_uring_probe * probe = reinterpret_cast<io_uring_probe *>(buf);
+	if (::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, maxOps) < 0)
+		return false;
+	const unsigned int ops[] = {IORING_OP_READ, IORING_OP_WRITE};
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+		if (ops[i] > probe->last_op || ops[i] >= probe->ops_len) return false;
+		if (!(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) return false;
+	}
+	return true;
+}
+
+void uring::setup_ring() {
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = static_cast<int>(::syscall(__NR_io_uring_setup, QUEUE_DEPTH, &p));
+	if (fd == -1) return; // No io_uring; use the synchronous fallback.
+	if (!supports_read_write(fd)) {
+		::close(fd);
+		return;
+	}
+
+	m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (m_cqRingSize > m_sqRingSize) m_sqRingSize = m_cqRingSize;
+		m_cqRingSize = 0;
+	}
+	m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+
+	m_sqRing = ::mmap(0, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (m_sqRing == MAP_FAILED) {
+		m_sqRing = 0;
+		::close(fd);
+		return;
+	}
+	if (m_cqRingSize == 0) {
+		m_cqRing = m_sqRing;
+	} else {
+		m_cqRing = ::mmap(0, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (m_cqRing == MAP_FAILED) {
+			m_cqRing = 0;
+			::munmap(m_sqRing, m_sqRingSize);
+			m_sqRing = 0;
+			::close(fd);
+			return;
+		}
+	}
+	m_sqes = ::mmap(0, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (m_sqes == MAP_FAILED) {
+		m_sqes = 0;
+		if (m_cqRing != m_sqRing) ::munmap(m_cqRing, m_cqRingSize);
+		::munmap(m_sqRing, m_sqRingSize);
+		m_sqRing = m_cqRing = 0;
+		::close(fd);
+		return;
+	}
+
+	char * sq = static_cast<char *>(m_sqRing);
+	m_sqHead = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+	m_sqTail = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+	m_sqMask = *reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+	m_sqArray = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+
+	char * cq = static_cast<char *>(m_cqRing);
+	m_cqHead = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+	m_cqMask = *reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+	m_cqes = cq + p.cq_off.cqes;
+
+	m_ringFd = fd;
+}
+
+void uring::teardown_ring() {
+	if (m_ringFd == -1) return;
+	::munmap(m_sqes, m_sqesSize);
+	if (m_cqRing != m_sqRing) ::munmap(m_cqRing, m_cqRingSize);
+	::munmap(m_sqRing, m_sqRingSize);
+	m_sqes = m_sqRing = m_cqRing = 0;
+	::close(m_ringFd);
+	m_ringFd = -1;
+}
+
+void uring::open_ro(const std::string & path) {
+	posix::open_ro(path);
+	m_position = 0;
+	setup_ring();
+}
+
+void uring::open_wo(const std::string & path) {
+	posix::open_wo(path);
+	m_position = 0;
+	setup_ring();
+}
+
+bool uring::try_open_rw(const std::string & path) {
+	if (!posix::try_open_rw(path)) return false;
+	m_position = 0;
+	setup_ring();
+	return true;
+}
+
+void uring::open_rw_new(const std::string & path) {
+	posix::open_rw_new(path);
+	m_position = 0;
+	setup_ring();
+}
+
+uring::~uring() {
+	// close_i reports errors of outstanding requests by throwing, which a
+	// destructor must not do.
+	drain();
+	teardown_ring();
+	posix::close_i();
+}
+
+void uring::close_i() {
+	if (m_fd != 0) wait_all();
+	teardown_ring();
+	posix::close_i();
+}
+
+void uring::read_i(void * data, memory_size_type size) {
+	pread_i(m_position, data, size);
+	m_position += size;
+}
+
+void uring::write_i(const void * data, memory_size_type size) {
+	pwrite_i(m_position, data, size);
+	m_position += size;
+}
+
+void uring::pread_i(stream_size_type offset, void * data, memory_size_type size) {
+	memory_size_type bytesRead = wait(submit_read(offset, data, size));
+	if (bytesRead != size) {
+		std::stringstream ss;
+		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
+		throw io_exception(ss.str());
+	}
+}
+
+void uring::pwrite_i(stream_size_type offset, const void * data, memory_size_type size) {
+	wait(submit_write(offset, data, size));
+}
+
+void uring::seek_i(stream_size_type offset) {
+	m_position = offset;
+}
+
+stream_size_type uring::file_size_i() {
+	wait_all();
+	return posix::file_size_i();
+}
+
+void uring::truncate_i(stream_size_type bytes) {
+	wait_all();
+	posix::truncate_i(bytes);
+}
+
+uring::ticket_t uring::submit_read(stream_size_type offset, void * data, memory_size_type size) {
+	return submit(offset, static_cast<char *>(data), size, false);
+}
+
+uring::ticket_t uring::submit_write(stream_size_type offset, const void * data, memory_size_type size) {
+	return submit(offset, static_cast<char *>(const_cast<void *>(data)), size, true);
+}
+
+uring::ticket_t uring::submit(stream_size_type offset, char * data, memory_size_type size, bool write) {
+	if (m_outstanding == QUEUE_DEPTH)
+		throw exception("uring: Too many outstanding requests");
+	ticket_t ticket = 0;
+	while (m_slots[ticket].busy) ++ticket;
+	slot & s = m_slots[ticket];
+	s.data = data;
+	s.offset = offset;
+	s.size = size;
+	s.result = 0;
+	s.write = write;
+	s.busy = true;
+	s.done = false;
+	++m_outstanding;
+
+	if (m_ringFd == -1) {
+		s.fd = m_fd;
+		s.result = finish_synchronously(s, 0);
+		s.done = true;
+		return ticket;
+	}
+
+	unsigned int tail = *m_sqTail;
+	unsigned int index = tail & m_sqMask;
+	io_uring_sqe * sqe = static_cast<io_uring_sqe *>(m_sqes) + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	s.fd = fd_for(offset, data, size);
+	count_request(s.fd);
+	sqe->fd = s.fd;
+	sqe->off = offset;
+	sqe->addr = reinterpret_cast<unsigned long>(data);
+	sqe->len = static_cast<unsigned int>(size);
+	sqe->user_data = ticket;
+	m_sqArray[index] = index;
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+	++m_unsubmitted;
+	return ticket;
+}
+
+void uring::flush() {
+	if (m_unsubmitted) enter(0);
+}
+
+void uring::enter(unsigned int minComplete) {
+	unsigned int flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+	int ret = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, m_unsubmitted, minComplete, flags, 0, 0));
+	if (ret == -1) {
+		if (errno == EINTR || errno == EAGAIN) return;
+		throw_errno();
+	}
+	m_unsubmitted -= static_cast<unsigned int>(ret);
+}
+
+void uring::reap() {
+	unsigned int head = *m_cqHead;
+	unsigned int tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		io_uring_cqe * cqe = static_cast<io_uring_cqe *>(m_cqes) + (head & m_cqMask);
+		slot & s = m_slots[cqe->user_data];
+		s.result = cqe->res;
+		s.done = true;
+		++head;
+	}
+	__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+memory_offset_type uring::finish_synchronously(slot & s, memory_size_type done) {
+	while (done < s.size) {
+		ssize_t n = s.write
+			? ::pwrite(m_fd, s.data + done, s.size - done, s.offset + done)
+			: ::pread(m_fd, s.data + done, s.size - done, s.offset + done);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			return -errno;
+		}
+		if (n == 0) break;
+		done += static_cast<memory_size_type>(n);
+	}
+	return static_cast<memory_offset_type>(done);
+}
+
+memory_size_type uring::wait(ticket_t ticket) {
+	slot & s = m_slots[ticket];
+	if (!s.busy) throw exception("uring: Waiting for a request that is not outstanding");
+	while (!s.done) {
+		enter(1);
+		reap();
+	}
+	memory_offset_type result = s.result;
+	if (result == -EINVAL) {
+		// The kernel rejected the request, e.g. because its alignment does
+		// not suit the descriptor; retry it with pread/pwrite.
+		s.fd = m_fd;
+		result = finish_synchronously(s, 0);
+	} else if (result >= 0 && static_cast<memory_size_type>(result) < s.size) {
+		// The rest of the request goes through the ordinary descriptor.
+		if (s.write) written(s.fd, s.offset, static_cast<memory_size_type>(result));
+		s.fd = m_fd;
+		result = finish_synchronously(s, static_cast<memory_size_type>(result));
+	}
+	s.busy = false;
+	--m_outstanding;
+
+	if (result < 0) {
+		errno = static_cast<int>(-result);
+		throw_errno();
+	}
+	if (s.write) {
+		if (static_cast<memory_size_type>(result) != s.size) throw io_exception("uring: Short write");
+		m_stats.record_write(s.size);
+		written(s.fd, s.offset, s.size);
+	} else {
+		m_stats.record_read(static_cast<memory_size_type>(result));
+	}
+	return static_cast<memory_size_type>(result);
+}
+
+void uring::drain() {
+	while (m_ringFd != -1) {
+		reap();
+		bool pending = false;
+		for (ticket_t i = 0; i < QUEUE_DEPTH; ++i)
+			if (m_slots[i].busy && !m_slots[i].done) pending = true;
+		if (!pending) break;
+		int ret = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, m_unsubmitted, 1, IORING_ENTER_GETEVENTS, 0, 0));
+		if (ret == -1) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			// Closing the ring cancels what is left.
+			break;
+		}
+		m_unsubmitted -= static_cast<unsigned int>(ret);
+	}
+	for (ticket_t i = 0; i < QUEUE_DEPTH; ++i) m_slots[i].busy = false;
+	m_outstanding = 0;
+}
+
+void uring::wait_all() {
+	for (ticket_t i = 0; m_outstanding > 0 && i < QUEUE_DEPTH; ++i)
+		if (m_slots[i].busy) wait(i);
+}
+
+}
+}
@@ -31,6 +31,7 @@
 #undef NO_ERROR
 
 #include <tpie/file_accessor/stream_accessor_base.h>
+#include <tpie/stats.h>
 namespace tpie {
 namespace file_accessor {
 
@@ -42,6 +43,7 @@ class win32 {
 private:
 	HANDLE m_fd;
 	DWORD m_creationFlag;
+	file_io_stats m_stats;
 
 public:
 	inline win32();
@@ -55,12 +57,56 @@ public:
 	inline void read_i(void * data, memory_size_type size);
 	inline void write_i(const void * data, memory_size_type size);
 	inline void seek_i(stream_size_type offset);
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Read size bytes at the given offset without moving the file
+	/// position. Unlike seek_i followed by read_i, this may be called by
+	/// several threads on the same file at once.
+	///////////////////////////////////////////////////////////////////////////
+	inline void pread_i(stream_size_type offset, void * data, memory_size_type size);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Write size bytes at the given offset without moving the file
+	/// position.
+	///////////////////////////////////////////////////////////////////////////
+	inline void pwrite_i(stream_size_type offset, const void * data, memory_size_type size);
 	inline stream_size_type file_size_i();
 	inline void close_i();
 	inline void truncate_i(stream_size_type bytes);
 	inline bool is_open() const;
 
 	inline void set_cache_hint(cache_hint cacheHint);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Direct I/O is not supported by this accessor; the setting is
+	/// ignored.
+	///////////////////////////////////////////////////////////////////////////
+	void set_direct_io(bool /*directIo*/) {}
+
+	bool is_direct_io() const {return false;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory mapping is not supported by this accessor; the setting
+	/// is ignored.
+	///////////////////////////////////////////////////////////////////////////
+	void set_memory_mapped(bool /*memoryMapped*/) {}
+
+	bool is_memory_mapped() const {return false;}
+
+	const char * map_i(stream_size_type /*offset*/, memory_size_type /*size*/) {return 0;}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes read through this accessor since reset_stats
+	/// was called.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const {return m_stats.bytes_read();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes written through this accessor since reset_stats
+	/// was called.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_written() const {return m_stats.bytes_written();}
+
+	void reset_stats() {m_stats.reset();}
 };
 
 }
@@ -50,13 +50,38 @@ inline void win32::read_i(void * data, memory_size_type size) {
 		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
 		throw io_exception(ss.str());
 	}
-	increment_bytes_read(size);
+	m_stats.record_read(size);
 }
 
 inline void win32::write_i(const void * data, memory_size_type size) {
 	DWORD bytesWritten = 0;
 	if (!WriteFile(m_fd, data, (DWORD)size, &bytesWritten, 0) || bytesWritten != size ) throw_getlasterror();
-	increment_bytes_written(size);
+	m_stats.record_write(size);
+}
+
+inline void win32::pread_i(stream_size_type offset, void * data, memory_size_type size) {
+	OVERLAPPED o;
+	memset(&o, 0, sizeof(o));
+	o.Offset = static_cast<DWORD>(offset);
+	o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD bytesRead = 0;
+	if (!ReadFile(m_fd, data, (DWORD)size, &bytesRead, &o)) throw_getlasterror();
+	if (bytesRead != size) {
+		std::stringstream ss;
+		ss << "Wrong number of bytes read: Expected " << size << " but got " << bytesRead;
+		throw io_exception(ss.str());
+	}
+	m_stats.record_read(size);
+}
+
+inline void win32::pwrite_i(stream_size_type offset, const void * data, memory_size_type size) {
+	OVERLAPPED o;
+	memset(&o, 0, sizeof(o));
+	o.Offset = static_cast<DWORD>(offset);
+	o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD bytesWritten = 0;
+	if (!WriteFile(m_fd, data, (DWORD)size, &bytesWritten, &o) || bytesWritten != size ) throw_getlasterror();
+	m_stats.record_write(size);
 }
 
 inline void win32::seek_i(stream_size_type size) {
@@ -186,6 +186,35 @@ public:
 	}
 
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Enable or disable memory mapping of files opened read-only.
+	///
+	/// When enabled, a file opened with access_read is mapped into the
+	/// address space, and blocks are read from the mapping, advised according
+	/// to the cache hint given to open. The setting takes effect on the next
+	/// open. It is ignored if the platform or the file accessor does not
+	/// support memory mapping.
+	///////////////////////////////////////////////////////////////////////////
+	void set_memory_mapped(bool memoryMapped) {
+		m_fileAccessor->set_memory_mapped(memoryMapped);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes read from disk, including the stream header,
+	/// since the file currently or most recently open was opened.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const {
+		return m_fileAccessor->get_bytes_read();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes written to disk, including the stream header,
+	/// since the file currently or most recently open was opened.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_written() const {
+		return m_fileAccessor->get_bytes_written();
+	}
+
 	/////////////////////////////////////////////////////////////////////////
 	/// \brief The path of the file opened or the empty string.
 	///
@@ -295,6 +324,15 @@ protected:
 
 	template <typename BT>
 	void read_block(BT & b, stream_size_type block);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Point b.data directly at the given block in the memory mapped
+	/// file instead of reading it.
+	/// \returns False if the block is not available in a mapping, in which
+	/// case b is left untouched and read_block must be used.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename BT>
+	bool map_block(BT & b, stream_size_type block);
 	void get_block_check(stream_size_type block);
 
 	memory_size_type m_blockItems;
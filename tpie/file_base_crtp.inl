@@ -56,6 +56,25 @@ void file_base_crtp<child_t>::read_block(BT & b, stream_size_type block) {
 	}
 }
 
+template <typename child_t>
+template <typename BT>
+bool file_base_crtp<child_t>::map_block(BT & b, stream_size_type block) {
+	memory_size_type size = m_blockItems;
+	if (static_cast<stream_size_type>(size) + block * static_cast<stream_size_type>(m_blockItems) > self().size())
+		size = static_cast<memory_size_type>(self().size() - block * m_blockItems);
+	if (size == 0) return false;
+
+	const char * data = m_fileAccessor->map_block(block, size);
+	if (data == 0) return false;
+
+	// The mapping is read-only, so the block must never be made dirty.
+	b.data = const_cast<char *>(data);
+	b.dirty = false;
+	b.number = block;
+	b.size = size;
+	return true;
+}
+
 template <typename child_t>
 void file_base_crtp<child_t>::get_block_check(stream_size_type block) {
 	// If the file contains n full blocks (numbered 0 through n-1), we may
@@ -33,10 +33,13 @@ file_stream_base::file_stream_base(memory_size_type itemSize,
 	m_nextIndex = std::numeric_limits<memory_size_type>::max();
 	m_index = std::numeric_limits<memory_size_type>::max();
 	m_block.data = 0;
+	m_blockBuffer = 0;
 }
 
 void file_stream_base::get_block(stream_size_type block) {
 	get_block_check(block);
+	if (!m_canWrite && map_block(m_block, block)) return;
+	m_block.data = m_blockBuffer;
 	read_block(m_block, block);
 }
 
@@ -50,7 +50,8 @@ public:
 	/////////////////////////////////////////////////////////////////////////
 	inline void close() throw(stream_exception) {
 		if (m_open) flush_block();
-		tpie_delete_array(m_block.data, m_itemSize * m_blockItems);
+		tpie_delete_array(m_blockBuffer, m_itemSize * m_blockItems);
+		m_blockBuffer = 0;
 		m_block.data = 0;
 		p_t::close();
 	}
@@ -104,6 +105,7 @@ protected:
 		swap(m_block.number,    other.m_block.number);
 		swap(m_block.dirty,     other.m_block.dirty);
 		swap(m_block.data,      other.m_block.data);
+		swap(m_blockBuffer,     other.m_blockBuffer);
 		swap(m_ownedTempFile,   other.m_ownedTempFile);
 		swap(m_tempFile,        other.m_tempFile);
 	}
@@ -122,7 +124,8 @@ protected:
 		m_block.size = 0;
 		m_block.number = std::numeric_limits<stream_size_type>::max();
 		m_block.dirty = false;
-		m_block.data = tpie_new_array<char>(m_blockItems * m_itemSize);
+		m_blockBuffer = tpie_new_array<char>(m_blockItems * m_itemSize);
+		m_block.data = m_blockBuffer;
 
 		initialize();
 		seek(0);
@@ -167,6 +170,10 @@ protected:
 
 	block_t m_block;
 
+	/** The buffer owned by the stream. When the file is memory mapped,
+	 * m_block.data may instead point into the mapping. */
+	char * m_blockBuffer;
+
 private:
 	friend class stream_crtp<file_stream_base>;
 	file_stream_base & get_file() {return *this;}
@@ -54,13 +54,24 @@ public:
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Insert some elements and run make_heap.
+	/// \brief Insert some elements.
+	///
+	/// Few elements compared to the heap are sifted up one at a time;
+	/// otherwise the heap is rebuilt with make_heap.
 	///////////////////////////////////////////////////////////////////////////
 	template <typename IT>
 	void insert(const IT & start, const IT & end) {
+		size_type n = static_cast<size_type>(end - start);
 		std::copy(start, end, pq.find(sz));
-		sz += (end - start);
-		make_safe();
+		if (n * 8 > sz) {
+			sz += n;
+			make_safe();
+			return;
+		}
+		for (size_type i = 0; i < n; ++i) {
+			++sz;
+			std::push_heap(pq.begin(), pq.find(sz), comp);
+		}
 	}
 
 	///////////////////////////////////////////////////////////////////////////
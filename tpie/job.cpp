@@ -19,15 +19,144 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \file job.cpp Job methods and job manager.
+///
+/// Each worker thread owns a deque of jobs. Jobs enqueued by a running job
+/// are pushed on the bottom of the deque of its worker, and the worker pops
+/// jobs from the bottom. Workers that run out of jobs steal from the top of
+/// the other deques. Jobs enqueued by other threads are pushed on a
+/// lock-free stack from which the workers take them. A thread waiting in
+/// job::join() runs pending jobs until the joined job is done. Idle threads
+/// sleep on a condition variable, which is only signalled when some thread
+/// is actually sleeping.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <tpie/job.h>
 #include <tpie/array.h>
-#include <tpie/internal_queue.h>
+#include <boost/bind.hpp>
 #include <tpie/exception.h>
 
 namespace tpie {
- 
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Work-stealing deque of jobs (Chase and Lev, 2005).
+///
+/// Only the owning worker may call push() and pop(); any thread may call
+/// steal(). The deque grows when it is full. Arrays replaced when growing are
+/// kept until the deque is destroyed, since a thief may still be reading
+/// from them.
+///////////////////////////////////////////////////////////////////////////////
+class job_deque {
+public:
+	job_deque()
+		: m_top(0)
+		, m_bottom(0)
+	{
+		m_ring = new_ring(INITIAL_CAPACITY, 0);
+	}
+
+	~job_deque() {
+		delete_rings(m_ring.load(boost::memory_order_relaxed));
+	}
+
+	void push(job * j) {
+		ptrdiff_t b = m_bottom.load(boost::memory_order_relaxed);
+		ptrdiff_t t = m_top.load(boost::memory_order_acquire);
+		ring * r = m_ring.load(boost::memory_order_relaxed);
+		if (b - t >= static_cast<ptrdiff_t>(r->capacity)) r = grow(r, t, b);
+		r->at(b).store(j, boost::memory_order_relaxed);
+		boost::atomic_thread_fence(boost::memory_order_release);
+		m_bottom.store(b + 1, boost::memory_order_relaxed);
+	}
+
+	job * pop() {
+		ptrdiff_t b = m_bottom.load(boost::memory_order_relaxed) - 1;
+		ring * r = m_ring.load(boost::memory_order_relaxed);
+		m_bottom.store(b, boost::memory_order_relaxed);
+		boost::atomic_thread_fence(boost::memory_order_seq_cst);
+		ptrdiff_t t = m_top.load(boost::memory_order_relaxed);
+		if (t > b) {
+			m_bottom.store(b + 1, boost::memory_order_relaxed);
+			return 0;
+		}
+		job * j = r->at(b).load(boost::memory_order_relaxed);
+		if (t == b) {
+			// Last job; race against thieves.
+			if (!m_top.compare_exchange_strong(t, t + 1, boost::memory_order_seq_cst, boost::memory_order_relaxed))
+				j = 0;
+			m_bottom.store(b + 1, boost::memory_order_relaxed);
+		}
+		return j;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Take the oldest job, or return 0 if the deque is empty or
+	/// another thread took the job first.
+	///////////////////////////////////////////////////////////////////////////
+	job * steal() {
+		ptrdiff_t t = m_top.load(boost::memory_order_acquire);
+		boost::atomic_thread_fence(boost::memory_order_seq_cst);
+		ptrdiff_t b = m_bottom.load(boost::memory_order_acquire);
+		if (t >= b) return 0;
+		ring * r = m_ring.load(boost::memory_order_acquire);
+		job * j = r->at(t).load(boost::memory_order_relaxed);
+		if (!m_top.compare_exchange_strong(t, t + 1, boost::memory_order_seq_cst, boost::memory_order_relaxed))
+			return 0;
+		return j;
+	}
+
+	bool empty() const {
+		return m_bottom.load(boost::memory_order_seq_cst) <= m_top.load(boost::memory_order_seq_cst);
+	}
+
+private:
+	static const size_t INITIAL_CAPACITY = 64;
+
+	struct ring {
+		size_t capacity;
+		boost::atomic<job *> * items;
+		ring * previous;
+
+		boost::atomic<job *> & at(ptrdiff_t i) {
+			return items[static_cast<size_t>(i) & (capacity - 1)];
+		}
+	};
+
+	static ring * new_ring(size_t capacity, ring * previous) {
+		ring * r = tpie_new<ring>();
+		r->capacity = capacity;
+		r->items = tpie_new_array<boost::atomic<job *> >(capacity);
+		r->previous = previous;
+		return r;
+	}
+
+	static void delete_rings(ring * r) {
+		while (r != 0) {
+			ring * previous = r->previous;
+			tpie_delete_array(r->items, r->capacity);
+			tpie_delete(r);
+			r = previous;
+		}
+	}
+
+	ring * grow(ring * r, ptrdiff_t t, ptrdiff_t b) {
+		ring * g = new_ring(2 * r->capacity, r);
+		for (ptrdiff_t i = t; i < b; ++i)
+			g->at(i).store(r->at(i).load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		m_ring.store(g, boost::memory_order_release);
+		return g;
+	}
+
+	boost::atomic<ptrdiff_t> m_top;
+	boost::atomic<ptrdiff_t> m_bottom;
+	boost::atomic<ring *> m_ring;
+};
+
+void no_cleanup(job_deque *) {}
+
+} // unnamed namespace
+
 ///////////////////////////////////////////////////////////////////////////////
 /// Job manager singleton.
 ///////////////////////////////////////////////////////////////////////////////
@@ -40,15 +169,27 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Default constructor.
 	///////////////////////////////////////////////////////////////////////////
-	job_manager() : m_jobs(128), m_kill_job_pool(false) {}
+	job_manager()
+		: m_submitted(0)
+		, m_ownDeque(no_cleanup)
+		, m_sleepers(0)
+		, m_kill_job_pool(false)
+	{
+	}
+
+	~job_manager() {
+		for (size_t i = 0; i < m_deques.size(); ++i) tpie_delete(m_deques[i]);
+	}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Initialize the thread pool.
 	///////////////////////////////////////////////////////////////////////////
 	void init_pool(size_t threads) {
+		m_deques.resize(threads, 0);
+		for (size_t i = 0; i < threads; ++i) m_deques[i] = tpie_new<job_deque>();
 		m_thread_pool.resize(threads);
 		for (size_t i = 0; i < threads; ++i) {
-			boost::function<void()> f(worker);
+			boost::function<void()> f(boost::bind(&job_manager::worker, this, i));
 			boost::thread t(f);
 			// thread is move-constructible
 			m_thread_pool[i].swap(t);
@@ -59,9 +200,9 @@ public:
 	/// \brief Notify all waiting workers, wait for them to quit.
 	///////////////////////////////////////////////////////////////////////////
 	void shutdown_pool() {
-		boost::mutex::scoped_lock lock(jobs_mutex);
-		m_kill_job_pool = true;
-		m_has_data.notify_all();
+		boost::mutex::scoped_lock lock(m_sleep_mutex);
+		m_kill_job_pool.store(true);
+		m_wake.notify_all();
 		lock.unlock();
 		for (size_t i = 0; i < m_thread_pool.size(); ++i) {
 			m_thread_pool[i].join();
@@ -70,38 +211,155 @@ public:
 
 private:
 
-	tpie::internal_queue<tpie::job *> m_jobs;
-	tpie::array<boost::thread> m_thread_pool;
-
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief The only mutex we will ever need.
+	/// \brief Make an enqueued job available to the workers.
 	///////////////////////////////////////////////////////////////////////////
-	boost::mutex jobs_mutex;
+	void submit(job * j) {
+		job_deque * own = m_ownDeque.get();
+		if (own != 0) {
+			own->push(j);
+		} else {
+			job * head = m_submitted.load(boost::memory_order_relaxed);
+			do {
+				j->m_next = head;
+			} while (!m_submitted.compare_exchange_weak(head, j, boost::memory_order_release, boost::memory_order_relaxed));
+		}
+		boost::atomic_thread_fence(boost::memory_order_seq_cst);
+		if (m_sleepers.load(boost::memory_order_seq_cst) > 0) {
+			boost::mutex::scoped_lock lock(m_sleep_mutex);
+			m_wake.notify_one();
+		}
+	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Notified when a job is added to the queue.
+	/// \brief Wake threads waiting in join().
 	///////////////////////////////////////////////////////////////////////////
-	boost::condition_variable m_has_data;
+	void notify_done() {
+		if (m_sleepers.load(boost::memory_order_seq_cst) > 0) {
+			boost::mutex::scoped_lock lock(m_sleep_mutex);
+			m_wake.notify_all();
+		}
+	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief True when the workers should quit ASAP.
+	/// \brief Find a job to run, or return 0 if none was found.
 	///////////////////////////////////////////////////////////////////////////
-	bool m_kill_job_pool;
+	job * find_job() {
+		job_deque * own = m_ownDeque.get();
+		if (own != 0) {
+			job * j = own->pop();
+			if (j != 0) return j;
+		}
+
+		job * submitted = m_submitted.exchange(0, boost::memory_order_acquire);
+		if (submitted != 0) {
+			// The submitted jobs are in reverse order. Keep the oldest job
+			// and make the rest available again.
+			job * oldest = submitted;
+			job * newer = 0;
+			while (oldest->m_next != 0) {
+				job * next = oldest->m_next;
+				oldest->m_next = newer;
+				newer = oldest;
+				oldest = next;
+			}
+			// Push the rest oldest first, so that thieves take the oldest jobs.
+			// Read m_next before pushing, since a pushed job may be run and
+			// enqueued again by another thread.
+			while (newer != 0) {
+				job * next = newer->m_next;
+				if (own != 0) own->push(newer);
+				else submit(newer);
+				newer = next;
+			}
+			return oldest;
+		}
+
+		size_t n = m_deques.size();
+		size_t first = 0;
+		for (size_t i = 0; i < n; ++i) if (m_deques[i] == own) first = i + 1;
+		for (size_t i = 0; i < n; ++i) {
+			job_deque * victim = m_deques[(first + i) % n];
+			if (victim == own) continue;
+			job * j = victim->steal();
+			if (j != 0) return j;
+		}
+		return 0;
+	}
+
+	bool has_jobs() {
+		if (m_submitted.load(boost::memory_order_seq_cst) != 0) return true;
+		for (size_t i = 0; i < m_deques.size(); ++i)
+			if (!m_deques[i]->empty()) return true;
+		return false;
+	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Worker thread entry point.
+	/// \brief Run pending jobs until the given job is done, or until the
+	/// pool is shut down if joined is 0.
 	///////////////////////////////////////////////////////////////////////////
-	static void worker() {
+	void help(job * joined) {
 		for (;;) {
-			boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
-			while (the_job_manager->m_jobs.empty() && !the_job_manager->m_kill_job_pool) the_job_manager->m_has_data.wait(lock);
-			if (the_job_manager->m_kill_job_pool) break;
-			tpie::job * j = the_job_manager->m_jobs.front();
-			the_job_manager->m_jobs.pop();
-			lock.unlock();
-			j->run();
+			if (joined != 0 && joined->m_complete.load(boost::memory_order_acquire)) return;
+			job * j = find_job();
+			if (j != 0) {
+				j->run();
+				continue;
+			}
+			boost::mutex::scoped_lock lock(m_sleep_mutex);
+			m_sleepers.fetch_add(1, boost::memory_order_seq_cst);
+			bool stop = joined == 0 && m_kill_job_pool.load();
+			if (!stop && !has_jobs()
+				&& (joined == 0 || !joined->m_complete.load(boost::memory_order_seq_cst)))
+				m_wake.wait(lock);
+			m_sleepers.fetch_sub(1, boost::memory_order_seq_cst);
+			if (stop) return;
 		}
-	};
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Worker thread entry point.
+	///////////////////////////////////////////////////////////////////////////
+	void worker(size_t index) {
+		m_ownDeque.reset(m_deques[index]);
+		help(0);
+		m_ownDeque.reset();
+	}
+
+	tpie::array<job_deque *> m_deques;
+	tpie::array<boost::thread> m_thread_pool;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Jobs enqueued by threads that are not workers, newest first.
+	///////////////////////////////////////////////////////////////////////////
+	boost::atomic<job *> m_submitted;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The deque of the calling thread, if it is a worker.
+	///////////////////////////////////////////////////////////////////////////
+	boost::thread_specific_ptr<job_deque> m_ownDeque;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Protects sleeping on m_wake. Not used when all threads are
+	/// busy.
+	///////////////////////////////////////////////////////////////////////////
+	boost::mutex m_sleep_mutex;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Notified when a job is submitted or done while some thread is
+	/// sleeping.
+	///////////////////////////////////////////////////////////////////////////
+	boost::condition_variable m_wake;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of threads sleeping on m_wake.
+	///////////////////////////////////////////////////////////////////////////
+	boost::atomic<size_t> m_sleepers;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief True when the workers should quit ASAP.
+	///////////////////////////////////////////////////////////////////////////
+	boost::atomic<bool> m_kill_job_pool;
 
 	friend class tpie::job;
 };
@@ -128,39 +386,32 @@ job::job()
 	: m_dependencies(0)
 	, m_parent(0)
 	, m_state(job_idle)
+	, m_complete(true)
+	, m_next(0)
 {
 }
 
 void job::join() {
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
-	while (m_dependencies) {
-		m_done.wait(lock);
-	}
+	if (is_done()) return;
+	the_job_manager->help(this);
 }
 
 bool job::is_done() {
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
-	return !m_dependencies;
+	return m_complete.load(boost::memory_order_acquire);
 }
 
 void job::enqueue(job * parent) {
 	if (m_state != job_idle)
 		throw tpie::exception("Bad job state");
 
-	m_state = job_enqueued;
+	if (the_job_manager->m_kill_job_pool.load()) throw job_manager_exception();
 
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
-	if (the_job_manager->m_kill_job_pool) throw job_manager_exception();
+	m_state = job_enqueued;
 	m_parent = parent;
-	m_dependencies = 1;
-	if (m_parent) ++m_parent->m_dependencies;
-	if (the_job_manager->m_jobs.full()) {
-		lock.unlock();
-		run();
-		return;
-	}
-	the_job_manager->m_jobs.push(this);
-	the_job_manager->m_has_data.notify_one();
+	m_complete.store(false, boost::memory_order_relaxed);
+	m_dependencies.store(1, boost::memory_order_relaxed);
+	if (m_parent) m_parent->m_dependencies.fetch_add(1, boost::memory_order_relaxed);
+	the_job_manager->submit(this);
 }
 
 void job::run() {
@@ -170,7 +421,6 @@ void job::run() {
 	m_state = job_running;
 
 	(*this)();
-	boost::mutex::scoped_lock lock(the_job_manager->jobs_mutex);
 	done();
 }
 
@@ -178,15 +428,17 @@ void job::done() {
 	if (m_state != job_running)
 		throw tpie::exception("Bad job state");
 
-	--m_dependencies;
-	if (m_dependencies) return;
+	if (m_dependencies.fetch_sub(1, boost::memory_order_acq_rel) != 1) return;
 
 	m_state = job_idle;
 
-	if (m_parent) m_parent->done();
-	m_done.notify_all();
 	on_done();
+	// Once m_complete is set, a joining thread may destroy this job, and
+	// once the parent is done, it may destroy the parent and its subjobs.
+	job * parent = m_parent;
+	m_complete.store(true, boost::memory_order_seq_cst);
+	the_job_manager->notify_done();
+	if (parent) parent->done();
 }
 
 } // namespace tpie
-
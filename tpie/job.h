@@ -26,6 +26,7 @@
 
 #include <stddef.h>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 #include <tpie/types.h>
 
 namespace tpie {
@@ -53,6 +54,9 @@ public:
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Wait for this job and its subjobs to complete.
+	///
+	/// While waiting, the calling thread runs other pending jobs, so a job
+	/// may join its subjobs without tying up a worker thread.
 	///////////////////////////////////////////////////////////////////////////
 	void join();
 
@@ -64,6 +68,10 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Add this job to the job pool.
 	///
+	/// When called from a job, the job is pushed on the deque of the calling
+	/// worker thread, from which idle workers may steal it. Otherwise, it is
+	/// handed to the workers through a lock-free queue.
+	///
 	/// \param parent (optional) The parent job, or 0 if this is a root job.
 	///////////////////////////////////////////////////////////////////////////
 	void enqueue(job * parent = 0);
@@ -84,20 +92,29 @@ protected:
 
 private:
 
-	size_t m_dependencies;
+	boost::atomic<size_t> m_dependencies;
 	job * m_parent;
 	job_state m_state;
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief Notified when this job and subjobs are done.
+	/// \brief Set when this job and subjobs are done and the job may be
+	/// reused or destroyed.
+	///////////////////////////////////////////////////////////////////////////
+	boost::atomic<bool> m_complete;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Next job in the job manager's queue of submitted jobs.
 	///////////////////////////////////////////////////////////////////////////
-	boost::condition_variable m_done;
+	job * m_next;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Called when this job or a subjob is done.
 	///
 	/// Decrement m_dependencies and call on_done() and notify
 	/// waiters, if applicable.
+	///
+	/// The job is not accessed after m_complete is set, since a thread
+	/// waiting in join() may then destroy it. The parent is notified last.
 	///////////////////////////////////////////////////////////////////////////
 	void done();
 
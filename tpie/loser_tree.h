@@ -0,0 +1,228 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_LOSER_TREE_H__
+#define __TPIE_LOSER_TREE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file loser_tree.h
+/// \brief Tournament tree for merging a fixed number of sorted sources.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <tpie/array.h>
+#include <tpie/tpie_assert.h>
+#include <tpie/util.h>
+#include <algorithm>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \class loser_tree
+/// \brief Tree of losers over a fixed number of sources, each holding at most
+/// one item.
+///
+/// The tree is used to merge sorted sources: top() is the smallest current
+/// item and top_index() the source it came from. Replacing the smallest item
+/// by the next item of the same source with pop_and_push() replays a single
+/// leaf-to-root path, which costs exactly one comparison per level, i.e.
+/// ceil(log2(k)) comparisons for k sources, where a binary heap needs about
+/// twice as many. The internal nodes are stored in an implicit array layout
+/// with the children of node n at 2n and 2n+1, and source i at leaf k+i.
+///
+/// A source that has no item is exhausted and loses every comparison.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t = std::less<T> >
+class loser_tree : public linear_memory_base<loser_tree<T, pred_t> > {
+public:
+	typedef memory_size_type size_type;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Construct a tree with the given number of sources, all of which
+	/// are exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	loser_tree(size_type sources = 0, pred_t pred = pred_t())
+		: m_pred(pred)
+	{
+		resize(sources);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Change the number of sources and mark all of them exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	void resize(size_type sources) {
+		m_items.resize(sources);
+		m_tree.resize(sources);
+		m_exhausted.resize(sources, true);
+		m_size = 0;
+		m_winner = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Give a source its first item, possibly destroying ordering
+	/// information.
+	///
+	/// Call make_safe() once all sources have been given their first item.
+	///////////////////////////////////////////////////////////////////////////
+	void unsafe_set(size_type source, const T & item) {
+		tp_assert(source < m_items.size(), "Source out of bounds");
+		if (m_exhausted[source]) ++m_size;
+		m_items[source] = item;
+		m_exhausted[source] = false;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play the tournament after a sequence of calls to unsafe_set.
+	///////////////////////////////////////////////////////////////////////////
+	void make_safe() {
+		if (m_items.size() == 0) return;
+		m_winner = build(1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether all sources are exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	bool empty() const { return m_size == 0; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of sources that are not exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	size_type size() const { return m_size; }
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The smallest item.
+	///////////////////////////////////////////////////////////////////////////
+	const T & top() const {
+		tp_assert(!empty(), "top() on empty loser_tree");
+		return m_items[m_winner];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The source of the smallest item.
+	///////////////////////////////////////////////////////////////////////////
+	size_type top_index() const {
+		tp_assert(!empty(), "top_index() on empty loser_tree");
+		return m_winner;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The smallest item of the sources other than top_index().
+	///
+	/// Items of the winning source that do not exceed this item can be
+	/// output without replaying the tree.
+	/// \returns A pointer that is valid until the tree is changed, or 0 if all
+	/// other sources are exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	const T * runner_up() {
+		tp_assert(!empty(), "runner_up() on empty loser_tree");
+		// The runner-up lost directly to the winner, so it is on its path.
+		size_type best = m_winner;
+		for (size_type n = (m_winner + m_items.size()) / 2; n > 0; n /= 2) {
+			if (best == m_winner || wins(m_tree[n], best)) best = m_tree[n];
+		}
+		if (best == m_winner || m_exhausted[best]) return 0;
+		return &m_items[best];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Replace the smallest item by the next item of its source.
+	///////////////////////////////////////////////////////////////////////////
+	void pop_and_push(const T & item) {
+		tp_assert(!empty(), "pop_and_push() on empty loser_tree");
+		m_items[m_winner] = item;
+		replay(m_winner);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the smallest item and mark its source exhausted.
+	///////////////////////////////////////////////////////////////////////////
+	void pop() {
+		tp_assert(!empty(), "pop() on empty loser_tree");
+		m_exhausted[m_winner] = true;
+		--m_size;
+		replay(m_winner);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_coefficient()
+	/// \copydetails linear_memory_structure_doc::memory_coefficient()
+	///////////////////////////////////////////////////////////////////////////
+	static double memory_coefficient() {
+		return array<T>::memory_coefficient()
+			+ array<size_type>::memory_coefficient()
+			+ array<bool>::memory_coefficient();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \copybrief linear_memory_structure_doc::memory_overhead()
+	/// \copydetails linear_memory_structure_doc::memory_overhead()
+	///////////////////////////////////////////////////////////////////////////
+	static double memory_overhead() {
+		return sizeof(loser_tree)
+			+ array<T>::memory_overhead() - sizeof(array<T>)
+			+ array<size_type>::memory_overhead() - sizeof(array<size_type>)
+			+ array<bool>::memory_overhead() - sizeof(array<bool>);
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether the item of source a wins against the item of source b.
+	///////////////////////////////////////////////////////////////////////////
+	bool wins(size_type a, size_type b) {
+		if (m_exhausted[a]) return false;
+		if (m_exhausted[b]) return true;
+		return m_pred(m_items[a], m_items[b]);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play the subtree rooted at node n, storing the losers in the
+	/// internal nodes.
+	/// \returns The winner of the subtree.
+	///////////////////////////////////////////////////////////////////////////
+	size_type build(size_type n) {
+		const size_type k = m_items.size();
+		if (n >= k) return n - k;
+		size_type a = build(2*n);
+		size_type b = build(2*n+1);
+		if (wins(b, a)) std::swap(a, b);
+		m_tree[n] = b;
+		return a;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Play the path from the leaf of the given source to the root.
+	///////////////////////////////////////////////////////////////////////////
+	void replay(size_type source) {
+		size_type winner = source;
+		for (size_type n = (source + m_items.size()) / 2; n > 0; n /= 2) {
+			if (wins(m_tree[n], winner)) std::swap(m_tree[n], winner);
+		}
+		m_winner = winner;
+	}
+
+	array<T> m_items;
+	array<size_type> m_tree;
+	array<bool> m_exhausted;
+	size_type m_size;
+	size_type m_winner;
+	pred_t m_pred;
+};
+
+} // namespace tpie
+
+#endif // __TPIE_LOSER_TREE_H__
@@ -32,6 +32,7 @@
 
 // Includes needed from TPIE
 #include <tpie/mergeheap.h>     //For templated heaps
+#include <tpie/comparator.h>
 
 #include <tpie/progress_indicator_base.h>
 
@@ -134,9 +135,9 @@ namespace tpie {
 	
 	
 		///////////////////////////////////////////////////////////////////////////
-		/// Merging with a heap that contains the records to be merged. CMPR is
-		/// the class of the comparison object, and must contain the method
-		/// compare() which is called from within the merge.
+		/// Merging with a loser tree that contains the records to be merged.
+		/// CMPR is the class of the comparison object, and must contain the
+		/// method compare() which is called from within the merge.
 		///
 		/// This is one of the merge entry points for merging without the   
 		/// \ref merge_management_object used by TPIE's merge.
@@ -146,21 +147,21 @@ namespace tpie {
 		/// \internal \todo add comparison operator version
 		///////////////////////////////////////////////////////////////////////////
 		template <class T, class CMPR>
-		void merge_sorted(typename tpie::array<std::auto_ptr<file_stream<T> > >::iterator start,
-						 typename tpie::array<std::auto_ptr<file_stream<T> > >::iterator end,
+		void merge_sorted(typename tpie::array<tpie::auto_ptr<file_stream<T> > >::iterator start,
+						 typename tpie::array<tpie::auto_ptr<file_stream<T> > >::iterator end,
 						 file_stream<T> *outStream, CMPR *cmp) {
 	    
-			// make a merge heap which uses the user's comparison object
+			// make a loser tree which uses the user's comparison object
 			// and initialize it
-			merge_heap_obj<T,CMPR> mrgheap (cmp);
+			merge_loser_tree_op<T, TPIE2STL_cmp<T, CMPR> > mrgheap((TPIE2STL_cmp<T, CMPR>(cmp)));
 			mrgheap.allocate(end-start);
 	    
 			//Rewind all the input streams
-			for (typename tpie::array<std::auto_ptr<file_stream<T> > >::iterator i=start; 
+			for (typename tpie::array<tpie::auto_ptr<file_stream<T> > >::iterator i=start; 
 				 i != end; ++i)
-				i->seek(0); 
+				(*i)->seek(0); 
 	    
-			merge_sorted_runs(start, end, outStream, mrgheap);
+			merge_sorted_runs<T>(start, end, outStream, &mrgheap);
 		}
 
 	
@@ -33,6 +33,7 @@
 #include <tpie/portability.h>
 #include <tpie/memory.h>
 #include <tpie/internal_priority_queue.h>
+#include <tpie/loser_tree.h>
 
 namespace tpie {
 	namespace ami {
@@ -252,6 +253,81 @@ namespace tpie {
 				merge_heap_op<REC, Compare>(cmp) {}
 		};
 
+		///////////////////////////////////////////////////////////////////////////
+		/// A merge heap backed by a loser_tree, which replaces the minimum in
+		/// ceil(log2(k)) comparisons for k runs. It has the interface of
+		/// merge_heap_op and can be used as the merge heap of sort_manager
+		/// and merge_sorted_runs.
+		///////////////////////////////////////////////////////////////////////////
+		template<class REC, class comp_t=std::less<REC> >
+		class merge_loser_tree_op {
+		private:
+			loser_tree<REC, comp_t> tree;
+			
+		public:
+			merge_loser_tree_op(comp_t c=comp_t()): tree(0, c) {}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Reports the number of runs that are not exhausted.
+			///////////////////////////////////////////////////////////////////////////
+			size_t sizeofheap() {return tree.size();}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Returns the run with the minimum key.
+			///////////////////////////////////////////////////////////////////////////
+			inline size_t get_min_run_id() {return tree.top_index();}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Allocates space for the given number of runs.
+			///////////////////////////////////////////////////////////////////////////
+			void allocate(size_t size) {tree.resize(size);}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Copies the first element of the given run into the tree.
+			///////////////////////////////////////////////////////////////////////////
+			void insert(const REC *ptr, size_t run_id) {tree.unsafe_set(run_id, *ptr);}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Extracts minimum element and marks its run exhausted.
+			///////////////////////////////////////////////////////////////////////////
+			void extract_min(REC& el, size_t& run_id) {
+				el=tree.top();
+				run_id=tree.top_index();
+				tree.pop();
+			}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Deallocates the space used by the tree.
+			///////////////////////////////////////////////////////////////////////////
+			void deallocate() {tree.resize(0);}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Plays the tournament between the initial elements.
+			///////////////////////////////////////////////////////////////////////////
+			void initialize() {tree.make_safe();}
+			
+			///////////////////////////////////////////////////////////////////////////
+			// Deletes the current minimum and inserts the new item from the same
+			// source / run.
+			///////////////////////////////////////////////////////////////////////////
+			inline void delete_min_and_insert(const REC *nextelement_same_run) {
+				if (nextelement_same_run)
+					tree.pop_and_push(*nextelement_same_run);
+				else
+					tree.pop();
+			}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Returns the main memory space usage per item.
+			///////////////////////////////////////////////////////////////////////////
+			inline size_t space_per_item() {return static_cast<size_t>(tree.memory_coefficient());}
+			
+			///////////////////////////////////////////////////////////////////////////
+			/// Returns the fixed main memory space overhead, regardless of item count.
+			///////////////////////////////////////////////////////////////////////////
+			inline size_t space_overhead() {return static_cast<size_t>(tree.memory_overhead());}
+		};
+
 	}   //  ami namespace
 }  //  tpie namespace 
 
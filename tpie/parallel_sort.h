@@ -37,6 +37,7 @@
 #include <tpie/dummy_progress.h>
 #include <tpie/internal_queue.h>
 #include <tpie/job.h>
+#include <tpie/radix_sort.h>
 #include <tpie/config.h>
 
 namespace tpie {
@@ -260,15 +261,18 @@ public:
 		qsort_job * master = new qsort_job(a, b, comp, 0, progress);
 		master->enqueue();
 
-		boost::uint64_t prev_work_estimate = 0;
-		boost::mutex::scoped_lock lock(progress.mutex);
-		while (progress.work_estimate < progress.total_work_estimate) {
-			if (progress.pi && progress.work_estimate > prev_work_estimate) progress.pi->step(progress.work_estimate - prev_work_estimate);
-			prev_work_estimate = progress.work_estimate;
-			progress.cond.wait(lock);
+		if (progress.pi) {
+			boost::uint64_t prev_work_estimate = 0;
+			boost::mutex::scoped_lock lock(progress.mutex);
+			while (progress.work_estimate < progress.total_work_estimate) {
+				if (progress.work_estimate > prev_work_estimate) progress.pi->step(progress.work_estimate - prev_work_estimate);
+				prev_work_estimate = progress.work_estimate;
+				progress.cond.wait(lock);
+			}
 		}
-		lock.unlock();
 
+		// Without progress tracking, the calling thread helps sorting while
+		// it waits, so parallel_sort may be called from within a job.
 		master->join();
 		delete master;
 		if (progress.pi) progress.pi->done();
@@ -326,5 +330,50 @@ void parallel_sort(iterator_type a,
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sort items in the range [a,b) by radix on the keys given by the
+/// key extractor of the comparator.
+/// \param a Iterator to left boundary.
+/// \param b Iterator to right boundary.
+/// \param pi Progress tracker. No thread-safety required.
+/// \param comp Comparator.
+/// \sa radix_sort_impl
+///////////////////////////////////////////////////////////////////////////////
+template <bool Progress, typename iterator_type, typename key_extractor_t>
+void parallel_sort(iterator_type a,
+				   iterator_type b,
+				   typename tpie::progress_types<Progress>::base & pi,
+				   radix_less<key_extractor_t> comp) {
+	pi.init(1);
+	radix_sort_impl<iterator_type, key_extractor_t> s(comp.key());
+#ifdef TPIE_PARALLEL_SORT
+	s.parallel(a, b);
+#else
+	s(a, b);
+#endif
+	pi.step();
+	pi.done();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sort items in the range [a,b) by radix on the keys given by the
+/// key extractor of the comparator.
+/// \param a Iterator to left boundary.
+/// \param b Iterator to right boundary.
+/// \param comp Comparator.
+/// \sa radix_sort_impl
+///////////////////////////////////////////////////////////////////////////////
+template <typename iterator_type, typename key_extractor_t>
+void parallel_sort(iterator_type a,
+				   iterator_type b,
+				   radix_less<key_extractor_t> comp) {
+	radix_sort_impl<iterator_type, key_extractor_t> s(comp.key());
+#ifdef TPIE_PARALLEL_SORT
+	s.parallel(a, b);
+#else
+	s(a, b);
+#endif
+}
+
 }
 #endif //__TPIE_PARALLEL_SORT_H__
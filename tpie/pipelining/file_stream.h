@@ -31,22 +31,65 @@ namespace pipelining {
 
 namespace bits {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \class file_stream_node
+///
+/// Base class of nodes that read or write a file_stream. Reports the I/O done
+/// on the stream between begin() and end() as the I/O of the node.
+///////////////////////////////////////////////////////////////////////////////
+class file_stream_node : public node {
+public:
+	virtual void begin() override {
+		m_bytesReadBefore = m_stream.get_bytes_read();
+		m_bytesWrittenBefore = m_stream.get_bytes_written();
+	}
+
+	virtual void end() override {
+		add_bytes_read(since(m_stream.get_bytes_read(), m_bytesReadBefore));
+		add_bytes_written(since(m_stream.get_bytes_written(), m_bytesWrittenBefore));
+	}
+
+protected:
+	file_stream_node(const compressed_stream_base & fs)
+		: m_stream(fs)
+		, m_bytesReadBefore(0)
+		, m_bytesWrittenBefore(0)
+	{
+	}
+
+private:
+	// The counters start over if the stream is reopened.
+	static stream_size_type since(stream_size_type now, stream_size_type before) {
+		return now >= before ? now - before : now;
+	}
+
+	const compressed_stream_base & m_stream;
+	stream_size_type m_bytesReadBefore;
+	stream_size_type m_bytesWrittenBefore;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \class input_t
 ///
 /// file_stream input generator.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename dest_t>
-class input_t : public node {
+class input_t : public file_stream_node {
 public:
 	typedef typename push_type<dest_t>::type item_type;
 
-	inline input_t(const dest_t & dest, file_stream<item_type> & fs) : dest(dest), fs(fs) {
+	inline input_t(const dest_t & dest, file_stream<item_type> & fs)
+		: file_stream_node(fs), dest(dest), fs(fs) {
 		add_push_destination(dest);
 		set_name("Read", PRIORITY_INSIGNIFICANT);
 		set_minimum_memory(fs.memory_usage());
 	}
 
+	virtual void prepare() override {
+		// Let sorters predict their I/O when memory is assigned.
+		forward("items", fs.is_open() ? fs.size() : static_cast<stream_size_type>(0));
+	}
+
 	virtual void propagate() override {
 		if (fs.is_open()) {
 			forward("items", fs.size());
@@ -76,15 +119,19 @@ private:
 /// file_stream pull input generator.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T>
-class pull_input_t : public node {
+class pull_input_t : public file_stream_node {
 public:
 	typedef T item_type;
 
-	inline pull_input_t(file_stream<T> & fs) : fs(fs) {
+	inline pull_input_t(file_stream<T> & fs) : file_stream_node(fs), fs(fs) {
 		set_name("Read", PRIORITY_INSIGNIFICANT);
 		set_minimum_memory(fs.memory_usage());
 	}
 
+	virtual void prepare() override {
+		forward("items", fs.size());
+	}
+
 	virtual void propagate() override {
 		forward("items", fs.size());
 		set_steps(fs.size());
@@ -108,11 +155,11 @@ public:
 /// file_stream output terminator.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T>
-class output_t : public node {
+class output_t : public file_stream_node {
 public:
 	typedef T item_type;
 
-	inline output_t(file_stream<T> & fs) : fs(fs) {
+	inline output_t(file_stream<T> & fs) : file_stream_node(fs), fs(fs) {
 		set_name("Write", PRIORITY_INSIGNIFICANT);
 		set_minimum_memory(fs.memory_usage());
 	}
@@ -120,6 +167,11 @@ public:
 	inline void push(const T & item) {
 		fs.write(item);
 	}
+
+	template <typename IT>
+	inline void push(IT begin, IT end) {
+		fs.write(begin, end);
+	}
 private:
 	file_stream<T> & fs;
 };
@@ -130,11 +182,12 @@ private:
 /// file_stream output pull data source.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename source_t>
-class pull_output_t : public node {
+class pull_output_t : public file_stream_node {
 public:
 	typedef typename pull_type<source_t>::type item_type;
 
-	inline pull_output_t(const source_t & source, file_stream<item_type> & fs) : source(source), fs(fs) {
+	inline pull_output_t(const source_t & source, file_stream<item_type> & fs)
+		: file_stream_node(fs), source(source), fs(fs) {
 		add_pull_source(source);
 		set_name("Write", PRIORITY_INSIGNIFICANT);
 		set_minimum_memory(fs.memory_usage());
@@ -156,10 +209,10 @@ template <typename T>
 class tee_t {
 public:
 	template <typename dest_t>
-	class type: public node {
+	class type: public file_stream_node {
 	public:
 		typedef T item_type;
-		type(const dest_t & dest, file_stream<item_type> & fs): fs(fs), dest(dest) {
+		type(const dest_t & dest, file_stream<item_type> & fs): file_stream_node(fs), fs(fs), dest(dest) {
 			add_push_destination(dest);
 			set_minimum_memory(fs.memory_usage());
 		}
@@ -21,11 +21,15 @@
 #define __TPIE_PIPELINING_MERGE_SORTER_H__
 
 #include <tpie/compressed/stream.h>
+#include <tpie/tpie.h>
 #include <tpie/pipelining/sort_parameters.h>
 #include <tpie/pipelining/merger.h>
 #include <tpie/pipelining/exception.h>
 #include <tpie/dummy_progress.h>
 #include <tpie/array_view.h>
+#include <tpie/parallel_sort.h>
+#include <tpie/job.h>
+#include <tpie/atomic.h>
 
 namespace tpie {
 
@@ -143,6 +147,19 @@ private:
 /// of a single run, we are in "report internal" mode, meaning we do not write
 /// anything to disk. This causes phase 2 to be a no-op and phase 3 to be a
 /// simple array traversal.
+///
+/// If phase 1 has memory for it, the memory for items is split between two
+/// run buffers. When the current buffer is full, it is handed to a job that
+/// sorts it and writes it to a run file, while pushed items go to the other
+/// buffer. Until the first run is written, all the memory is used as a
+/// single buffer, so an input that fits in memory is still reported
+/// internally. Since two buffers double the number of runs, they are not
+/// used when the expected number of items shows that this costs an extra
+/// merge level.
+///
+/// With set_parallel_merge, the merges of each intermediate merge level in
+/// phase 2 are run as concurrent jobs that share the phase 2 memory. The
+/// final merge is done by a single merger.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T, bool UseProgress, typename pred_t = std::less<T> >
 class merge_sorter {
@@ -160,9 +177,19 @@ public:
 		, pred(pred)
 		, m_evacuated(false)
 		, m_finalMergeInitialized(false)
+		, m_parallelMerges(1)
+		, m_hasItemEstimate(false)
+		, m_itemEstimate(0)
+		, m_runFormationJob(this)
+		, m_runCompression(compression_normal)
 	{
 	}
 
+	inline ~merge_sorter() {
+		// If phase 1 was aborted, the job may still use our buffers.
+		m_runFormationJob.join();
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Enable setting run length and fanout manually (for testing
 	/// purposes).
@@ -170,10 +197,14 @@ public:
 	inline void set_parameters(memory_size_type runLength, memory_size_type fanout) {
 		tp_assert(m_state == stParameters, "Merge sorting already begun");
 		p.runLength = p.internalReportThreshold = runLength;
+		// Without a memory amount, the run length is taken to be all the
+		// memory for items, so only one run buffer is used.
+		p.runBuffers = 1;
 		p.fanout = p.finalFanout = fanout;
+		p.mergeJobs = m_parallelMerges;
 		m_parametersSet = true;
 		log_debug() << "Manually set merge sort run length and fanout\n";
-		log_debug() << "Run length =       " << p.runLength << " (uses memory " << (p.runLength*sizeof(T) + file_stream<T>::memory_usage()) << ")\n";
+		log_debug() << "Run length =       " << p.runLength << " (uses memory " << (p.runBuffers*p.runLength*sizeof(T) + file_stream<T>::memory_usage()) << ")\n";
 		log_debug() << "Fanout =           " << p.fanout << " (uses memory " << fanout_memory_usage(p.fanout) << ")" << std::endl;
 	}
 
@@ -195,6 +226,21 @@ public:
 		calculate_parameters(m1, m2, m3);
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Run up to the given number of merges at the same time in
+	/// phase 2.
+	///
+	/// The phase 2 memory is split between the merges, so each merge has a
+	/// smaller fanout, and more merge levels may be needed. This pays off
+	/// when merging is bound by CPU rather than I/O. Call this before the
+	/// available memory is set.
+	///////////////////////////////////////////////////////////////////////////
+	inline void set_parallel_merge(memory_size_type jobs) {
+		tp_assert(m_state == stParameters, "Merge sorting already begun");
+		m_parallelMerges = p.mergeJobs = std::max<memory_size_type>(jobs, 1);
+		maybe_calculate_parameters();
+	}
+
 private:
 	// set_phase_?_memory helper
 	inline void maybe_calculate_parameters() {
@@ -229,9 +275,17 @@ public:
 		tp_assert(m_state == stParameters, "Merge sorting already begun");
 		if (!m_parametersSet) throw merge_sort_not_ready();
 		log_debug() << "Start forming input runs" << std::endl;
-		m_currentRunItems.resize((size_t)p.runLength);
+		m_currentRunItems.resize((size_t)(p.runBuffers*p.runLength));
 		m_runFiles.resize(p.fanout*2);
+		// Compressed blocks have arbitrary sizes and offsets, so they cannot
+		// bypass the page cache; with direct I/O the runs are stored raw.
+		m_runCompression = compression_normal;
+		if (get_direct_io_temp_files()) {
+			log_debug() << "Direct I/O temp files: storing runs uncompressed" << std::endl;
+			m_runCompression = compression_none;
+		}
 		m_currentRunItemCount = 0;
+		m_backgroundRunItemCount = 0;
 		m_finishedRuns = 0;
 		m_state = stRunFormation;
 		m_itemCount = 0;
@@ -242,9 +296,19 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	inline void push(const T & item) {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
-		if (m_currentRunItemCount >= p.runLength) {
-			sort_current_run();
-			empty_current_run();
+		if (m_currentRunItemCount >= m_currentRunItems.size()) {
+			if (m_currentRunItems.size() > p.runLength) {
+				// The first buffer has room for all run buffers. Write it as
+				// several runs and continue with buffers of one run each.
+				sort_current_run();
+				empty_current_run();
+				m_currentRunItems.resize((size_t)p.runLength);
+			} else if (p.runBuffers > 1) {
+				start_background_run();
+			} else {
+				sort_current_run();
+				empty_current_run();
+			}
 		}
 		m_currentRunItems[m_currentRunItemCount] = item;
 		++m_currentRunItemCount;
@@ -256,6 +320,8 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	inline void end() {
 		tp_assert(m_state == stRunFormation, "Wrong phase");
+		finish_background_run();
+		m_backgroundRunItems.resize(0);
 		sort_current_run();
 
 		if (m_itemCount == 0) {
@@ -315,7 +381,8 @@ public:
 		if (m_reportInternal) {
 			log_debug() << "Evacuate merge_sorter (" << this << ") in internal reporting mode" << std::endl;
 			m_reportInternal = false;
-			memory_size_type runCount = (m_currentRunItemCount > 0) ? 1 : 0;
+			memory_size_type runCount = (m_currentRunItemCount > 0)
+				? (m_currentRunItemCount + p.runLength - 1) / p.runLength : 0;
 			empty_current_run();
 			m_currentRunItems.resize(0);
 			initialize_final_merger(0, runCount);
@@ -326,6 +393,7 @@ public:
 		}
 		log_debug() << "Evacuate merge_sorter (" << this << ") before reporting in external reporting mode" << std::endl;
 		m_merger.reset();
+		m_pullBuffer.resize(0);
 		m_evacuated = true;
 		m_runPositions.evacuate();
 	}
@@ -343,30 +411,133 @@ private:
 	// Phase 1 helpers.
 	///////////////////////////////////////////////////////////////////////////
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Job that remembers an exception thrown by run.
+	///
+	/// Exceptions cannot propagate out of a job, so they are rethrown by
+	/// rethrow in the thread that joins the job.
+	///////////////////////////////////////////////////////////////////////////
+	class sorter_job : public job {
+	public:
+		sorter_job()
+			: m_failed(false)
+		{
+		}
+
+		virtual void operator()() override {
+			try {
+				run();
+			} catch (const std::exception & e) {
+				m_failed = true;
+				m_error = e.what();
+			}
+		}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Throw an exception if run failed. Call after join.
+		///////////////////////////////////////////////////////////////////////
+		void rethrow(const std::string & what) {
+			if (!m_failed) return;
+			m_failed = false;
+			throw exception(what + ": " + m_error);
+		}
+
+	protected:
+		virtual void run() = 0;
+
+	private:
+		bool m_failed;
+		std::string m_error;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sorts and writes the background run buffer in phase 1.
+	///////////////////////////////////////////////////////////////////////////
+	class run_formation_job : public sorter_job {
+	public:
+		run_formation_job(merge_sorter * sorter)
+			: m_sorter(sorter)
+		{
+		}
+
+	protected:
+		virtual void run() override {
+			merge_sorter & s = *m_sorter;
+			s.sort_run(s.m_backgroundRunItems, s.m_backgroundRunItemCount);
+			s.write_run(s.m_backgroundRunItems.get(), s.m_backgroundRunItemCount);
+			s.m_backgroundRunItemCount = 0;
+		}
+
+	private:
+		merge_sorter * m_sorter;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Hand the full current run buffer to the run formation job and
+	/// continue in the other buffer.
+	/// postcondition: m_currentRunItemCount = 0
+	///////////////////////////////////////////////////////////////////////////
+	inline void start_background_run() {
+		finish_background_run();
+		if (m_backgroundRunItems.size() != m_currentRunItems.size())
+			m_backgroundRunItems.resize(m_currentRunItems.size());
+		m_currentRunItems.swap(m_backgroundRunItems);
+		m_backgroundRunItemCount = m_currentRunItemCount;
+		m_currentRunItemCount = 0;
+		m_runFormationJob.enqueue();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Wait for the run formation job to write its run.
+	///////////////////////////////////////////////////////////////////////////
+	inline void finish_background_run() {
+		m_runFormationJob.join();
+		m_runFormationJob.rethrow("Writing sorted run failed");
+	}
+
+	inline void sort_run(array<T> & items, memory_size_type count) {
+		parallel_sort(items.begin(), items.begin()+count, pred);
+	}
+
 	inline void sort_current_run() {
-		parallel_sort(m_currentRunItems.begin(), m_currentRunItems.begin()+m_currentRunItemCount, pred);
+		sort_run(m_currentRunItems, m_currentRunItemCount);
 	}
 
-	// postcondition: m_currentRunItemCount = 0
-	inline void empty_current_run() {
+	inline void write_run(const T * items, memory_size_type count) {
 		if (m_finishedRuns < 10)
-			log_debug() << "Write " << m_currentRunItemCount << " items to run file " << m_finishedRuns << std::endl;
+			log_debug() << "Write " << count << " items to run file " << m_finishedRuns << std::endl;
 		else if (m_finishedRuns == 10)
 			log_debug() << "..." << std::endl;
 		file_stream<T> fs;
 		open_run_file_write(fs, 0, m_finishedRuns);
-		for (memory_size_type i = 0; i < m_currentRunItemCount; ++i) {
-			fs.write(m_currentRunItems[i]);
-		}
-		m_currentRunItemCount = 0;
+		fs.write(items, items+count);
+		fs.close();
+		m_bytesWritten.add(fs.get_bytes_written());
 		++m_finishedRuns;
 	}
 
+	// Write the sorted current buffer as runs of p.runLength items; the
+	// first buffer and an internally reported buffer may hold more than one.
+	// postcondition: m_currentRunItemCount = 0
+	inline void empty_current_run() {
+		memory_size_type written = 0;
+		do {
+			memory_size_type count = std::min(p.runLength, m_currentRunItemCount - written);
+			write_run(m_currentRunItems.get() + written, count);
+			written += count;
+		} while (written < m_currentRunItemCount);
+		m_currentRunItemCount = 0;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// Prepare m_merger for merging the runNumber'th to the
 	/// (runNumber+runCount)'th run in mergeLevel.
 	///////////////////////////////////////////////////////////////////////////
 	inline void initialize_merger(memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount) {
+		initialize_merger(m_merger, mergeLevel, runNumber, runCount);
+	}
+
+	inline void initialize_merger(merger<T, pred_t> & m, memory_size_type mergeLevel, memory_size_type runNumber, memory_size_type runCount) {
 		// runCount is a memory_size_type since we must be able to have that
 		// many file_streams open at the same time.
 
@@ -377,7 +548,7 @@ private:
 		}
 		stream_size_type runLength = calculate_run_length(p.runLength, p.fanout, mergeLevel);
 		// Pass file streams with correct stream offsets to the merger
-		m_merger.reset(in, runLength);
+		m.reset(in, runLength);
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -453,13 +624,99 @@ private:
 		file_stream<T> out;
 		memory_size_type nextRunNumber = runNumber/p.fanout;
 		open_run_file_write(out, mergeLevel+1, nextRunNumber);
+		m_pullBuffer.resize(pull_buffer_items());
 		while (m_merger.can_pull()) {
-			pi.step();
-			out.write(m_merger.pull());
+			memory_size_type n = m_merger.pull(m_pullBuffer.get(), m_pullBuffer.size());
+			pi.step(n);
+			out.write(m_pullBuffer.begin(), m_pullBuffer.begin()+n);
 		}
+		out.close();
+		m_bytesWritten.add(out.get_bytes_written());
 		return nextRunNumber;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Merges runs into an output stream in phase 2.
+	///////////////////////////////////////////////////////////////////////////
+	class merge_job : public sorter_job {
+	public:
+		merge_job(pred_t pred)
+			: m_merger(pred)
+			, m_items(0)
+		{
+		}
+
+		merger<T, pred_t> & get_merger() {return m_merger;}
+		file_stream<T> & get_output() {return m_out;}
+
+		///////////////////////////////////////////////////////////////////////
+		/// \brief Number of items merged since the last call.
+		///////////////////////////////////////////////////////////////////////
+		stream_size_type take_items() {
+			stream_size_type items = m_items;
+			m_items = 0;
+			return items;
+		}
+
+	protected:
+		virtual void run() override {
+			m_buffer.resize(pull_buffer_items());
+			while (m_merger.can_pull()) {
+				memory_size_type n = m_merger.pull(m_buffer.get(), m_buffer.size());
+				m_out.write(m_buffer.begin(), m_buffer.begin()+n);
+				m_items += n;
+			}
+			m_buffer.resize(0);
+			m_out.close();
+		}
+
+	private:
+		merger<T, pred_t> m_merger;
+		file_stream<T> m_out;
+		array<T> m_buffer;
+		stream_size_type m_items;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Merge the runCount runs in mergeLevel into mergeLevel+1 using up to
+	/// p.mergeJobs concurrent merge jobs.
+	///////////////////////////////////////////////////////////////////////////
+	template <typename ProgressIndicator>
+	inline void merge_level_parallel(memory_size_type mergeLevel, memory_size_type runCount, ProgressIndicator & pi) {
+		memory_size_type groups = (runCount + p.fanout - 1) / p.fanout;
+		// The output runs of concurrent jobs must go to different run
+		// files, so at most fanout jobs run at a time.
+		memory_size_type jobCount = std::min(std::min(p.mergeJobs, groups), p.fanout);
+		array<tpie::auto_ptr<merge_job> > jobs(jobCount);
+		for (memory_size_type j = 0; j < jobCount; ++j)
+			jobs[j].reset(tpie_new<merge_job>(pred));
+
+		for (memory_size_type g = 0; g < groups; g += jobCount) {
+			memory_size_type batch = std::min(jobCount, groups - g);
+			if (g/jobCount < 10)
+				log_debug() << "Merge " << batch << " groups of runs starting from #" << g*p.fanout << " in parallel" << std::endl;
+			else if (g/jobCount == 10)
+				log_debug() << "..." << std::endl;
+			// Run positions are only touched by this thread, in the order
+			// of the output run numbers.
+			for (memory_size_type j = 0; j < batch; ++j) {
+				memory_size_type runNumber = (g+j)*p.fanout;
+				memory_size_type n = std::min(runCount-runNumber, p.fanout);
+				initialize_merger(jobs[j]->get_merger(), mergeLevel, runNumber, n);
+				open_run_file_write(jobs[j]->get_output(), mergeLevel+1, g+j);
+				jobs[j]->enqueue();
+			}
+			for (memory_size_type j = 0; j < batch; ++j) {
+				jobs[j]->join();
+				jobs[j]->rethrow("Merging runs failed");
+				pi.step(jobs[j]->take_items());
+				m_bytesWritten.add(jobs[j]->get_output().get_bytes_written());
+			}
+		}
+		for (memory_size_type j = 0; j < jobCount; ++j)
+			m_bytesRead.add(jobs[j]->get_merger().get_bytes_read());
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// Phase 2: Merge all runs and initialize merger for public pulling.
 	///////////////////////////////////////////////////////////////////////////
@@ -477,16 +734,21 @@ private:
 			log_debug() << "Merge " << runCount << " runs in merge level " << mergeLevel << '\n';
 			m_runPositions.next_level();
 			memory_size_type newRunCount = 0;
-			for (memory_size_type i = 0; i < runCount; i += p.fanout) {
-				memory_size_type n = std::min(runCount-i, p.fanout);
+			if (p.mergeJobs > 1) {
+				merge_level_parallel(mergeLevel, runCount, pi);
+				newRunCount = (runCount + p.fanout - 1) / p.fanout;
+			} else {
+				for (memory_size_type i = 0; i < runCount; i += p.fanout) {
+					memory_size_type n = std::min(runCount-i, p.fanout);
 
-				if (newRunCount < 10)
-					log_debug() << "Merge " << n << " runs starting from #" << i << std::endl;
-				else if (newRunCount == 10)
-					log_debug() << "..." << std::endl;
+					if (newRunCount < 10)
+						log_debug() << "Merge " << n << " runs starting from #" << i << std::endl;
+					else if (newRunCount == 10)
+						log_debug() << "..." << std::endl;
 
-				merge_runs(mergeLevel, i, n, pi);
-				++newRunCount;
+					merge_runs(mergeLevel, i, n, pi);
+					++newRunCount;
+				}
 			}
 			++mergeLevel;
 			runCount = newRunCount;
@@ -505,10 +767,16 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	inline bool can_pull() {
 		tp_assert(m_state == stReport, "Wrong phase");
-		if (m_reportInternal) return m_itemsPulled < m_currentRunItemCount;
-		else {
+		if (m_reportInternal) {
+			if (m_itemsPulled < m_currentRunItemCount) return true;
+			// The last items may have been returned by pull_block.
+			m_currentRunItems.resize(0);
+			return false;
+		} else {
 			if (m_evacuated) reinitialize_final_merger();
-			return m_merger.can_pull();
+			if (m_merger.can_pull()) return true;
+			m_pullBuffer.resize(0);
+			return false;
 		}
 	}
 
@@ -528,12 +796,57 @@ public:
 		}
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// In phase 3, fetch the next items in the final merge phase.
+	///
+	/// In internal reporting mode, this returns all remaining items without
+	/// copying them. Otherwise, the merger fills a buffer of
+	/// pull_buffer_items() items.
+	/// \returns A view of at least one item that is valid until the next
+	/// call to can_pull, pull or pull_block.
+	///////////////////////////////////////////////////////////////////////////
+	inline array_view<const T> pull_block() {
+		tp_assert(m_state == stReport, "Wrong phase");
+		if (m_reportInternal) {
+			tp_assert(m_itemsPulled < m_currentRunItemCount, "pull_block() while !can_pull()");
+			array_view<const T> items(m_currentRunItems.get() + m_itemsPulled, m_currentRunItemCount - m_itemsPulled);
+			m_itemsPulled = m_currentRunItemCount;
+			return items;
+		} else {
+			if (m_evacuated) reinitialize_final_merger();
+			m_runPositions.close();
+			if (m_pullBuffer.size() == 0) m_pullBuffer.resize(pull_buffer_items());
+			memory_size_type n = m_merger.pull(m_pullBuffer.get(), m_pullBuffer.size());
+			return array_view<const T>(m_pullBuffer.get(), n);
+		}
+	}
+
 	inline stream_size_type item_count() {
 		return m_itemCount;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes read from run files so far.
+	///
+	/// Only complete between phases, since runs may be read by other threads
+	/// during a phase.
+	///////////////////////////////////////////////////////////////////////////
+	inline stream_size_type get_bytes_read() const {
+		return m_bytesRead.fetch() + m_merger.get_bytes_read();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes written to run files so far.
+	///
+	/// Only complete between phases, since runs may be written by other
+	/// threads during a phase.
+	///////////////////////////////////////////////////////////////////////////
+	inline stream_size_type get_bytes_written() const {
+		return m_bytesWritten.fetch();
+	}
+
 	static memory_size_type memory_usage_phase_1(const sort_parameters & params) {
-		return params.runLength * sizeof(T)
+		return params.runBuffers * params.runLength * sizeof(T)
 			+ bits::run_positions::memory_usage()
 			+ file_stream<T>::memory_usage()
 			+ 2*params.fanout*sizeof(temp_file);
@@ -549,12 +862,13 @@ public:
 		// longer than 1, which is probably what the user wants anyway.
 		sort_parameters p((sort_parameters()));
 		p.runLength = 1;
+		p.runBuffers = 1;
 		p.fanout = calculate_fanout(std::numeric_limits<memory_size_type>::max());
 		return memory_usage_phase_1(p);
 	}
 
 	static memory_size_type memory_usage_phase_2(const sort_parameters & params) {
-		return fanout_memory_usage(params.fanout);
+		return params.mergeJobs * fanout_memory_usage(params.fanout);
 	}
 
 	static memory_size_type minimum_memory_phase_2() {
@@ -597,8 +911,12 @@ private:
 		// Phase 2 (merge):
 		// Run length: unbounded
 		// Fanout: determined by the size of our merge heap and the stream memory usage.
+		// With parallel merging, each merge job gets an equal share.
 		log_debug() << "Phase 2: " << p.memoryPhase2 << " b available memory\n";
-		p.fanout = calculate_fanout(p.memoryPhase2);
+		p.mergeJobs = m_parallelMerges;
+		while (p.mergeJobs > 1 && p.mergeJobs * fanout_memory_usage(calculate_fanout(0)) > p.memoryPhase2)
+			--p.mergeJobs;
+		p.fanout = calculate_fanout(p.memoryPhase2 / p.mergeJobs);
 		if (fanout_memory_usage(p.fanout) > p.memoryPhase2) {
 			log_debug() << "Not enough memory for fanout " << p.fanout << "! (" << p.memoryPhase2 << " < " << fanout_memory_usage(p.fanout) << ")\n";
 			p.memoryPhase2 = fanout_memory_usage(p.fanout);
@@ -620,25 +938,25 @@ private:
 
 		// Phase 1 (run formation):
 		// Run length: determined by the number of items we can hold in memory.
+		// If there is room for two minimal runs and the input spans more than
+		// one run, the memory is split between the buffer being filled and the
+		// buffer being written.
 		// Fanout: unbounded
 
 		memory_size_type streamMemory = file_stream<T>::memory_usage();
 		memory_size_type tempFileMemory = 2*p.fanout*sizeof(temp_file);
 
 		log_debug() << "Phase 1: " << p.memoryPhase1 << " b available memory; " << streamMemory << " b for a single stream; " << tempFileMemory << " b for temp_files\n";
-		memory_size_type min_m1 = 128*1024 / sizeof(T) + bits::run_positions::memory_usage() + streamMemory + tempFileMemory;
+		memory_size_type min_m1 = minimum_phase_1_memory(p.fanout);
 		if (p.memoryPhase1 < min_m1) {
 			log_warning() << "Not enough phase 1 memory for 128 KB items and an open stream! (" << p.memoryPhase1 << " < " << min_m1 << ")\n";
 			p.memoryPhase1 = min_m1;
 		}
-		p.runLength = (p.memoryPhase1 - bits::run_positions::memory_usage() - streamMemory - tempFileMemory)/sizeof(T);
+		calculate_run_buffers(p.memoryPhase1, p.fanout,
+							  m_hasItemEstimate ? m_itemEstimate : unknown_items(),
+							  p.runBuffers, p.runLength);
 
-		p.internalReportThreshold = (std::min(p.memoryPhase1,
-											  std::min(p.memoryPhase2,
-													   p.memoryPhase3))
-									 - tempFileMemory)/sizeof(T);
-		if (p.internalReportThreshold > p.runLength)
-			p.internalReportThreshold = p.runLength;
+		p.internalReportThreshold = internal_report_threshold(m1, m2, m3, p.fanout, p.runBuffers*p.runLength);
 
 		m_parametersSet = true;
 
@@ -684,11 +1002,96 @@ private:
 		return fanout_lo;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_parameters helper: The phase 1 memory that is not used for
+	/// run buffers.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type phase_1_fixed_memory(memory_size_type fanout) {
+		return bits::run_positions::memory_usage()
+			+ file_stream<T>::memory_usage()
+			+ 2*fanout*sizeof(temp_file); // m_runFiles
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_parameters helper
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type minimum_phase_1_memory(memory_size_type fanout) {
+		return 128*1024 / sizeof(T) + phase_1_fixed_memory(fanout);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_run_buffers argument when the number of items is not known.
+	///////////////////////////////////////////////////////////////////////////
+	static inline stream_size_type unknown_items() {
+		return std::numeric_limits<stream_size_type>::max();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_run_buffers helper: The number of merge levels in phase 2.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type merge_levels(stream_size_type runs, memory_size_type fanout) {
+		memory_size_type levels = 0;
+		while (runs > fanout) {
+			runs = (runs + fanout - 1) / fanout;
+			++levels;
+		}
+		return levels;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_parameters and predict_io helper: The number of run buffers
+	/// and the run length with the given phase 1 memory, raised to the
+	/// minimum if needed. Two buffers are used when each can hold a minimal
+	/// run of 128 KB, and the given number of items spans more than one run
+	/// without needing another merge level for the shorter runs.
+	///////////////////////////////////////////////////////////////////////////
+	static inline void calculate_run_buffers(memory_size_type m1, memory_size_type fanout,
+	                                         stream_size_type items,
+	                                         memory_size_type & runBuffers, memory_size_type & runLength) {
+		const memory_size_type minimumRunBytes = 128*1024;
+		memory_size_type runMemory = std::max(m1, minimum_phase_1_memory(fanout))
+			- phase_1_fixed_memory(fanout);
+		memory_size_type singleRunLength = runMemory / sizeof(T);
+		memory_size_type doubleRunLength = runMemory / (2*sizeof(T));
+		bool doubleBuffer = runMemory >= 2*minimumRunBytes && items > singleRunLength;
+		if (doubleBuffer && items != unknown_items()) {
+			doubleBuffer =
+				merge_levels((items + doubleRunLength - 1) / doubleRunLength, fanout)
+				== merge_levels((items + singleRunLength - 1) / singleRunLength, fanout);
+		}
+		runBuffers = doubleBuffer ? 2 : 1;
+		runLength = doubleBuffer ? doubleRunLength : singleRunLength;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// calculate_parameters and predict_io helper: The largest number of
+	/// items that are reported internally without writing any runs.
+	///
+	/// Reporting internally keeps the run buffer through phases 2 and 3, so
+	/// it must fit in the memory actually given to every phase, and not in
+	/// the amounts raised to fit the minimum fanout.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type internal_report_threshold(memory_size_type m1, memory_size_type m2,
+	                                                         memory_size_type m3, memory_size_type fanout,
+	                                                         memory_size_type runItems) {
+		memory_size_type m = std::min(m1, std::min(m2, m3));
+		memory_size_type tempFileMemory = 2*fanout*sizeof(temp_file);
+		return std::min(runItems, (m - std::min(tempFileMemory, m))/sizeof(T));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of items merged at a time in phases 2 and 3.
+	///////////////////////////////////////////////////////////////////////////
+	static inline memory_size_type pull_buffer_items() {
+		return std::max<memory_size_type>(1, 64*1024 / sizeof(T));
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// calculate_parameters helper
 	///////////////////////////////////////////////////////////////////////////
 	static inline memory_size_type fanout_memory_usage(memory_size_type fanout) {
 		return merger<T, pred_t>::memory_usage(fanout) // accounts for the `fanout' open streams
+			+ static_cast<memory_size_type>(array<T>::memory_usage(pull_buffer_items())) // m_pullBuffer
 			+ bits::run_positions::memory_usage()
 			+ file_stream<T>::memory_usage() // output stream
 			+ 2*sizeof(temp_file); // merge_sorter::m_runFiles
@@ -709,6 +1112,12 @@ public:
 		if (m_state != stParameters)
 			throw exception("Wrong state in set_items: state is not stParameters");
 
+		if (p.runBuffers > 1) {
+			calculate_run_buffers(p.memoryPhase1, p.fanout, n, p.runBuffers, p.runLength);
+			if (p.runBuffers == 1)
+				log_debug() << "Using a single run buffer for " << n << " items" << std::endl;
+		}
+
 		if (n < p.runLength) {
 			log_debug() << "Decreasing run length from " << p.runLength
 				<< " to " << n << std::endl;
@@ -717,8 +1126,8 @@ public:
 			p.runLength = static_cast<memory_size_type>(n);
 
 			// Mirror the restriction from calculate_parameters.
-			if (p.internalReportThreshold > p.runLength)
-				p.internalReportThreshold = p.runLength;
+			if (p.internalReportThreshold > p.runBuffers*p.runLength)
+				p.internalReportThreshold = p.runBuffers*p.runLength;
 
 			log_debug() << "New merge sort parameters\n";
 			p.dump(log_debug());
@@ -726,7 +1135,91 @@ public:
 		}
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the expected number of items pushed.
+	///
+	/// Unlike set_items, this may be called before the parameters are set.
+	/// It is only used to predict the I/O of the sort.
+	///////////////////////////////////////////////////////////////////////////
+	void set_item_estimate(stream_size_type n) {
+		m_hasItemEstimate = true;
+		m_itemEstimate = n;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predict the number of bytes read and written by the sort with
+	/// the given phase 1 memory.
+	///
+	/// The other phases are assumed to get the memory that has already been
+	/// set for them, or else the same amount as phase 1.
+	/// \returns Zero if no item estimate has been set.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type predict_io_phase_1(memory_size_type m1) const {
+		return predict_io(m1, memory_or(p.memoryPhase2, m1), memory_or(p.memoryPhase3, m1));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predict the number of bytes read and written by the sort with
+	/// the given phase 2 memory.
+	/// \sa predict_io_phase_1
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type predict_io_phase_2(memory_size_type m2) const {
+		return predict_io(memory_or(p.memoryPhase1, m2), m2, memory_or(p.memoryPhase3, m2));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predict the number of bytes read and written by the sort with
+	/// the given phase 3 memory.
+	/// \sa predict_io_phase_1
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type predict_io_phase_3(memory_size_type m3) const {
+		return predict_io(memory_or(p.memoryPhase1, m3), memory_or(p.memoryPhase2, m3), m3);
+	}
+
 private:
+	///////////////////////////////////////////////////////////////////////////
+	/// predict_io_phase_? helper
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type memory_or(memory_size_type m, memory_size_type otherwise) {
+		return m > 0 ? m : otherwise;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predict the I/O of the sort from the parameters that
+	/// calculate_parameters would choose for the given memory.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type predict_io(memory_size_type m1, memory_size_type m2, memory_size_type m3) const {
+		if (!m_hasItemEstimate) return 0;
+
+		memory_size_type mergeJobs = m_parallelMerges;
+		while (mergeJobs > 1 && mergeJobs * fanout_memory_usage(calculate_fanout(0)) > m2)
+			--mergeJobs;
+		memory_size_type fanout = calculate_fanout(m2 / mergeJobs);
+		memory_size_type finalFanout = std::min(calculate_fanout(m3), fanout);
+
+		memory_size_type runBuffers;
+		memory_size_type runLength;
+		calculate_run_buffers(m1, fanout, m_itemEstimate, runBuffers, runLength);
+
+		stream_size_type internalReportThreshold =
+			internal_report_threshold(m1, m2, m3, fanout, runBuffers*runLength);
+		if (m_itemEstimate <= internalReportThreshold) return 0;
+
+		const stream_size_type bytes = m_itemEstimate * sizeof(T);
+		stream_size_type runs = (m_itemEstimate + runLength - 1) / runLength;
+		// The runs are written in phase 1 and read by the final merge.
+		stream_size_type io = 2*bytes;
+		// Each merge level of phase 2 reads and writes every item.
+		while (runs > fanout) {
+			runs = (runs + fanout - 1) / fanout;
+			io += 2*bytes;
+		}
+		// Phase 3 first merges the runs that do not fit in the final fanout.
+		if (runs > finalFanout)
+			io += 2*(bytes / runs)*(runs - finalFanout + 1);
+		return io;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Figure out the index in m_runFiles of the given run.
 	/// \param mergeLevel  Distance from leaves of merge tree.
@@ -747,7 +1240,7 @@ private:
 
 		memory_size_type idx = run_file_index(mergeLevel, runNumber);
 		if (runNumber < p.fanout) m_runFiles[idx].free();
-		fs.open(m_runFiles[idx], access_read_write, 0, access_sequential, compression_normal);
+		fs.open(m_runFiles[idx], access_read_write, 0, access_sequential, m_runCompression);
 		fs.seek(0, file_stream_base::end);
 		m_runPositions.set_position(mergeLevel, runNumber, fs.get_position());
 	}
@@ -759,7 +1252,7 @@ private:
 		// see run_file_index comment about runNumber
 
 		memory_size_type idx = run_file_index(mergeLevel, runNumber);
-		fs.open(m_runFiles[idx], access_read, 0, access_sequential, compression_normal);
+		fs.open(m_runFiles[idx], access_read, 0, access_sequential, m_runCompression);
 		fs.set_position(m_runPositions.get_position(mergeLevel, runNumber));
 	}
 
@@ -793,6 +1286,16 @@ private:
 	// Used to index into m_currentRunItems, so memory_size_type.
 	memory_size_type m_currentRunItemCount;
 
+	// Run buffer being sorted and written by m_runFormationJob.
+	// Size 0 until the first run is full, or if p.runBuffers is 1.
+	array<T> m_backgroundRunItems;
+
+	// Number of items in the background run buffer.
+	memory_size_type m_backgroundRunItemCount;
+
+	// Output of m_merger in phases 2 and 3; see pull_block.
+	array<T> m_pullBuffer;
+
 	bool m_reportInternal;
 
 	// When doing internal reporting: the number of items already reported
@@ -808,6 +1311,23 @@ private:
 	memory_size_type m_finalMergeLevel;
 	memory_size_type m_finalRunCount;
 	memory_size_type m_finalMergeSpecialRunNumber;
+
+	// Requested number of concurrent merges; see set_parallel_merge.
+	memory_size_type m_parallelMerges;
+
+	// Expected number of items; see set_item_estimate.
+	bool m_hasItemEstimate;
+	stream_size_type m_itemEstimate;
+
+	// I/O of run files that have been closed and of finished merge jobs.
+	// Written to by the run formation job as well.
+	atomic_stream_size_type m_bytesRead;
+	atomic_stream_size_type m_bytesWritten;
+
+	run_formation_job m_runFormationJob;
+
+	// Compression of the run files, chosen when run formation begins.
+	compression_flags m_runCompression;
 };
 
 } // namespace tpie
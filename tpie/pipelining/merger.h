@@ -20,34 +20,39 @@
 #ifndef __TPIE_PIPELINING_MERGER_H__
 #define __TPIE_PIPELINING_MERGER_H__
 
-#include <tpie/internal_priority_queue.h>
+#include <tpie/loser_tree.h>
 #include <tpie/compressed/stream.h>
 #include <tpie/file_stream.h>
 #include <tpie/tpie_assert.h>
 
 namespace tpie {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Merges sorted runs using a loser_tree, which takes one comparison
+/// per level of the tree to replace the smallest item.
+///////////////////////////////////////////////////////////////////////////////
 template <typename T, typename pred_t>
 class merger {
 public:
 	inline merger(pred_t pred)
-		: pq(0, predwrap(pred))
+		: tree(0, pred)
+		, pred(pred)
+		, bytesRead(0)
 	{
 	}
 
 	inline bool can_pull() {
-		return !pq.empty();
+		return !tree.empty();
 	}
 
 	inline T pull() {
 		tp_assert(can_pull(), "pull() while !can_pull()");
-		T el = pq.top().first;
-		size_t i = pq.top().second;
-		if (in[i].can_read() && itemsRead[i] < runLength) {
-			pq.pop_and_push(std::make_pair(in[i].read(), i));
-			++itemsRead[i];
+		T el = tree.top();
+		size_t i = tree.top_index();
+		if (can_read(i)) {
+			tree.pop_and_push(read(i));
 		} else {
-			pq.pop();
+			tree.pop();
 		}
 		if (!can_pull()) {
 			reset();
@@ -55,9 +60,57 @@ public:
 		return el;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Fetch up to count items into dest.
+	///
+	/// When an input wins twice in a row, its following items are copied
+	/// while they do not exceed the smallest item of the other inputs, at
+	/// the cost of one comparison per item instead of a replay of the tree.
+	/// \returns The number of items fetched, which is less than count only
+	/// if the merger runs out of items.
+	///////////////////////////////////////////////////////////////////////////
+	inline memory_size_type pull(T * dest, memory_size_type count) {
+		memory_size_type n = 0;
+		size_t last = in.size();
+		while (n < count && can_pull()) {
+			size_t i = tree.top_index();
+			dest[n++] = tree.top();
+			if (!can_read(i)) {
+				tree.pop();
+				last = in.size();
+				continue;
+			}
+			T item = read(i);
+			bool pending = true;
+			if (i == last) {
+				const T * bound = tree.runner_up();
+				while (n < count && (bound == 0 || !pred(*bound, item))) {
+					dest[n++] = item;
+					if (!can_read(i)) {
+						pending = false;
+						break;
+					}
+					item = read(i);
+				}
+			}
+			if (pending) {
+				tree.pop_and_push(item);
+				last = i;
+			} else {
+				tree.pop();
+				last = in.size();
+			}
+		}
+		if (!can_pull()) {
+			reset();
+		}
+		return n;
+	}
+
 	inline void reset() {
+		for (size_t i = 0; i < in.size(); ++i) bytesRead += in[i].get_bytes_read();
 		in.resize(0);
-		pq.resize(0);
+		tree.resize(0);
 		itemsRead.resize(0);
 	}
 
@@ -68,20 +121,30 @@ public:
 	// Precondition: !can_pull()
 	void reset(array<file_stream<T> > & inputs, stream_size_type runLength) {
 		this->runLength = runLength;
-		tp_assert(pq.empty(), "Reset before we are done");
+		tp_assert(tree.empty(), "Reset before we are done");
 		in.swap(inputs);
-		pq.resize(in.size());
+		tree.resize(in.size());
 		for (size_t i = 0; i < in.size(); ++i) {
-			pq.unsafe_push(std::make_pair(in[i].read(), i));
+			tree.unsafe_set(i, in[i].read());
 		}
-		pq.make_safe();
+		tree.make_safe();
 		itemsRead.resize(in.size(), 1);
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of bytes read from the input runs since the merger was
+	/// constructed.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const {
+		stream_size_type bytes = bytesRead;
+		for (size_t i = 0; i < in.size(); ++i) bytes += in[i].get_bytes_read();
+		return bytes;
+	}
+
 	inline static memory_size_type memory_usage(memory_size_type fanout) {
 		return sizeof(merger)
-			- sizeof(internal_priority_queue<std::pair<T, size_t>, predwrap>) // pq
-			+ static_cast<memory_size_type>(internal_priority_queue<std::pair<T, size_t>, predwrap>::memory_usage(fanout)) // pq
+			- sizeof(loser_tree<T, pred_t>) // tree
+			+ static_cast<memory_size_type>(loser_tree<T, pred_t>::memory_usage(fanout)) // tree
 			- sizeof(array<file_stream<T> >) // in
 			+ static_cast<memory_size_type>(array<file_stream<T> >::memory_usage(fanout)) // in
 			- fanout*sizeof(file_stream<T>) // in file_streams
@@ -91,31 +154,22 @@ public:
 			;
 	}
 
-	class predwrap {
-	public:
-		typedef std::pair<T, size_t> item_type;
-		typedef item_type first_argument_type;
-		typedef item_type second_argument_type;
-		typedef bool result_type;
-
-		predwrap(pred_t pred)
-			: pred(pred)
-		{
-		}
-
-		inline bool operator()(const item_type & lhs, const item_type & rhs) {
-			return pred(lhs.first, rhs.first);
-		}
+private:
+	inline bool can_read(size_t i) {
+		return in[i].can_read() && itemsRead[i] < runLength;
+	}
 
-	private:
-		pred_t pred;
-	};
+	inline T read(size_t i) {
+		++itemsRead[i];
+		return in[i].read();
+	}
 
-private:
-	internal_priority_queue<std::pair<T, size_t>, predwrap> pq;
+	loser_tree<T, pred_t> tree;
+	pred_t pred;
 	array<file_stream<T> > in;
 	array<stream_size_type> itemsRead;
 	stream_size_type runLength;
+	stream_size_type bytesRead;
 };
 
 } // namespace tpie
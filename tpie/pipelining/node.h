@@ -146,6 +146,19 @@ public:
 		return m_parameters.memoryFraction;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Predict the number of bytes this node reads and writes if it is
+	/// assigned the given amount of memory.
+	///
+	/// Called after prepare() while memory is being assigned. The runtime gives
+	/// memory beyond the minimum to the nodes that save the most I/O with it.
+	/// The default implementation returns zero, meaning that the I/O of the
+	/// node does not depend on its memory.
+	///////////////////////////////////////////////////////////////////////////
+	virtual stream_size_type get_io_cost(memory_size_type /*memory*/) {
+		return 0;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Get the local node map, mapping node IDs to node
 	/// pointers for all the nodes reachable from this one.
@@ -328,6 +341,20 @@ public:
 	void set_plot_options(int options) {
 		m_plotOptions = options;
 	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Number of bytes this node has reported reading from disk.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_read() const {
+		return m_bytesRead;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Number of bytes this node has reported writing to disk.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_bytes_written() const {
+		return m_bytesWritten;
+	}
 protected:
 #ifdef _WIN32
 	// Disable warning C4355: 'this' : used in base member initializer list
@@ -347,6 +374,8 @@ protected:
 		, m_pi(0)
 		, m_state(STATE_FRESH)
 		, m_plotOptions(0)
+		, m_bytesRead(0)
+		, m_bytesWritten(0)
 	{
 	}
 
@@ -362,6 +391,8 @@ protected:
 		, m_pi(other.m_pi)
 		, m_state(other.m_state)
 		, m_plotOptions(other.m_plotOptions)
+		, m_bytesRead(other.m_bytesRead)
+		, m_bytesWritten(other.m_bytesWritten)
 	{
 		if (m_state != STATE_FRESH) 
 			throw call_order_exception(
@@ -381,6 +412,8 @@ protected:
 		, m_pi(std::move(other.m_pi))
 		, m_state(std::move(other.m_state))
 		, m_plotOptions(std::move(other.m_plotOptions))
+		, m_bytesRead(std::move(other.m_bytesRead))
+		, m_bytesWritten(std::move(other.m_bytesWritten))
 	{
 		if (m_state != STATE_FRESH)
 			throw call_order_exception(
@@ -399,6 +432,8 @@ protected:
 		, m_pi(0)
 		, m_state(STATE_FRESH)
 		, m_plotOptions(0)
+		, m_bytesRead(0)
+		, m_bytesWritten(0)
 	{
 	}
 #ifdef _WIN32
@@ -613,6 +648,21 @@ public:
 		return token;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Called by implementers that do I/O, typically in end(), to
+	/// report the number of bytes read and written by the node.
+	///
+	/// The counters are not shared between nodes, so a node should report
+	/// the I/O of its streams in bulk rather than per block.
+	///////////////////////////////////////////////////////////////////////////
+	void add_bytes_read(stream_size_type bytes) {
+		m_bytesRead += bytes;
+	}
+
+	void add_bytes_written(stream_size_type bytes) {
+		m_bytesWritten += bytes;
+	}
+
 public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Called by implementers that intend to call step().
@@ -704,6 +754,8 @@ private:
 	STATE m_state;
 	std::auto_ptr<progress_indicator_base> m_piProxy;
 	int m_plotOptions;
+	stream_size_type m_bytesRead;
+	stream_size_type m_bytesWritten;
 
 	friend class bits::proxy_progress_indicator;
 };
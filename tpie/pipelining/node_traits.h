@@ -22,6 +22,7 @@
 
 #ifdef TPIE_CPP_DECLTYPE
 #include <type_traits>
+#include <utility>
 #endif
 
 namespace tpie {
@@ -106,6 +107,19 @@ struct has_itemtype {
 	//static_assert(sizeof(test<T>(nullptr)) == sizeof(yes), "WTF");
 	static const bool value = sizeof(test<T>(nullptr)) == sizeof(yes);
 };
+
+template <typename T, typename IT>
+struct has_range_push {
+	typedef char yes[1];
+	typedef char no[2];
+
+	template <typename C>
+	static yes& test(decltype(std::declval<C &>().push(std::declval<IT>(), std::declval<IT>())) *);
+
+	template <typename>
+	static no& test(...);
+	static const bool value = sizeof(test<T>(nullptr)) == sizeof(yes);
+};
 #endif //TPIE_CPP_DECLTYPE
 
 
@@ -143,6 +157,23 @@ struct pull_type {
 
 #endif //TPIE_CPP_DECLTYPE
 
+///////////////////////////////////////////////////////////////////////////////
+/// Tells whether a node of type T accepts a range of items through
+/// push(begin, end) with iterators of type IT.
+///////////////////////////////////////////////////////////////////////////////
+#ifdef TPIE_CPP_DECLTYPE
+template <typename T, typename IT>
+struct accepts_range_push {
+	typedef typename bits::remove<T>::type node_type;
+	static const bool value = bits::has_range_push<node_type, IT>::value;
+};
+#else //TPIE_CPP_DECLTYPE
+template <typename T, typename IT>
+struct accepts_range_push {
+	static const bool value = false;
+};
+#endif //TPIE_CPP_DECLTYPE
+
 } // namespace pipelining
 
 } // namespace tpie
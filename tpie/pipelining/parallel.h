@@ -37,11 +37,11 @@
 /// parallel_bits::befores running in different threads, and the consumer
 /// receives the items pushed to each after instance.
 ///
-/// All nodes have access to a single parallel_bits::state instance
-/// which has the mutex and the necessary condition variables.
-///    It also has pointers to the parallel_bits::before and
-/// parallel_bits::after instances and it holds an array of worker states (of
-/// enum type parallel_bits::worker_state).
+/// All nodes have access to a single parallel_bits::state instance.
+///    It has pointers to the parallel_bits::before and parallel_bits::after
+/// instances, and for each worker an input_channel and an output_channel,
+/// each a pair of lock-free single-producer single-consumer queues
+/// (parallel_bits::spsc_ring).
 ///    It also has a options struct which contains the user-supplied
 /// parameters to the framework (size of item buffer and number of concurrent
 /// workers).
@@ -50,33 +50,41 @@
 /// since we get deadlocks if some of the workers are allowed to wait for a
 /// ready tpie::job worker. Instead, we use boost::threads directly.
 ///
-/// Parallel worker states. The main thread has a condition variable
-/// (producerCond) which is signalled every time a worker changes its own
-/// state. Each worker thread has a condition variable (workerCond[]) which is
-/// signalled when the main thread changes the worker's state.
+/// Buffer ownership. Only pointers to buffers pass through the queues, so
+/// items are never copied between threads; a buffer belongs to whichever
+/// thread last popped it from a queue.
 ///
-/// Initializing: Before the input/output buffers are initialized.
-/// -> Idle (worker thread)
+/// The producer owns numJobs+1 input buffers. It fills one, pushes it to the
+/// work queue of an idle worker and continues with a free buffer. The worker
+/// pushes the items down its pipeline and hands the buffer back through the
+/// processed queue.
 ///
-/// Idle: Input/output buffers are empty.
-/// -> Processing (main thread)
+/// Each after instance owns two output buffers. When one is full, or when an
+/// input buffer has been processed, it is pushed to the full queue, and the
+/// worker continues with the buffer it pops from the empty queue. The
+/// producer consumes full buffers and pushes them to the empty queue. With
+/// maintainOrder, the producer only consumes output from the worker that was
+/// sent the oldest input buffer, until that worker marks an output buffer as
+/// complete.
 ///
-/// Processing: Input buffer is full; output buffer is empty.
-/// -> Partial output (worker thread; signals main)
-/// -> Outputting (worker thread)
+/// A thread only sleeps when a queue it needs is empty. It sleeps on an
+/// event_count: the main thread on producerEvents and each worker on its
+/// own entry of workerEvents. Whoever pushes to a queue notifies the event
+/// count of the thread reading from it, which only takes a lock if that
+/// thread is asleep.
 ///
-/// Partial output: Output buffer is full; input buffer is non-empty.
-/// -> Processing (main thread)
-///
-/// Outputting: Output buffer is full; input buffer is empty.
-/// -> Idle (main thread)
+/// Worker placement. With options::placement, each worker pins its thread
+/// to a processor or NUMA node before it allocates its output buffers, so
+/// the buffers it fills are placed in memory local to the worker. The input
+/// buffers are allocated by the producer, which writes them, in the main
+/// thread.
 ///
 /// TODO at some future point: Optimize code for the case where the buffer size
 /// is one.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <tpie/pipelining/parallel/options.h>
-#include <tpie/pipelining/parallel/worker_state.h>
+#include <tpie/pipelining/parallel/spsc_ring.h>
 #include <tpie/pipelining/parallel/aligned_array.h>
 #include <tpie/pipelining/parallel/base.h>
 #include <tpie/pipelining/parallel/factory.h>
@@ -24,8 +24,15 @@
 #include <tpie/pipelining/factory_base.h>
 #include <tpie/array_view.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <tpie/pipelining/maintain_order_type.h>
 #include <tpie/pipelining/parallel/options.h>
+#include <tpie/pipelining/parallel/spsc_ring.h>
+#include <tpie/internal_queue.h>
+#include <tpie/internal_stack.h>
+#include <tpie/cpu_affinity.h>
+#include <sstream>
 
 namespace tpie {
 
@@ -183,7 +190,6 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Called by before::worker after a batch of items has
 	/// been pushed.
-	/// \param  complete  Whether the entire input has been processed.
 	///////////////////////////////////////////////////////////////////////////
 	virtual void flush_buffer() = 0;
 
@@ -198,41 +204,56 @@ public:
 /// This class is instantiated once and kept in a boost::shared_ptr, and it is
 /// not copy constructible.
 ///
-/// Unless noted otherwise, a thread must own the state mutex to access other
-/// parts of this instance.
+/// Buffers are handed between the main thread and the workers through
+/// spsc_rings, so no lock is taken unless a thread has to sleep.
 ///////////////////////////////////////////////////////////////////////////////
 class state_base {
 public:
-	typedef boost::mutex mutex_t;
-	typedef boost::condition_variable cond_t;
-	typedef boost::unique_lock<boost::mutex> lock_t;
+	/** Number of output buffers of each worker. While the main thread
+	 * consumes one of them, the worker can fill another. */
+	static const size_t outputBuffers = 2;
 
 	const options opts;
 
-	/** Single mutex. */
-	mutex_t mutex;
+	/** Number of items each input and output buffer can hold. This is
+	 * opts.bufSize, unless the batch size is adaptive, in which case the
+	 * producer sets it from its assigned memory before the workers start. */
+	memory_size_type bufCapacity;
 
-	/** Condition variable.
+	/** Event count of the main thread.
 	 *
-	 * Who waits: The producer, with the single mutex (waits until at least one
-	 * worker has state = IDLE or state = OUTPUTTING).
+	 * Who waits: The producer, when no worker can take its input buffer, and
+	 * when waiting for the workers to start or stop.
 	 *
-	 * Who signals: The par_after, when a worker is OUTPUTTING. */
-	cond_t producerCond;
+	 * Who notifies: The workers, when they hand back an input buffer, send an
+	 * output buffer, start or stop. */
+	event_count producerEvents;
 
-	/** Condition variable, one per worker.
+	/** Event count, one per worker.
 	 *
-	 * Who waits: The worker's par_before when waiting for input (wait for
-	 * state = PROCESSING), the worker's par_after when waiting for output to
-	 * be read (wait for state = IDLE). Waits with the single mutex.
+	 * Who waits: The worker's before when waiting for input, the worker's
+	 * after when waiting for an output buffer to be consumed.
 	 *
-	 * Who signals: par_producer, when input has been written (sets state to PROCESSING).
-	 * par_consumer, when output has been read (sets state to IDLE).
-	 */
-	cond_t * workerCond;
+	 * Who notifies: The producer, when it sends an input buffer or hands back
+	 * an output buffer. */
+	event_count * workerEvents;
 
-	/** Shared state, must have mutex to write. */
-	size_t runningWorkers;
+	/** Number of workers that have initialized their buffers and not yet
+	 * stopped. */
+	boost::atomic<size_t> runningWorkers;
+
+	/** Set by the producer when all workers have processed all input.
+	 * Afterwards, the after instances pass output directly to the consumer,
+	 * which happens in the main thread when nodes push items in end(). */
+	boost::atomic<bool> done;
+
+	/** Number of workers that could not be pinned as requested by
+	 * opts.placement. */
+	boost::atomic<size_t> unpinnedWorkers;
+
+	/** The worker threads, started by the befores and joined by the
+	 * producer. */
+	boost::thread_group workerThreads;
 
 	/// Must not be used concurrently.
 	void set_input_ptr(size_t idx, node * v) {
@@ -248,8 +269,6 @@ public:
 	/// \brief  Get the specified before instance.
 	///
 	/// Enables easy construction of the pipeline graph at runtime.
-	///
-	/// Shared state, must have mutex to use.
 	///////////////////////////////////////////////////////////////////////////
 	node & input(size_t idx) { return *m_inputs[idx]; }
 
@@ -260,49 +279,33 @@ public:
 	/// First, it enables easy construction of the pipeline graph at runtime.
 	/// Second, it is used by before to send batch signals to
 	/// after.
-	///
-	/// Shared state, must have mutex to use.
 	///////////////////////////////////////////////////////////////////////////
 	after_base & output(size_t idx) { return *m_outputs[idx]; }
 
-	/// Shared state, must have mutex to use.
-	worker_state get_state(size_t idx) {
-		return m_states[idx];
-	}
-
-	/// Shared state, must have mutex to use.
-	void transition_state(size_t idx, worker_state from, worker_state to) {
-		if (m_states[idx] != from) {
-			std::stringstream ss;
-			ss << idx << " Invalid state transition " << from << " -> " << to << "; current state is " << m_states[idx];
-			log_error() << ss.str() << std::endl;
-			throw exception(ss.str());
-		}
-		m_states[idx] = to;
-	}
-
 protected:
 	std::vector<node *> m_inputs;
 	std::vector<after_base *> m_outputs;
-	std::vector<worker_state> m_states;
 
 	state_base(const options opts)
 		: opts(opts)
+		, bufCapacity(opts.bufSize)
 		, runningWorkers(0)
+		, done(false)
+		, unpinnedWorkers(0)
 		, m_inputs(opts.numJobs, 0)
 		, m_outputs(opts.numJobs, 0)
-		, m_states(opts.numJobs, INITIALIZING)
 	{
-		workerCond = new cond_t[opts.numJobs];
+		workerEvents = new event_count[opts.numJobs];
 	}
 
 	virtual ~state_base() {
-		delete[] workerCond;
+		delete[] workerEvents;
 	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Instantiated in each thread.
+/// \brief Buffer of input items. Filled by the producer and handed to a
+/// worker, which hands it back when the items have been processed.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T>
 class parallel_input_buffer {
@@ -310,49 +313,101 @@ class parallel_input_buffer {
 	array<T> m_inputBuffer;
 
 public:
-	array_view<T> get_input() {
-		return array_view<T>(&m_inputBuffer[0], m_inputSize);
+	/** Set by the worker when the batch size is adaptive: The number of items
+	 * in the batch it processed, the seconds it waited for the batch, and
+	 * the seconds it spent processing it. */
+	memory_size_type processedItems;
+	double waitSeconds;
+	double processSeconds;
+
+	parallel_input_buffer()
+		: m_inputSize(0)
+		, processedItems(0)
+		, waitSeconds(0)
+		, processSeconds(0)
+	{
 	}
 
-	void set_input(array_view<T> input) {
-		if (input.size() > m_inputBuffer.size())
-			throw tpie::exception(m_inputBuffer.size() ? "Input too large" : "Input buffer not initialized");
+	void resize(memory_size_type items) {
+		m_inputBuffer.resize(items);
+		m_inputSize = 0;
+	}
 
-		memory_size_type items =
-			std::copy(input.begin(), input.end(), m_inputBuffer.begin())
-			-m_inputBuffer.begin();
+	void push(const T & item) {
+		m_inputBuffer[m_inputSize++] = item;
+	}
 
-		m_inputSize = items;
+	memory_size_type size() const {
+		return m_inputSize;
 	}
 
-	parallel_input_buffer(const options & opts)
-		: m_inputSize(0)
-		, m_inputBuffer(opts.bufSize)
-	{
+	bool empty() const {
+		return m_inputSize == 0;
+	}
+
+	void clear() {
+		m_inputSize = 0;
+	}
+
+	array_view<T> get_input() {
+		return array_view<T>(m_inputBuffer.get(), m_inputSize);
 	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Instantiated in each thread.
+/// \brief Buffer of output items. Filled by a worker and handed to the
+/// producer, which hands it back when the items have been consumed.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T>
 class parallel_output_buffer {
 	memory_size_type m_outputSize;
 	array<T> m_outputBuffer;
+	bool m_complete;
 	friend class after<T>;
 
 public:
+	parallel_output_buffer()
+		: m_outputSize(0)
+		, m_complete(false)
+	{
+	}
+
 	array_view<T> get_output() {
-		return array_view<T>(&m_outputBuffer[0], m_outputSize);
+		return array_view<T>(m_outputBuffer.get(), m_outputSize);
 	}
 
-	parallel_output_buffer(const options & opts)
-		: m_outputSize(0)
-		, m_outputBuffer(opts.bufSize)
-	{
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Whether this is the last output of an input buffer.
+	///////////////////////////////////////////////////////////////////////////
+	bool is_complete() const {
+		return m_complete;
 	}
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Queues of input buffers between the producer and a worker.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+struct input_channel {
+	/** Input buffers sent to the worker, or 0 when the worker must stop. */
+	spsc_ring<parallel_input_buffer<T> *, 2> work;
+
+	/** Processed input buffers handed back to the producer. */
+	spsc_ring<parallel_input_buffer<T> *, 2> processed;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Queues of output buffers between a worker and the producer.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+struct output_channel {
+	/** Output buffers sent to the producer. */
+	spsc_ring<parallel_output_buffer<T> *, state_base::outputBuffers> full;
+
+	/** Consumed output buffers handed back to the worker. */
+	spsc_ring<parallel_output_buffer<T> *, state_base::outputBuffers> empty;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief  Node running in main thread, accepting an output buffer
 /// from the managing producer and forwards them down the pipe. The overhead
@@ -371,18 +426,15 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief State subclass containing the item type specific state, i.e. the
-/// input/output buffers and the concrete pipes.
+/// buffer queues and the concrete pipes.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T1, typename T2>
 class state : public state_base {
 public:
 	typedef boost::shared_ptr<state> ptr;
-	typedef state_base::mutex_t mutex_t;
-	typedef state_base::cond_t cond_t;
-	typedef state_base::lock_t lock_t;
 
-	array<parallel_input_buffer<T1> *> m_inputBuffers;
-	array<parallel_output_buffer<T2> *> m_outputBuffers;
+	input_channel<T1> * m_inputChannels;
+	output_channel<T2> * m_outputChannels;
 
 	consumer<T2> * m_cons;
 
@@ -391,14 +443,20 @@ public:
 	template <typename fact_t>
 	state(const options opts, const fact_t & fact)
 		: state_base(opts)
-		, m_inputBuffers(opts.numJobs)
-		, m_outputBuffers(opts.numJobs)
+		, m_inputChannels(new input_channel<T1>[opts.numJobs])
+		, m_outputChannels(new output_channel<T2>[opts.numJobs])
 		, m_cons(0)
 	{
 		typedef threads_impl<T1, T2, fact_t> pipes_impl_t;
 		pipes.reset(new pipes_impl_t(fact, *this));
 	}
 
+	virtual ~state() {
+		pipes.reset();
+		delete[] m_inputChannels;
+		delete[] m_outputChannels;
+	}
+
 	void set_consumer_ptr(consumer<T2> * cons) {
 		m_cons = cons;
 	}
@@ -416,9 +474,9 @@ class after : public after_base {
 protected:
 	state_base & st;
 	size_t parId;
-	std::auto_ptr<parallel_output_buffer<T> > m_buffer;
-	array<parallel_output_buffer<T> *> & m_outputBuffers;
-	typedef state_base::lock_t lock_t;
+	array<parallel_output_buffer<T> > m_buffers;
+	parallel_output_buffer<T> * m_buffer;
+	output_channel<T> & m_channel;
 	consumer<T> * const * m_cons;
 
 public:
@@ -429,7 +487,8 @@ public:
 				   size_t parId)
 		: st(state)
 		, parId(parId)
-		, m_outputBuffers(state.m_outputBuffers)
+		, m_buffer(0)
+		, m_channel(state.m_outputChannels[parId])
 		, m_cons(state.get_consumer_ptr_ptr())
 	{
 		state.set_output_ptr(parId, this);
@@ -446,7 +505,8 @@ public:
 		: after_base(other)
 		, st(other.st)
 		, parId(other.parId)
-		, m_outputBuffers(other.m_outputBuffers)
+		, m_buffer(0)
+		, m_channel(other.m_channel)
 		, m_cons(other.m_cons)
 	{
 		st.set_output_ptr(parId, this);
@@ -471,13 +531,19 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Invoked by before::worker (in worker thread context).
 	///////////////////////////////////////////////////////////////////////////
-	virtual void worker_initialize() {
-		m_buffer.reset(new parallel_output_buffer<T>(st.opts));
-		m_outputBuffers[parId] = m_buffer.get();
+	virtual void worker_initialize() override {
+		m_buffers.resize(state_base::outputBuffers);
+		for (size_t i = 0; i < m_buffers.size(); ++i)
+			m_buffers[i].m_outputBuffer.resize(st.bufCapacity);
+		m_buffer = &m_buffers[0];
+		// The producer does not touch the queue before the worker is running,
+		// so we may push to it from this end.
+		for (size_t i = 1; i < m_buffers.size(); ++i)
+			m_channel.empty.try_push(&m_buffers[i]);
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Invoked by before::push_all when all input items have been
+	/// \brief  Invoked by before::worker when all input items have been
 	/// pushed.
 	///////////////////////////////////////////////////////////////////////////
 	virtual void flush_buffer() override {
@@ -485,62 +551,31 @@ public:
 	}
 
 private:
-	bool is_done() const {
-		switch (st.get_state(parId)) {
-			case INITIALIZING:
-				throw tpie::exception("INITIALIZING not expected in after::is_done");
-			case IDLE:
-				return true;
-			case PROCESSING:
-				// The main thread may transition us from Outputting to Idle to
-				// Processing without us noticing, or it may transition us from
-				// Partial_Output to Processing. In either case, we are done
-				// flushing the buffer.
-				return true;
-			case PARTIAL_OUTPUT:
-			case OUTPUTTING:
-				return false;
-			case DONE:
-				return true;
-		}
-		throw tpie::exception("Unknown state");
-	}
-
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Send a signal to the main thread that the output buffer must
-	/// be emptied.
-	///
-	/// If this is in response to a full output buffer before the input buffer
-	/// has been processed, `complete == false`. In this case, we transition
-	/// to PARTIAL_OUTPUT and the main thread will transition us to PROCESSING
-	/// after consuming our output buffer.
+	/// \brief  Send the output buffer to the main thread and continue with
+	/// a buffer that the main thread has consumed.
 	///
-	/// If this is in response to an empty input buffer, `complete == true`,
-	/// and we transition to OUTPUTTING and the main thread will transition us
-	/// to IDLE.
-	///
-	/// \param  complete  Whether the entire input has been processed.
+	/// \param  complete  Whether the entire input buffer has been processed.
 	///////////////////////////////////////////////////////////////////////////
 	void flush_buffer_impl(bool complete) {
-		// At this point, we could check if the output buffer is empty and
-		// short-circuit when it is without acquiring the lock; however, we
-		// must do a full PROCESSING -> OUTPUTTING -> IDLE transition in this
-		// case to let the main thread know that we are done processing the
-		// input.
-
-		lock_t lock(st.mutex);
-		if (st.get_state(parId) == DONE) {
+		if (st.done.load(boost::memory_order_acquire)) {
+			// The workers have stopped, and we are in the main thread.
 			if (*m_cons == 0) throw tpie::exception("Unexpected nullptr in flush_buffer");
-			array_view<T> out = m_buffer->get_output();
-			(*m_cons)->consume(out);
-		} else {
-			st.transition_state(parId, PROCESSING, complete ? OUTPUTTING : PARTIAL_OUTPUT);
-			// notify producer that output is ready
-			st.producerCond.notify_one();
-			while (!is_done()) {
-				st.workerCond[parId].wait(lock);
-			}
+			(*m_cons)->consume(m_buffer->get_output());
+			m_buffer->m_outputSize = 0;
+			return;
 		}
+
+		// When order is maintained, the producer must be told where the
+		// output of an input buffer ends, even if there is no output.
+		if (m_buffer->m_outputSize == 0 && !st.opts.maintainOrder) return;
+
+		m_buffer->m_complete = complete;
+		if (!m_channel.full.try_push(m_buffer))
+			throw tpie::exception("Output queue of parallel worker is full");
+		st.producerEvents.notify();
+
+		pop_or_wait(m_channel.empty, m_buffer, st.workerEvents[parId]);
 		m_buffer->m_outputSize = 0;
 	}
 };
@@ -555,9 +590,7 @@ class before : public node {
 protected:
 	state_base & st;
 	size_t parId;
-	std::auto_ptr<parallel_input_buffer<T> > m_buffer;
-	array<parallel_input_buffer<T> *> & m_inputBuffers;
-	boost::thread m_worker;
+	input_channel<T> & m_channel;
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Overridden in subclass to push a buffer of items.
@@ -568,7 +601,7 @@ protected:
 	before(state<T, Output> & st, size_t parId)
 		: st(st)
 		, parId(parId)
-		, m_inputBuffers(st.m_inputBuffers)
+		, m_channel(st.m_inputChannels[parId])
 	{
 		set_name("Parallel before", PRIORITY_INSIGNIFICANT);
 	}
@@ -577,7 +610,7 @@ protected:
 	before(const before & other)
 		: st(other.st)
 		, parId(other.parId)
-		, m_inputBuffers(other.m_inputBuffers)
+		, m_channel(other.m_channel)
 	{
 	}
 
@@ -586,87 +619,80 @@ public:
 
 	virtual void begin() override {
 		node::begin();
-		boost::thread t(run_worker, this);
-		m_worker.swap(t);
+		st.workerThreads.create_thread(boost::bind(run_worker, this));
 	}
 
 private:
-	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if we are ready to process a batch of input.
-	///////////////////////////////////////////////////////////////////////////
-	bool ready() {
-		switch (st.get_state(parId)) {
-			case INITIALIZING:
-				throw tpie::exception("INITIALIZING not expected in before::ready");
-			case IDLE:
-				return false;
-			case PROCESSING:
-				return true;
-			case PARTIAL_OUTPUT:
-				throw tpie::exception("State 'partial_output' was not expected in before::ready");
-			case OUTPUTTING:
-				throw tpie::exception("State 'outputting' was not expected in before::ready");
-			case DONE:
-				return false;
-		}
-		throw tpie::exception("Unknown state");
+	static void run_worker(before * self) {
+		self->worker();
 	}
 
-	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Class providing RAII-style bookkeeping of number of workers.
-	///////////////////////////////////////////////////////////////////////////
-	class running_signal {
-		typedef state_base::cond_t cond_t;
-		memory_size_type & sig;
-		cond_t & producerCond;
-	public:
-		running_signal(memory_size_type & sig, cond_t & producerCond)
-			: sig(sig)
-			, producerCond(producerCond)
-		{
-			++sig;
-			producerCond.notify_one();
-		}
+	static boost::posix_time::ptime now() {
+		return boost::posix_time::microsec_clock::universal_time();
+	}
 
-		~running_signal() {
-			--sig;
-			producerCond.notify_one();
-		}
-	};
+	static double seconds(boost::posix_time::time_duration d) {
+		return d.total_microseconds() / 1000000.0;
+	}
 
-	static void run_worker(before * self) {
-		self->worker();
+	void place_worker() {
+		bool pinned = true;
+		switch (st.opts.placement) {
+			case unpinned_workers:
+				return;
+			case pin_workers_to_cpus:
+				pinned = pin_thread_to_cpu(parId);
+				break;
+			case pin_workers_to_numa_nodes:
+				pinned = pin_thread_to_numa_node(parId);
+				break;
+		}
+		if (!pinned) st.unpinnedWorkers.fetch_add(1);
 	}
 
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Worker thread entry point.
 	///////////////////////////////////////////////////////////////////////////
 	void worker() {
-		state_base::lock_t lock(st.mutex);
-
-		m_buffer.reset(new parallel_input_buffer<T>(st.opts));
-		m_inputBuffers[parId] = m_buffer.get();
+		// Pin the thread before the output buffers are allocated, so that
+		// they are placed on the worker's NUMA node.
+		place_worker();
 
 		// virtual invocation
 		st.output(parId).worker_initialize();
 
-		st.transition_state(parId, INITIALIZING, IDLE);
-		running_signal _(st.runningWorkers, st.producerCond);
+		st.runningWorkers.fetch_add(1);
+		st.producerEvents.notify();
+
+		const bool measure = st.opts.bufSize == adaptive_buffer_size;
+		boost::posix_time::ptime t0;
+		boost::posix_time::ptime t1;
+		if (measure) t0 = now();
+
 		while (true) {
-			// wait for transition IDLE -> PROCESSING
-			while (!ready()) {
-				if (st.get_state(parId) == DONE) {
-					return;
-				}
-				st.workerCond[parId].wait(lock);
-			}
-			lock.unlock();
+			parallel_input_buffer<T> * buffer;
+			pop_or_wait(m_channel.work, buffer, st.workerEvents[parId]);
+			if (buffer == 0) break;
+			if (measure) t1 = now();
 
 			// virtual invocation
-			push_all(m_buffer->get_input());
-
-			lock.lock();
+			push_all(buffer->get_input());
+
+			if (measure) {
+				boost::posix_time::ptime t2 = now();
+				buffer->processedItems = buffer->size();
+				buffer->waitSeconds = seconds(t1 - t0);
+				buffer->processSeconds = seconds(t2 - t1);
+				t0 = t2;
+			}
+			buffer->clear();
+			if (!m_channel.processed.try_push(buffer))
+				throw tpie::exception("Input queue of parallel worker is full");
+			st.producerEvents.notify();
 		}
+
+		st.runningWorkers.fetch_sub(1);
+		st.producerEvents.notify();
 	}
 };
 
@@ -744,6 +770,10 @@ public:
 /// \brief Producer, running in main thread, managing the parallel execution.
 ///
 /// This class contains the bulk of the code that is run in the main thread.
+///
+/// The producer has one input buffer more than there are workers. It fills
+/// one of them and hands it to an idle worker, and then continues with a
+/// buffer that a worker has handed back.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename T1, typename T2>
 class producer : public node {
@@ -753,100 +783,191 @@ public:
 private:
 	typedef state<T1, T2> state_t;
 	typedef typename state_t::ptr stateptr;
+	typedef parallel_input_buffer<T1> input_buffer_t;
+	typedef parallel_output_buffer<T2> output_buffer_t;
+
 	stateptr st;
-	array<T1> inputBuffer;
-	size_t written;
-	size_t readyIdx;
+	array<input_buffer_t> m_inputBuffers;
+	/** The input buffer being filled. */
+	input_buffer_t * m_input;
+	/** Input buffers handed back by the workers. */
+	internal_stack<input_buffer_t *> m_freeInputs;
+	/** Whether each worker has an input buffer that it has not handed back. */
+	array<bool> m_busy;
 	boost::shared_ptr<consumer<T2> > cons;
+	/** With maintainOrder, the workers that were sent input buffers whose
+	 * output has not been consumed, in the order they were sent. */
 	internal_queue<memory_size_type> m_outputOrder;
 	stream_size_type m_steps;
+	/** Number of items to put in an input buffer before sending it. */
+	memory_size_type m_batchSize;
+	/** With adaptive_buffer_size, moving averages of the seconds a worker
+	 * spends per item, and of the seconds it waits between batches. */
+	double m_itemSeconds;
+	double m_waitSeconds;
+	/** With adaptive_buffer_size, the breadcrumb showing the batch size in
+	 * the progress indicator, or empty if none is shown. */
+	std::string m_batchCrumb;
+
+	/** Bounds of the buffer capacity with adaptive_buffer_size. */
+	static const memory_size_type minAdaptiveBatch = 64;
+	static const memory_size_type maxAdaptiveBatch = 1024*1024;
+	/** Buffer capacity with adaptive_buffer_size when the stage is given no
+	 * memory fraction. */
+	static const memory_size_type defaultAdaptiveBatch = 4096;
+
+	bool adaptive() const {
+		return st->opts.bufSize == adaptive_buffer_size;
+	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if a worker is waiting for the main thread.
-	///
-	/// A worker may wait for output to be fetched, or it may wait for input to
-	/// be sent. If there is a worker waiting, this function returns true and
-	/// sets the index of the waiting worker in this->readyIdx.
+	/// \brief  Memory used by the buffers per item of buffer capacity.
 	///////////////////////////////////////////////////////////////////////////
-	bool has_ready_pipe() {
+	memory_size_type bytes_per_item() const {
+		return (st->opts.numJobs + 1) * sizeof(T1) // input buffers
+			+ st->opts.numJobs * state_base::outputBuffers * sizeof(T2) // output buffers
+			;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Memory used by the buffer bookkeeping, independent of the
+	/// buffer capacity.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type fixed_memory() const {
+		const memory_size_type numJobs = st->opts.numJobs;
+		return (numJobs + 1) * (sizeof(input_buffer_t) + sizeof(input_buffer_t *)) // m_inputBuffers, m_freeInputs
+			+ numJobs * sizeof(bool) // m_busy
+			+ numJobs * state_base::outputBuffers * sizeof(output_buffer_t) // after::m_buffers
+			+ internal_queue<memory_size_type>::memory_usage(numJobs * (state_base::outputBuffers + 1)) // m_outputOrder
+			;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Collect the input buffers that workers have processed.
+	///////////////////////////////////////////////////////////////////////////
+	void collect_processed() {
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			switch (st->get_state(i)) {
-				case INITIALIZING:
-				case PROCESSING:
-					break;
-				case PARTIAL_OUTPUT:
-				case OUTPUTTING:
-					// If we have to maintain order of items, the only
-					// outputting worker we consider to be waiting is the
-					// "front worker".
-					if (st->opts.maintainOrder && m_outputOrder.front() != i)
-						break;
-					// fallthrough
-				case IDLE:
-					readyIdx = i;
-					return true;
-				case DONE:
-					throw tpie::exception("State DONE not expected in has_ready_pipe().");
+			input_buffer_t * buffer;
+			if (st->m_inputChannels[i].processed.try_pop(buffer)) {
+				if (adaptive() && buffer->processedItems > 0) adapt(*buffer);
+				m_freeInputs.push(buffer);
+				m_busy[i] = false;
 			}
 		}
-		return false;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if a worker is waiting for the main thread to process its
-	/// output.
+	/// \brief  Choose the batch size from the timings of a processed batch.
 	///
-	/// This is used in end() instead of has_ready_pipe, since we do not care
-	/// about workers waiting for input when we don't have any input to send.
+	/// A batch should take much longer to process than a worker waits
+	/// between batches, so that handing over buffers does not dominate, but
+	/// not so long that the load is unevenly balanced at the end or that the
+	/// first output is delayed. We aim at processing a batch in sixteen times
+	/// the wait, between 0.2 and 10 milliseconds.
+	///////////////////////////////////////////////////////////////////////////
+	void adapt(const input_buffer_t & buffer) {
+		const double weight = 0.25;
+		double itemSeconds = buffer.processSeconds / buffer.processedItems;
+		if (m_itemSeconds < 0) {
+			m_itemSeconds = itemSeconds;
+			m_waitSeconds = buffer.waitSeconds;
+		} else {
+			m_itemSeconds += weight * (itemSeconds - m_itemSeconds);
+			m_waitSeconds += weight * (buffer.waitSeconds - m_waitSeconds);
+		}
+
+		double target = std::min(std::max(16 * m_waitSeconds, 0.0002), 0.01);
+		memory_size_type batch = st->bufCapacity;
+		if (m_itemSeconds * batch > target)
+			batch = static_cast<memory_size_type>(target / m_itemSeconds);
+		m_batchSize = std::max(std::min(batch, st->bufCapacity),
+							   std::min(minAdaptiveBatch, st->bufCapacity));
+		report_batch_size();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Show the current batch size as a breadcrumb in the progress
+	/// indicator.
+	///////////////////////////////////////////////////////////////////////////
+	void report_batch_size() {
+		progress_indicator_base * pi = this->get_progress_indicator();
+		if (pi == 0) return;
+		std::stringstream ss;
+		ss << "Batch " << m_batchSize;
+		if (ss.str() == m_batchCrumb) return;
+		if (!m_batchCrumb.empty()) pi->pop_breadcrumb();
+		m_batchCrumb = ss.str();
+		pi->push_breadcrumb(m_batchCrumb.c_str(), IMPORTANCE_MINOR);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Pass an output buffer to the consumer and hand it back to the
+	/// worker.
+	///////////////////////////////////////////////////////////////////////////
+	void consume(size_t idx, output_buffer_t * buffer) {
+		// virtual invocation
+		cons->consume(buffer->get_output());
+		st->m_outputChannels[idx].empty.try_push(buffer);
+		st->workerEvents[idx].notify();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Consume the output buffers that workers have sent.
 	///
-	/// Like has_ready_pipe, this function sets this->readyIdx if and only if
-	/// it returns true.
+	/// If we have to maintain order of items, we only consume the output of
+	/// the worker that was sent the oldest input buffer.
 	///////////////////////////////////////////////////////////////////////////
-	bool has_outputting_pipe() {
-		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			switch (st->get_state(i)) {
-				case INITIALIZING:
-				case IDLE:
-				case PROCESSING:
-					break;
-				case PARTIAL_OUTPUT:
-				case OUTPUTTING:
-					if (st->opts.maintainOrder && m_outputOrder.front() != i)
-						break;
-					readyIdx = i;
-					return true;
-				case DONE:
-					throw tpie::exception("State DONE not expected in has_outputting_pipe().");
+	void consume_output() {
+		output_buffer_t * buffer;
+		if (st->opts.maintainOrder) {
+			while (!m_outputOrder.empty()) {
+				size_t idx = m_outputOrder.front();
+				if (!st->m_outputChannels[idx].full.try_pop(buffer)) break;
+				bool complete = buffer->is_complete();
+				consume(idx, buffer);
+				if (complete) m_outputOrder.pop();
+			}
+		} else {
+			for (size_t i = 0; i < st->opts.numJobs; ++i) {
+				for (size_t j = 0; j < state_base::outputBuffers; ++j) {
+					if (!st->m_outputChannels[i].full.try_pop(buffer)) break;
+					consume(i, buffer);
+				}
 			}
 		}
-		return false;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
-	/// \brief  Check if a worker is waiting for the main thread to process its
-	/// output.
-	///
-	/// This is used in end() when we are waiting for workers to finish up.
-	/// When no worker is outputting and no worker is processing, all items
-	/// have been processed.
-	///
-	/// Does not modify this->readyIdx.
+	/// \brief  Hand the input buffer to an idle worker, consuming output
+	/// while waiting for one.
 	///////////////////////////////////////////////////////////////////////////
-	bool has_processing_pipe() {
-		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			switch (st->get_state(i)) {
-				case INITIALIZING:
-				case IDLE:
-				case PARTIAL_OUTPUT:
-				case OUTPUTTING:
-					break;
-				case PROCESSING:
-					return true;
-				case DONE:
-					throw tpie::exception("State DONE not expected in has_processing_pipe().");
+	void send_input() {
+		flush_steps();
+		while (true) {
+			size_t ticket = st->producerEvents.prepare_wait();
+			collect_processed();
+			consume_output();
+			for (size_t i = 0; i < st->opts.numJobs; ++i) {
+				if (m_busy[i]) continue;
+				if (!st->m_inputChannels[i].work.try_push(m_input))
+					throw tpie::exception("Input queue of parallel worker is full");
+				st->workerEvents[i].notify();
+				m_busy[i] = true;
+				if (st->opts.maintainOrder)
+					m_outputOrder.push(i);
+				// The worker has handed back its previous buffer.
+				m_input = m_freeInputs.top();
+				m_freeInputs.pop();
+				return;
 			}
+			st->producerEvents.wait(ticket);
 		}
-		return false;
+	}
+
+	bool all_idle() {
+		for (size_t i = 0; i < st->opts.numJobs; ++i)
+			if (m_busy[i]) return false;
+		return true;
 	}
 
 	///////////////////////////////////////////////////////////////////////////
@@ -875,31 +996,77 @@ public:
 	template <typename consumer_t>
 	producer(stateptr st, const consumer_t & cons)
 		: st(st)
-		, written(0)
+		, m_input(0)
 		, cons(new consumer_t(cons))
 		, m_steps(0)
+		, m_batchSize(0)
+		, m_itemSeconds(-1)
+		, m_waitSeconds(0)
 	{
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
 			this->add_push_destination(st->input(i));
 		}
 		this->set_name("Parallel input", PRIORITY_INSIGNIFICANT);
-		memory_size_type usage =
-			st->opts.numJobs * st->opts.bufSize * (sizeof(T1) + sizeof(T2)) // workers
-			+ st->opts.bufSize * sizeof(item_type) // our buffer
-			;
-		this->set_minimum_memory(usage);
+		if (adaptive()) {
+			// Like other nodes, the stage only gets memory beyond its
+			// minimum if it is given a memory fraction, and then at most
+			// enough for the largest batches.
+			st->bufCapacity = defaultAdaptiveBatch;
+			this->set_maximum_memory(maxAdaptiveBatch * bytes_per_item() + fixed_memory());
+		}
+		this->set_minimum_memory(st->bufCapacity * bytes_per_item() + fixed_memory());
 
 		if (st->opts.maintainOrder) {
-			m_outputOrder.resize(st->opts.numJobs);
+			m_outputOrder.resize(st->opts.numJobs * (state_base::outputBuffers + 1));
 		}
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  With adaptive_buffer_size, size the buffers to the assigned
+	/// memory. Called before the workers allocate their output buffers.
+	///////////////////////////////////////////////////////////////////////////
+	virtual void set_available_memory(memory_size_type availableMemory) override {
+		node::set_available_memory(availableMemory);
+		if (!adaptive()) return;
+		memory_size_type fixed = fixed_memory();
+		memory_size_type capacity = 0;
+		if (availableMemory > fixed) capacity = (availableMemory - fixed) / bytes_per_item();
+		st->bufCapacity = std::max(minAdaptiveBatch, std::min(maxAdaptiveBatch, capacity));
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  The number of items currently sent to a worker at a time.
+	///
+	/// With adaptive_buffer_size, the batch size is also shown as a
+	/// breadcrumb in the progress indicator of the phase.
+	///////////////////////////////////////////////////////////////////////////
+	memory_size_type get_batch_size() const {
+		return m_batchSize;
+	}
+
 	virtual void begin() override {
-		inputBuffer.resize(st->opts.bufSize);
+		const size_t numJobs = st->opts.numJobs;
+		// Start with small batches so the first output arrives early, and
+		// grow them as timings come in.
+		m_batchSize = adaptive() ? std::min(minAdaptiveBatch, st->bufCapacity) : st->bufCapacity;
+		if (adaptive()) report_batch_size();
+		m_inputBuffers.resize(numJobs + 1);
+		for (size_t i = 0; i < m_inputBuffers.size(); ++i)
+			m_inputBuffers[i].resize(st->bufCapacity);
+		m_input = &m_inputBuffers[0];
+		m_freeInputs.resize(numJobs + 1);
+		for (size_t i = 1; i < m_inputBuffers.size(); ++i)
+			m_freeInputs.push(&m_inputBuffers[i]);
+		m_busy.resize(numJobs, false);
 
-		state_base::lock_t lock(st->mutex);
-		while (st->runningWorkers != st->opts.numJobs) {
-			st->producerCond.wait(lock);
+		while (true) {
+			size_t ticket = st->producerEvents.prepare_wait();
+			if (st->runningWorkers.load() == numJobs) break;
+			st->producerEvents.wait(ticket);
+		}
+		if (st->unpinnedWorkers.load() > 0) {
+			log_debug() << "Could not pin " << st->unpinnedWorkers.load()
+						<< " of " << numJobs << " parallel workers" << std::endl;
 		}
 	}
 
@@ -913,127 +1080,66 @@ public:
 	/// the consumer consume an output buffer to free up a parallel worker.
 	///////////////////////////////////////////////////////////////////////////
 	void push(item_type item) {
-		inputBuffer[written++] = item;
-		if (written < st->opts.bufSize) {
+		m_input->push(item);
+		if (m_input->size() < m_batchSize) {
 			// Wait for more items before doing anything expensive such as
-			// locking.
+			// touching the queues.
 			return;
 		}
-		state_base::lock_t lock(st->mutex);
-
-		flush_steps();
-
-		empty_input_buffer(lock);
+		send_input();
 	}
 
-private:
-	void empty_input_buffer(state_base::lock_t & lock) {
-		while (written > 0) {
-			while (!has_ready_pipe()) {
-				st->producerCond.wait(lock);
-			}
-			switch (st->get_state(readyIdx)) {
-				case INITIALIZING:
-					throw tpie::exception("State 'INITIALIZING' not expected at this point");
-				case IDLE:
-				{
-					// Send buffer to ready worker
-					item_type * first = &inputBuffer[0];
-					item_type * last = first + written;
-					parallel_input_buffer<T1> & dest = *st->m_inputBuffers[readyIdx];
-					dest.set_input(array_view<T1>(first, last));
-					st->transition_state(readyIdx, IDLE, PROCESSING);
-					st->workerCond[readyIdx].notify_one();
-					written = 0;
-					if (st->opts.maintainOrder)
-						m_outputOrder.push(readyIdx);
-					break;
-				}
-				case PROCESSING:
-					throw tpie::exception("State 'processing' not expected at this point");
-				case PARTIAL_OUTPUT:
-					// Receive buffer (virtual invocation)
-					cons->consume(st->m_outputBuffers[readyIdx]->get_output());
-					st->transition_state(readyIdx, PARTIAL_OUTPUT, PROCESSING);
-					st->workerCond[readyIdx].notify_one();
-					break;
-				case OUTPUTTING:
-					// Receive buffer (virtual invocation)
-					cons->consume(st->m_outputBuffers[readyIdx]->get_output());
-
-					st->transition_state(readyIdx, OUTPUTTING, IDLE);
-					st->workerCond[readyIdx].notify_one();
-					if (st->opts.maintainOrder) {
-						if (m_outputOrder.front() != readyIdx) {
-							log_error() << "Producer: Expected " << readyIdx << " in front; got "
-								<< m_outputOrder.front() << std::endl;
-							throw tpie::exception("Producer got wrong entry from has_ready_pipe");
-						}
-						m_outputOrder.pop();
-					}
-					break;
-				case DONE:
-					throw tpie::exception("State 'DONE' not expected at this point");
-			}
-		}
-	}
-
-public:
 	virtual void end() override {
-		state_base::lock_t lock(st->mutex);
-
-		flush_steps();
-
-		empty_input_buffer(lock);
+		if (!m_input->empty()) send_input();
 
-		inputBuffer.resize(0);
+		// Wait for the workers to process all input and for their output to
+		// be consumed. A worker sends its output before it hands back its
+		// input buffer, so once all workers are idle, all output has been
+		// sent.
+		while (true) {
+			size_t ticket = st->producerEvents.prepare_wait();
+			collect_processed();
+			consume_output();
+			if (all_idle() && m_outputOrder.empty()) break;
+			st->producerEvents.wait(ticket);
+		}
+		consume_output();
 
 		st->set_consumer_ptr(cons.get());
+		st->done.store(true, boost::memory_order_release);
 
-		bool done = false;
-		while (!done) {
-			while (!has_outputting_pipe()) {
-				if (!has_processing_pipe()) {
-					done = true;
-					break;
-				}
-				// All items pushed; wait for processors to complete
-				st->producerCond.wait(lock);
-			}
-			if (done) break;
-
-			// virtual invocation
-			cons->consume(st->m_outputBuffers[readyIdx]->get_output());
-
-			if (st->get_state(readyIdx) == PARTIAL_OUTPUT) {
-				st->transition_state(readyIdx, PARTIAL_OUTPUT, PROCESSING);
-				st->workerCond[readyIdx].notify_one();
-				continue;
-			}
-			st->transition_state(readyIdx, OUTPUTTING, IDLE);
-			if (st->opts.maintainOrder) {
-				if (m_outputOrder.front() != readyIdx) {
-					log_error() << "Producer: Expected " << readyIdx << " in front; got "
-						<< m_outputOrder.front() << std::endl;
-					throw tpie::exception("Producer got wrong entry from has_ready_pipe");
-				}
-				m_outputOrder.pop();
-			}
-		}
-		// Notify all workers that all processing is done
+		// Stop all workers
 		for (size_t i = 0; i < st->opts.numJobs; ++i) {
-			st->transition_state(i, IDLE, DONE);
-			st->workerCond[i].notify_one();
-		}
-		while (st->runningWorkers > 0) {
-			st->producerCond.wait(lock);
+			st->m_inputChannels[i].work.try_push(0);
+			st->workerEvents[i].notify();
 		}
+		st->workerThreads.join_all();
 		// All workers terminated
 
+		m_inputBuffers.resize(0);
+		m_freeInputs.resize(0);
+		m_input = 0;
+
+		if (adaptive()) {
+			log_debug() << "Parallel batch size " << m_batchSize
+						<< " of " << st->bufCapacity << " items" << std::endl;
+			if (!m_batchCrumb.empty()) this->get_progress_indicator()->pop_breadcrumb();
+			m_batchCrumb.clear();
+		}
+
 		flush_steps();
 	}
 };
 
+template <typename T1, typename T2>
+const memory_size_type producer<T1, T2>::minAdaptiveBatch;
+
+template <typename T1, typename T2>
+const memory_size_type producer<T1, T2>::maxAdaptiveBatch;
+
+template <typename T1, typename T2>
+const memory_size_type producer<T1, T2>::defaultAdaptiveBatch;
+
 } // namespace parallel_bits
 
 } // namespace pipelining
@@ -20,10 +20,24 @@
 #ifndef __TPIE_PIPELINING_PARALLEL_OPTIONS_H__
 #define __TPIE_PIPELINING_PARALLEL_OPTIONS_H__
 
+#include <tpie/pipelining/worker_placement_type.h>
+
 namespace tpie {
 
 namespace pipelining {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Pass as bufSize to parallel() to let the framework choose the
+/// number of items per batch at run time.
+///
+/// The buffers are sized to the memory assigned to the parallel stage, and
+/// the batches are resized within that capacity based on how long the
+/// workers take to process a batch and how long they wait for one. Without
+/// a memory fraction, the stage is assigned room for batches of 4096 items.
+/// The current batch size is shown as a breadcrumb in the progress indicator.
+///////////////////////////////////////////////////////////////////////////////
+const size_t adaptive_buffer_size = 0;
+
 namespace parallel_bits {
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -32,7 +46,10 @@ namespace parallel_bits {
 struct options {
 	bool maintainOrder;
 	size_t numJobs;
+	/** Items per batch, or adaptive_buffer_size to let the producer choose
+	 * the batch size at run time. */
 	size_t bufSize;
+	worker_placement_type placement;
 };
 
 } // namespace parallel_bits
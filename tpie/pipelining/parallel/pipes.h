@@ -30,11 +30,14 @@ namespace pipelining {
 /// output in the order they are input.
 /// \param numJobs  The number of threads to utilize for parallel execution.
 /// \param bufSize  The number of items to store in the buffer sent between
-/// threads.
+/// threads, or adaptive_buffer_size.
+/// \param placement  Whether to pin the worker threads to processors or NUMA
+/// nodes.
 ///////////////////////////////////////////////////////////////////////////////
 template <typename fact_t>
 pipe_middle<parallel_bits::factory<fact_t> >
-parallel(const pipe_middle<fact_t> & fact, maintain_order_type maintainOrder, size_t numJobs, size_t bufSize = 2048) {
+parallel(const pipe_middle<fact_t> & fact, maintain_order_type maintainOrder, size_t numJobs, size_t bufSize = 2048,
+		 worker_placement_type placement = unpinned_workers) {
 	parallel_bits::options opts;
 	switch (maintainOrder) {
 		case arbitrary_order:
@@ -46,6 +49,7 @@ parallel(const pipe_middle<fact_t> & fact, maintain_order_type maintainOrder, si
 	}
 	opts.numJobs = numJobs;
 	opts.bufSize = bufSize;
+	opts.placement = placement;
 	return pipe_middle<parallel_bits::factory<fact_t> >
 		(parallel_bits::factory<fact_t>
 		 (fact.factory, opts));
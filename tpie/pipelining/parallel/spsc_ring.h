@@ -0,0 +1,155 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+#ifndef __TPIE_PIPELINING_PARALLEL_SPSC_RING_H__
+#define __TPIE_PIPELINING_PARALLEL_SPSC_RING_H__
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+namespace tpie {
+
+namespace pipelining {
+
+namespace parallel_bits {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Bounded lock-free queue between a single producing thread and a
+/// single consuming thread.
+///
+/// One thread may call try_push while another calls try_pop. The read and
+/// write positions are on separate cache lines, so the two threads only
+/// share a cache line when an item is actually handed over.
+///
+/// The parallel framework sends pointers to buffers through these queues, so
+/// the ownership of a buffer moves from one thread to another without
+/// copying its items.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, size_t Capacity>
+class spsc_ring {
+public:
+	spsc_ring()
+		: m_head(0)
+		, m_tail(0)
+	{
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Called by the producing thread.
+	/// \returns  False if the queue is full.
+	///////////////////////////////////////////////////////////////////////////
+	bool try_push(const T & item) {
+		size_t tail = m_tail.load(boost::memory_order_relaxed);
+		if (tail - m_head.load(boost::memory_order_acquire) == Capacity)
+			return false;
+		m_items[tail % Capacity] = item;
+		m_tail.store(tail + 1, boost::memory_order_release);
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Called by the consuming thread.
+	/// \returns  False if the queue is empty.
+	///////////////////////////////////////////////////////////////////////////
+	bool try_pop(T & item) {
+		size_t head = m_head.load(boost::memory_order_relaxed);
+		if (m_tail.load(boost::memory_order_acquire) == head)
+			return false;
+		item = m_items[head % Capacity];
+		m_head.store(head + 1, boost::memory_order_release);
+		return true;
+	}
+
+private:
+	static const size_t cacheLine = 64;
+
+	/** Read position; written by the consuming thread. */
+	boost::atomic<size_t> m_head;
+	char m_headPadding[cacheLine - sizeof(boost::atomic<size_t>)];
+
+	/** Write position; written by the producing thread. */
+	boost::atomic<size_t> m_tail;
+	char m_tailPadding[cacheLine - sizeof(boost::atomic<size_t>)];
+
+	T m_items[Capacity];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Lets a thread sleep until another thread has pushed to one of the
+/// spsc_rings it reads from.
+///
+/// The waiting thread takes a ticket with prepare_wait, checks its queues,
+/// and calls wait with the ticket only if there was nothing to do. A notify
+/// after the ticket was taken makes wait return immediately, so no wakeup is
+/// lost. notify takes the mutex only if a thread is actually waiting.
+///////////////////////////////////////////////////////////////////////////////
+class event_count {
+public:
+	event_count()
+		: m_count(0)
+		, m_waiters(0)
+	{
+	}
+
+	size_t prepare_wait() {
+		return m_count.load(boost::memory_order_seq_cst);
+	}
+
+	void wait(size_t ticket) {
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+		m_waiters.fetch_add(1, boost::memory_order_seq_cst);
+		while (m_count.load(boost::memory_order_seq_cst) == ticket)
+			m_cond.wait(lock);
+		m_waiters.fetch_sub(1, boost::memory_order_relaxed);
+	}
+
+	void notify() {
+		m_count.fetch_add(1, boost::memory_order_seq_cst);
+		if (m_waiters.load(boost::memory_order_seq_cst) == 0) return;
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+		m_cond.notify_all();
+	}
+
+private:
+	boost::atomic<size_t> m_count;
+	boost::atomic<size_t> m_waiters;
+	boost::mutex m_mutex;
+	boost::condition_variable m_cond;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Pop an item from the ring, sleeping on the given event count
+/// while the ring is empty.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, size_t Capacity>
+void pop_or_wait(spsc_ring<T, Capacity> & ring, T & item, event_count & events) {
+	while (!ring.try_pop(item)) {
+		size_t ticket = events.prepare_wait();
+		if (ring.try_pop(item)) return;
+		events.wait(ticket);
+	}
+}
+
+} // namespace parallel_bits
+
+} // namespace pipelining
+
+} // namespace tpie
+
+#endif // __TPIE_PIPELINING_PARALLEL_SPSC_RING_H__
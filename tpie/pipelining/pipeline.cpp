@@ -102,6 +102,7 @@ void pipeline_base::plot_impl(std::ostream & out, bool full) {
 void pipeline_base::operator()(stream_size_type items, progress_indicator_base & pi, const memory_size_type initialMemory) {
 	node_map::ptr map = m_nodeMap->find_authority();
 	runtime rt(map);
+	rt.set_parallel_phases(m_parallelPhases);
 	rt.go(items, pi, initialMemory);
 
 	/*
@@ -38,6 +38,12 @@ namespace bits {
 ///////////////////////////////////////////////////////////////////////////////
 class pipeline_base {
 public:
+	pipeline_base()
+		: m_memory(0)
+		, m_parallelPhases(false)
+	{
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Invoke the pipeline.
 	///////////////////////////////////////////////////////////////////////////
@@ -76,6 +82,14 @@ public:
 		return m_memory;
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Run phases that do not depend on each other concurrently.
+	/// See runtime::set_parallel_phases.
+	///////////////////////////////////////////////////////////////////////////
+	void set_parallel_phases(bool enabled) {
+		m_parallelPhases = enabled;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief Virtual dtor.
 	///////////////////////////////////////////////////////////////////////////
@@ -96,6 +110,7 @@ public:
 protected:
 	node_map::ptr m_nodeMap;
 	double m_memory;
+	bool m_parallelPhases;
 private:
 	void plot_impl(std::ostream & out, bool full);
 };
@@ -167,6 +182,18 @@ public:
 	inline double memory() const {
 		return p->memory();
 	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Run phases that do not depend on each other, such as two
+	/// sorts whose outputs are later joined, at the same time in separate
+	/// threads. The memory is split between concurrent phases.
+	///
+	/// Only enable this if the nodes of independent phases do not share
+	/// unsynchronized state.
+	///////////////////////////////////////////////////////////////////////////
+	void set_parallel_phases(bool enabled = true) {
+		p->set_parallel_phases(enabled);
+	}
 	inline bits::node_map::ptr get_node_map() const {
 		return p->get_node_map();
 	}
@@ -22,6 +22,10 @@
 #include <tpie/pipelining/tokens.h>
 #include <tpie/pipelining/node.h>
 #include <tpie/pipelining/runtime.h>
+#include <tpie/progress_indicator_null.h>
+#include <tpie/exception_ptr.h>
+#include <boost/thread.hpp>
+#include <algorithm>
 
 namespace tpie {
 
@@ -129,7 +133,7 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 class begin_end {
 public:
-	begin_end(graph<node *> & actorGraph) {
+	begin_end(const graph<node *> & actorGraph) {
 		actorGraph.topological_order(m_topologicalOrder);
 	}
 
@@ -155,12 +159,14 @@ private:
 
 memory_runtime::memory_runtime(const std::vector<node *> & nodes)
 	: m_nodes(nodes)
+	, m_minimumMemories(nodes.size())
 	, m_minimumMemory(0)
 	, m_maximumMemory(0)
 	, m_fraction(0.0)
 {
 	const size_t N = m_nodes.size();
 	for (size_t i = 0; i < N; ++i) {
+		m_minimumMemories[i] = m_nodes[i]->get_minimum_memory();
 		m_minimumMemory += minimum_memory(i);
 		m_maximumMemory += maximum_memory(i);
 		m_fraction += fraction(i);
@@ -169,7 +175,7 @@ memory_runtime::memory_runtime(const std::vector<node *> & nodes)
 
 // Node accessors
 memory_size_type memory_runtime::minimum_memory(size_t i) const {
-	return m_nodes[i]->get_minimum_memory();
+	return m_minimumMemories[i];
 }
 
 memory_size_type memory_runtime::maximum_memory(size_t i) const {
@@ -180,6 +186,14 @@ double memory_runtime::fraction(size_t i) const {
 	return m_nodes[i]->get_memory_fraction();
 }
 
+stream_size_type memory_runtime::io_cost(size_t i, memory_size_type mem) const {
+	return m_nodes[i]->get_io_cost(mem);
+}
+
+size_t memory_runtime::node_count() const {
+	return m_nodes.size();
+}
+
 // Node accessor aggregates
 memory_size_type memory_runtime::sum_minimum_memory() const {
 	return m_minimumMemory;
@@ -198,6 +212,12 @@ void memory_runtime::set_memory(size_t i, memory_size_type mem) {
 	m_nodes[i]->set_available_memory(mem);
 }
 
+void memory_runtime::raise_minimum_memory(size_t i, memory_size_type mem) {
+	if (mem <= m_minimumMemories[i]) return;
+	m_minimumMemory += mem - m_minimumMemories[i];
+	m_minimumMemories[i] = mem;
+}
+
 void memory_runtime::assign_memory(double factor) {
 	for (size_t i = 0; i < m_nodes.size(); ++i)
 		set_memory(i, get_assigned_memory(i, factor));
@@ -271,8 +291,51 @@ void memory_runtime::print_memory(double c, std::ostream & os) {
 	os << std::endl;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Runs a phase in a thread of its own, keeping an exception so it
+/// can be rethrown in the main thread.
+///////////////////////////////////////////////////////////////////////////////
+class phase_thread {
+public:
+	phase_thread(runtime & rt,
+				 const std::vector<node *> & phase,
+				 const graph<node *> & itemFlow,
+				 const graph<node *> & actor)
+		: m_rt(rt)
+		, m_phase(phase)
+		, m_itemFlow(itemFlow)
+		, m_actor(actor)
+	{
+	}
+
+	void operator()() {
+		try {
+			m_rt.propagate_all(m_itemFlow);
+			m_rt.set_progress_indicators(m_phase, m_pi);
+			begin_end beginEnd(m_actor);
+			beginEnd.begin();
+			m_rt.go_initiators(m_phase);
+			beginEnd.end();
+		} catch (...) {
+			m_error = tpie::current_exception();
+		}
+	}
+
+	bool failed() const { return static_cast<bool>(m_error); }
+	const boost::exception_ptr & error() const { return m_error; }
+
+private:
+	runtime & m_rt;
+	const std::vector<node *> & m_phase;
+	const graph<node *> & m_itemFlow;
+	const graph<node *> & m_actor;
+	progress_indicator_null m_pi;
+	boost::exception_ptr m_error;
+};
+
 runtime::runtime(node_map::ptr nodeMap)
 	: m_nodeMap(*nodeMap)
+	, m_parallelPhases(false)
 {
 }
 
@@ -280,6 +343,10 @@ size_t runtime::get_node_count() {
 	return m_nodeMap.size();
 }
 
+void runtime::set_parallel_phases(bool enabled) {
+	m_parallelPhases = enabled;
+}
+
 void runtime::go(stream_size_type items,
 				 progress_indicator_base & progress,
 				 memory_size_type memory)
@@ -315,8 +382,29 @@ void runtime::go(stream_size_type items,
 	// and call node::prepare in item source to item sink order
 	prepare_all(itemFlow);
 
-	// Gather node memory requirements and assign memory to each phase
-	assign_memory(phases, memory);
+	// Group the phases that may run concurrently
+	std::vector<std::vector<size_t> > waves;
+	if (m_parallelPhases) {
+		get_phase_waves(phaseMap, phaseGraph, phases, waves);
+	} else {
+		waves.resize(phases.size());
+		for (size_t i = 0; i < phases.size(); ++i) waves[i].push_back(i);
+	}
+
+	// Gather node memory requirements and assign memory to each phase,
+	// splitting it between the phases of a wave
+	if (m_parallelPhases) {
+		std::vector<std::vector<node *> > waveNodes(waves.size());
+		for (size_t i = 0; i < waves.size(); ++i) {
+			for (size_t j = 0; j < waves[i].size(); ++j) {
+				const std::vector<node *> & phase = phases[waves[i][j]];
+				waveNodes[i].insert(waveNodes[i].end(), phase.begin(), phase.end());
+			}
+		}
+		assign_memory(waveNodes, memory);
+	} else {
+		assign_memory(phases, memory);
+	}
 
 	// Exception guarantees are the following:
 	//   Progress indicators:
@@ -335,28 +423,89 @@ void runtime::go(stream_size_type items,
 	progress_indicators pi;
 	pi.init(items, progress, phases);
 
-	for (size_t i = 0; i < phases.size(); ++i) {
-		// Run each phase:
-		// Evacuate previous if necessary
-		if (i > 0 && evacuateWhenDone[i-1]) evacuate_all(phases[i-1]);
-		// call propagate in item source to item sink order
-		propagate_all(itemFlow[i]);
-		// sum number of steps and call pi.init()
-		phase_progress_indicator phaseProgress(pi, i, phases[i]);
-		// set progress indicators on each node
-		set_progress_indicators(phases[i], phaseProgress.get());
-		// call begin in leaf to root actor order
-		begin_end beginEnd(actor[i]);
-		beginEnd.begin();
-		// call go on initiators
-		go_initiators(phases[i]);
-		// call end in root to leaf actor order
-		beginEnd.end();
-		// call pi.done in ~phase_progress_indicator
+	for (size_t w = 0; w < waves.size(); ++w) {
+		// Evacuate the phases of the previous wave whose results are not
+		// needed by this wave
+		if (w > 0 && !m_parallelPhases) {
+			if (evacuateWhenDone[w-1]) evacuate_all(phases[w-1]);
+		} else if (w > 0) {
+			const std::vector<size_t> & prev = waves[w-1];
+			for (size_t i = 0; i < prev.size(); ++i) {
+				size_t u = phaseMap.find(phases[prev[i]][0])->second;
+				bool needed = false;
+				for (size_t j = 0; j < waves[w].size(); ++j) {
+					size_t v = phaseMap.find(phases[waves[w][j]][0])->second;
+					if (phaseGraph.has_edge(u, v)) needed = true;
+				}
+				if (!needed) evacuate_all(phases[prev[i]]);
+			}
+		}
+		run_wave(waves[w], phases, itemFlow, actor, pi);
 	}
 	// call fp->done in ~progress_indicators
 }
 
+void runtime::run_phase(const std::vector<node *> & phase,
+						const graph<node *> & itemFlow,
+						const graph<node *> & actor,
+						progress_indicators & pi,
+						size_t phaseNumber)
+{
+	// call propagate in item source to item sink order
+	propagate_all(itemFlow);
+	// sum number of steps and call pi.init()
+	phase_progress_indicator phaseProgress(pi, phaseNumber, phase);
+	// set progress indicators on each node
+	set_progress_indicators(phase, phaseProgress.get());
+	// call begin in leaf to root actor order
+	begin_end beginEnd(actor);
+	beginEnd.begin();
+	// call go on initiators
+	go_initiators(phase);
+	// call end in root to leaf actor order
+	beginEnd.end();
+	log_io(phase);
+	// call pi.done in ~phase_progress_indicator
+}
+
+void runtime::run_wave(const std::vector<size_t> & wave,
+					   const std::vector<std::vector<node *> > & phases,
+					   const std::vector<graph<node *> > & itemFlow,
+					   const std::vector<graph<node *> > & actor,
+					   progress_indicators & pi)
+{
+	std::vector<phase_thread *> runners;
+	boost::thread_group threads;
+	for (size_t j = 1; j < wave.size(); ++j) {
+		size_t i = wave[j];
+		runners.push_back(new phase_thread(*this, phases[i], itemFlow[i], actor[i]));
+		threads.create_thread(boost::ref(*runners.back()));
+	}
+
+	try {
+		run_phase(phases[wave[0]], itemFlow[wave[0]], actor[wave[0]], pi, wave[0]);
+	} catch (...) {
+		threads.join_all();
+		for (size_t j = 0; j < runners.size(); ++j) delete runners[j];
+		throw;
+	}
+	threads.join_all();
+
+	boost::exception_ptr error;
+	for (size_t j = 1; j < wave.size(); ++j) {
+		size_t i = wave[j];
+		if (runners[j-1]->failed()) {
+			if (!error) error = runners[j-1]->error();
+		} else {
+			// Account for the progress of the phase now that it is done.
+			phase_progress_indicator phaseProgress(pi, i, phases[i]);
+			log_io(phases[i]);
+		}
+		delete runners[j-1];
+	}
+	if (error) boost::rethrow_exception(error);
+}
+
 void runtime::get_item_sources(std::vector<node *> & itemSources) {
 	typedef node_map::id_t id_t;
 	std::set<id_t> possibleSources;
@@ -508,6 +657,33 @@ void runtime::get_phases(const std::map<node *, size_t> & phaseMap,
 	}
 }
 
+void runtime::get_phase_waves(const std::map<node *, size_t> & phaseMap,
+							  const graph<size_t> & phaseGraph,
+							  const std::vector<std::vector<node *> > & phases,
+							  std::vector<std::vector<size_t> > & waves)
+{
+	const size_t N = phases.size();
+	std::vector<size_t> phaseNumber(N);
+	for (size_t i = 0; i < N; ++i)
+		phaseNumber[i] = phaseMap.find(phases[i][0])->second;
+
+	// phases is in topological order, so the wave of each phase is known
+	// before it is needed.
+	std::vector<size_t> wave(N, 0);
+	size_t waveCount = 0;
+	for (size_t j = 0; j < N; ++j) {
+		for (size_t i = 0; i < j; ++i) {
+			if (phaseGraph.has_edge(phaseNumber[i], phaseNumber[j]))
+				wave[j] = std::max(wave[j], wave[i] + 1);
+		}
+		waveCount = std::max(waveCount, wave[j] + 1);
+	}
+
+	waves.clear();
+	waves.resize(waveCount);
+	for (size_t i = 0; i < N; ++i) waves[wave[i]].push_back(i);
+}
+
 void runtime::get_item_flow_graphs(std::vector<std::vector<node *> > & phases,
 								   std::vector<graph<node *> > & itemFlow)
 {
@@ -605,11 +781,24 @@ void runtime::go_initiators(const std::vector<node *> & phase) {
 		initiators[i]->go();
 }
 
+void runtime::log_io(const std::vector<node *> & phase) {
+	for (size_t i = 0; i < phase.size(); ++i) {
+		stream_size_type bytesRead = phase[i]->get_bytes_read();
+		stream_size_type bytesWritten = phase[i]->get_bytes_written();
+		if (bytesRead == 0 && bytesWritten == 0) continue;
+		log_debug() << "Node " << phase[i]->get_name() << " read " << bytesRead
+					<< " bytes and wrote " << bytesWritten << " bytes" << std::endl;
+	}
+}
+
 /*static*/
 void runtime::assign_memory(const std::vector<std::vector<node *> > & phases,
 							memory_size_type memory) {
 	for (size_t i = 0; i < phases.size(); ++i) {
 		memory_runtime rt(phases[i]);
+		stream_size_type io = reserve_io_memory(rt, memory);
+		if (io > 0)
+			log_debug() << "Predicted I/O of phase " << i << ": " << io << " bytes" << std::endl;
 		double c = get_memory_factor(rt, memory);
 #ifndef TPIE_NDEBUG
 		rt.print_memory(c, log_debug());
@@ -618,6 +807,87 @@ void runtime::assign_memory(const std::vector<std::vector<node *> > & phases,
 	}
 }
 
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief  Predicted I/O of a node at increasing amounts of memory.
+///////////////////////////////////////////////////////////////////////////////
+struct io_cost_curve {
+	size_t node;
+	std::vector<memory_size_type> memory;
+	std::vector<stream_size_type> cost;
+	// Index of the amount of memory reserved so far
+	size_t reserved;
+};
+
+} // unnamed namespace
+
+/*static*/
+stream_size_type runtime::reserve_io_memory(memory_runtime & rt,
+											memory_size_type memory) {
+	if (rt.sum_minimum_memory() >= memory) return 0;
+	memory_size_type spare = memory - rt.sum_minimum_memory();
+
+	// Sample the cost of each node at a geometric sequence of amounts of
+	// memory from its maximum down to its minimum.
+	std::vector<io_cost_curve> curves;
+	stream_size_type totalCost = 0;
+	for (size_t i = 0; i < rt.node_count(); ++i) {
+		memory_size_type lo = rt.minimum_memory(i);
+		memory_size_type hi = std::min(rt.maximum_memory(i), lo + spare);
+		stream_size_type loCost = rt.io_cost(i, lo);
+		totalCost += loCost;
+		if (loCost == 0 || hi <= lo) continue;
+
+		io_cost_curve c;
+		c.node = i;
+		c.reserved = 0;
+		for (memory_size_type m = hi; m > lo; m -= m / 8 + 1)
+			c.memory.push_back(m);
+		c.memory.push_back(lo);
+		std::reverse(c.memory.begin(), c.memory.end());
+		bool sensitive = false;
+		for (size_t j = 0; j < c.memory.size(); ++j) {
+			c.cost.push_back(j == 0 ? loCost : rt.io_cost(i, c.memory[j]));
+			if (c.cost[j] < loCost) sensitive = true;
+		}
+		if (sensitive) curves.push_back(c);
+	}
+
+	while (true) {
+		double bestRatio = 0.0;
+		size_t bestCurve = 0;
+		size_t bestIndex = 0;
+		for (size_t k = 0; k < curves.size(); ++k) {
+			const io_cost_curve & c = curves[k];
+			memory_size_type m = c.memory[c.reserved];
+			stream_size_type cost = c.cost[c.reserved];
+			for (size_t j = c.reserved + 1; j < c.memory.size(); ++j) {
+				if (c.memory[j] - m > spare) break;
+				if (c.cost[j] >= cost) continue;
+				double ratio = static_cast<double>(cost - c.cost[j])
+					/ static_cast<double>(c.memory[j] - m);
+				if (ratio > bestRatio) {
+					bestRatio = ratio;
+					bestCurve = k;
+					bestIndex = j;
+				}
+			}
+		}
+		if (bestRatio == 0.0) break;
+
+		io_cost_curve & c = curves[bestCurve];
+		spare -= c.memory[bestIndex] - c.memory[c.reserved];
+		totalCost -= c.cost[c.reserved] - c.cost[bestIndex];
+		c.reserved = bestIndex;
+	}
+
+	for (size_t k = 0; k < curves.size(); ++k)
+		rt.raise_minimum_memory(curves[k].node, curves[k].memory[curves[k].reserved]);
+
+	return totalCost;
+}
+
 /*static*/
 double runtime::get_memory_factor(const memory_runtime & rt,
 								  memory_size_type memory) {
@@ -119,6 +119,8 @@ public:
 	memory_size_type minimum_memory(size_t i) const;
 	memory_size_type maximum_memory(size_t i) const;
 	double fraction(size_t i) const;
+	stream_size_type io_cost(size_t i, memory_size_type mem) const;
+	size_t node_count() const;
 
 	// Node accessor aggregates
 	memory_size_type sum_minimum_memory() const;
@@ -128,6 +130,9 @@ public:
 	// Node mutator
 	void set_memory(size_t i, memory_size_type mem);
 
+	// Assign at least the given amount of memory to the node
+	void raise_minimum_memory(size_t i, memory_size_type mem);
+
 	void assign_memory(double factor);
 
 	// Special case of assign_memory when factor is zero.
@@ -144,16 +149,20 @@ public:
 
 private:
 	const std::vector<node *> & m_nodes;
+	std::vector<memory_size_type> m_minimumMemories;
 	memory_size_type m_minimumMemory;
 	memory_size_type m_maximumMemory;
 	double m_fraction;
 };
 
+class progress_indicators;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief  Execute the pipeline contained in a node_map.
 ///////////////////////////////////////////////////////////////////////////////
 class runtime {
 	node_map & m_nodeMap;
+	bool m_parallelPhases;
 
 public:
 	///////////////////////////////////////////////////////////////////////////
@@ -170,6 +179,17 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	size_t get_node_count();
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Run phases that do not depend on each other concurrently.
+	///
+	/// When enabled, go() groups the phases into waves, in which no phase
+	/// depends on another, and runs the phases of a wave in separate
+	/// threads. The memory is split between the phases of a wave as if they
+	/// were a single phase. The nodes of phases in the same wave must not
+	/// share unsynchronized state.
+	///////////////////////////////////////////////////////////////////////////
+	void set_parallel_phases(bool enabled);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Execute the pipeline.
 	///
@@ -244,6 +264,18 @@ public:
 					std::vector<bool> & evacuateWhenDone,
 					std::vector<std::vector<node *> > & phases);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Group the phases into waves that can run concurrently.
+	///
+	/// The phases are numbered as in the result of get_phases. A phase is in
+	/// the wave following the latest wave of the phases it depends on, so no
+	/// phase depends on a phase in the same or a later wave.
+	///////////////////////////////////////////////////////////////////////////
+	void get_phase_waves(const std::map<node *, size_t> & phaseMap,
+						 const graph<size_t> & phaseGraph,
+						 const std::vector<std::vector<node *> > & phases,
+						 std::vector<std::vector<size_t> > & waves);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
 	///////////////////////////////////////////////////////////////////////////
@@ -309,12 +341,52 @@ public:
 	///////////////////////////////////////////////////////////////////////////
 	void go_initiators(const std::vector<node *> & phase);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Call propagate, begin, go and end on the nodes of a phase.
+	///////////////////////////////////////////////////////////////////////////
+	void run_phase(const std::vector<node *> & phase,
+				   const graph<node *> & itemFlow,
+				   const graph<node *> & actor,
+				   progress_indicators & pi,
+				   size_t phaseNumber);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Run the phases of a wave, all but the first in new threads.
+	///
+	/// The phases in other threads report no progress while they run; their
+	/// progress is reported when they are done.
+	///////////////////////////////////////////////////////////////////////////
+	void run_wave(const std::vector<size_t> & wave,
+				  const std::vector<std::vector<node *> > & phases,
+				  const std::vector<graph<node *> > & itemFlow,
+				  const std::vector<graph<node *> > & actor,
+				  progress_indicators & pi);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Log the I/O reported by the nodes in the phase.
+	///////////////////////////////////////////////////////////////////////////
+	void log_io(const std::vector<node *> & phase);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by go().
 	///////////////////////////////////////////////////////////////////////////
 	static void assign_memory(const std::vector<std::vector<node *> > & phases,
 							  memory_size_type memory);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Raise the minimum memory of the nodes that predict less I/O
+	/// with more memory.
+	///
+	/// Internal method used by assign_memory(). The memory above the sum of
+	/// the minimums is handed out greedily, each time to the node and amount
+	/// that remove the most predicted I/O per byte, as reported by
+	/// node::get_io_cost. The memory that is left is split by
+	/// get_memory_factor as usual.
+	/// \returns  The predicted I/O of the nodes of the phase in bytes.
+	///////////////////////////////////////////////////////////////////////////
+	static stream_size_type reserve_io_memory(memory_runtime & rt,
+											  memory_size_type memory);
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Internal method used by assign_memory().
 	///////////////////////////////////////////////////////////////////////////
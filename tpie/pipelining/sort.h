@@ -30,6 +30,7 @@
 #include <tpie/memory.h>
 #include <queue>
 #include <boost/shared_ptr.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 
 namespace tpie {
 
@@ -37,6 +38,39 @@ namespace pipelining {
 
 namespace bits {
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The I/O of a merge sorter since the beginning of the phase of a
+/// sort node, which the node reports as its own I/O.
+///////////////////////////////////////////////////////////////////////////////
+class sorter_io_since_begin {
+public:
+	sorter_io_since_begin()
+		: m_bytesRead(0)
+		, m_bytesWritten(0)
+	{
+	}
+
+	template <typename sorter_t>
+	void begin(const sorter_t & sorter) {
+		m_bytesRead = sorter.get_bytes_read();
+		m_bytesWritten = sorter.get_bytes_written();
+	}
+
+	template <typename sorter_t>
+	stream_size_type bytes_read(const sorter_t & sorter) const {
+		return sorter.get_bytes_read() - m_bytesRead;
+	}
+
+	template <typename sorter_t>
+	stream_size_type bytes_written(const sorter_t & sorter) const {
+		return sorter.get_bytes_written() - m_bytesWritten;
+	}
+
+private:
+	stream_size_type m_bytesRead;
+	stream_size_type m_bytesWritten;
+};
+
 template <typename T, typename pred_t>
 class sort_calc_t;
 
@@ -62,6 +96,17 @@ public:
 		add_dependency(calc);
 	}
 
+	virtual void begin() override {
+		node::begin();
+		m_io.begin(*m_sorter);
+	}
+
+	virtual void end() override {
+		node::end();
+		add_bytes_read(m_io.bytes_read(*m_sorter));
+		add_bytes_written(m_io.bytes_written(*m_sorter));
+	}
+
 protected:
 	sort_output_base(pred_t pred)
 		: m_sorter(new sorter_t(pred))
@@ -69,6 +114,9 @@ protected:
 	}
 
 	sorterptr m_sorter;
+
+private:
+	sorter_io_since_begin m_io;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -121,6 +169,10 @@ public:
 		throw not_initiator_node();
 	}
 
+	virtual stream_size_type get_io_cost(memory_size_type memory) override {
+		return this->m_sorter->predict_io_phase_3(memory);
+	}
+
 protected:
 	virtual void set_available_memory(memory_size_type availableMemory) override {
 		node::set_available_memory(availableMemory);
@@ -164,11 +216,17 @@ public:
 
 	virtual void go() override {
 		while (this->m_sorter->can_pull()) {
-			dest.push(this->m_sorter->pull());
-			this->step();
+			array_view<const item_type> items = this->m_sorter->pull_block();
+			push_block(items, boost::integral_constant<bool,
+					   accepts_range_push<dest_t, block_iterator>::value>());
+			this->step(items.size());
 		}
 	}
 
+	virtual stream_size_type get_io_cost(memory_size_type memory) override {
+		return this->m_sorter->predict_io_phase_3(memory);
+	}
+
 protected:
 	virtual void set_available_memory(memory_size_type availableMemory) override {
 		node::set_available_memory(availableMemory);
@@ -176,6 +234,24 @@ protected:
 	}
 
 private:
+	typedef typename array_view<const item_type>::iterator block_iterator;
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Push a block in one call to a destination with
+	/// push(begin, end).
+	///////////////////////////////////////////////////////////////////////////
+	void push_block(const array_view<const item_type> & items, boost::true_type) {
+		dest.push(items.begin(), items.end());
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Push the items of a block one at a time.
+	///////////////////////////////////////////////////////////////////////////
+	void push_block(const array_view<const item_type> & items, boost::false_type) {
+		for (block_iterator i = items.begin(); i != items.end(); ++i)
+			dest.push(*i);
+	}
+
 	dest_t dest;
 };
 
@@ -229,11 +305,22 @@ public:
 		set_steps(1000);
 	}
 
+	virtual void begin() override {
+		node::begin();
+		m_io.begin(*m_sorter);
+	}
+
 	virtual void go() override {
 		progress_indicator_base * pi = proxy_progress_indicator();
 		m_sorter->calc(*pi);
 	}
 
+	virtual void end() override {
+		node::end();
+		add_bytes_read(m_io.bytes_read(*m_sorter));
+		add_bytes_written(m_io.bytes_written(*m_sorter));
+	}
+
 	virtual bool can_evacuate() override {
 		return true;
 	}
@@ -242,6 +329,10 @@ public:
 		m_sorter->evacuate_before_reporting();
 	}
 
+	virtual stream_size_type get_io_cost(memory_size_type memory) override {
+		return m_sorter->predict_io_phase_2(memory);
+	}
+
 	sorterptr get_sorter() const {
 		return m_sorter;
 	}
@@ -259,6 +350,7 @@ protected:
 private:
 	sorterptr m_sorter;
 	boost::shared_ptr<Output> dest;
+	sorter_io_since_begin m_io;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -287,12 +379,26 @@ public:
 		set_plot_options(PLOT_BUFFERED | PLOT_SIMPLIFIED_HIDE);
 	}
 
+	virtual void prepare() override {
+		if (this->can_fetch("items"))
+			m_sorter->set_item_estimate(this->fetch<stream_size_type>("items"));
+	}
+
+	virtual stream_size_type get_io_cost(memory_size_type memory) override {
+		return m_sorter->predict_io_phase_1(memory);
+	}
+
 	virtual void propagate() override {
 		if (this->can_fetch("items"))
 			m_sorter->set_items(this->fetch<stream_size_type>("items"));
 		m_sorter->begin();
 	}
 
+	virtual void begin() override {
+		node::begin();
+		m_io.begin(*m_sorter);
+	}
+
 	inline void push(const item_type & item) {
 		m_sorter->push(item);
 	}
@@ -300,6 +406,8 @@ public:
 	virtual void end() override {
 		node::end();
 		m_sorter->end();
+		add_bytes_read(m_io.bytes_read(*m_sorter));
+		add_bytes_written(m_io.bytes_written(*m_sorter));
 	}
 
 	virtual bool can_evacuate() override {
@@ -319,6 +427,7 @@ protected:
 private:
 	sorterptr m_sorter;
 	sort_calc_t<T, pred_t> dest;
+	sorter_io_since_begin m_io;
 };
 
 template <typename child_t>
@@ -38,11 +38,18 @@ struct sort_parameters {
 	 * that we can have in internal memory.
 	 */
 	memory_size_type runLength;
+	/** Number of run buffers of runLength items used during phase 1.
+	 * With two buffers, a full run is sorted and written in the background
+	 * while the other buffer is filled. */
+	memory_size_type runBuffers;
 	/** Maximum item count for internal reporting, subject to memory
 	 * restrictions in all phases. Less or equal to runLength. */
 	memory_size_type internalReportThreshold;
 	/** Fanout of merge tree during phase 3. */
 	memory_size_type fanout;
+	/** Number of merges of fanout runs that run at the same time in the
+	 * merge phase, each using a share of its memory. */
+	memory_size_type mergeJobs;
 	/** Fanout of merge tree during phase 4. Less or equal to fanout. */
 	memory_size_type finalFanout;
 
@@ -50,8 +57,10 @@ struct sort_parameters {
 		out << "Merge sort parameters\n"
 			<< "Phase 1 memory:              " << memoryPhase1 << '\n'
 			<< "Run length:                  " << runLength << '\n'
+			<< "Run buffers:                 " << runBuffers << '\n'
 			<< "Phase 2 memory:              " << memoryPhase2 << '\n'
 			<< "Fanout:                      " << fanout << '\n'
+			<< "Merge jobs:                  " << mergeJobs << '\n'
 			<< "Phase 3 memory:              " << memoryPhase3 << '\n'
 			<< "Final merge level fanout:    " << finalFanout << '\n'
 			<< "Internal report threshold:   " << internalReportThreshold << '\n';
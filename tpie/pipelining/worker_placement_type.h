@@ -1,6 +1,6 @@
 // -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
 // vi:set ts=4 sts=4 sw=4 noet :
-// Copyright 2013, The TPIE development team
+// Copyright 2014, The TPIE development team
 // 
 // This file is part of TPIE.
 // 
@@ -16,44 +16,32 @@
 // 
 // You should have received a copy of the GNU Lesser General Public License
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
-
-#ifndef __TPIE_PIPELINING_PARALLEL_WORKER_STATE_H__
-#define __TPIE_PIPELINING_PARALLEL_WORKER_STATE_H__
-
-namespace tpie {
-
-namespace pipelining {
-
-namespace parallel_bits {
+#ifndef __TPIE_PIPELINING_WORKER_PLACEMENT_TYPE_H__
+#define __TPIE_PIPELINING_WORKER_PLACEMENT_TYPE_H__
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief  States of the parallel worker state machine.
+/// \file worker_placement_type.h  Where to run the workers of parallel.
 ///////////////////////////////////////////////////////////////////////////////
-enum worker_state {
-	/** The input is being written by the producer. */
-	INITIALIZING,
 
-	/** The input is being written by the producer. */
-	IDLE,
-
-	/** The worker is writing output. */
-	PROCESSING,
-
-	/** The worker has filled its output buffer, but has not yet consumed the
-	 * input buffer. */
-	PARTIAL_OUTPUT,
+namespace tpie {
 
-	/** The output is being read by the consumer. */
-	OUTPUTTING,
+namespace pipelining {
 
-	/** The worker thread is done. */
-	DONE
+/** Type describing how the worker threads of parallel are bound to
+ * processors. A bound worker allocates its output buffers after it has been
+ * pinned, so they are placed in memory local to its processor. */
+enum worker_placement_type {
+	/** Let the operating system schedule the workers. */
+	unpinned_workers,
+	/** Pin worker i to processor i modulo the number of processors. */
+	pin_workers_to_cpus,
+	/** Pin worker i to the processors of NUMA node i modulo the number of
+	 * nodes, spreading the workers evenly over the sockets. */
+	pin_workers_to_numa_nodes
 };
 
-} // namespace parallel_bits
-
 } // namespace pipelining
 
 } // namespace tpie
 
-#endif // __TPIE_PIPELINING_PARALLEL_WORKER_STATE_H__
+#endif // __TPIE_PIPELINING_WORKER_PLACEMENT_TYPE_H__
@@ -52,6 +52,22 @@ public:
     ///////////////////////////////////////////////////////////////////////////
     void push(const T& x);
 
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Insert the elements of [start, end) and restore the heap order
+    /// in linear time.
+    ///
+    /// \param start Random access iterator to the first element.
+    /// \param end Random access iterator past the last element.
+    ///////////////////////////////////////////////////////////////////////////
+    template <typename IT>
+    void push(const IT & start, const IT & end);
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Returns the number of elements that can be inserted before the
+    /// queue is full.
+    ///////////////////////////////////////////////////////////////////////////
+    memory_size_type free_space() const;
+
     ///////////////////////////////////////////////////////////////////////////
     /// \brief Remove the top element from the priority queue.
     ///////////////////////////////////////////////////////////////////////////
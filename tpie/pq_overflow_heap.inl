@@ -33,6 +33,18 @@ inline void pq_overflow_heap<T, Comparator>::push(const T& x) {
 	h.push(x);
 }
 
+template<typename T, typename Comparator>
+template<typename IT>
+inline void pq_overflow_heap<T, Comparator>::push(const IT & start, const IT & end) {
+	assert(static_cast<memory_size_type>(end - start) <= free_space());
+	h.insert(start, end);
+}
+
+template<typename T, typename Comparator>
+inline memory_size_type pq_overflow_heap<T, Comparator>::free_space() const {
+	return maxsize - h.size();
+}
+
 template<typename T, typename Comparator>
 inline void pq_overflow_heap<T, Comparator>::pop() {
 	assert(!empty());
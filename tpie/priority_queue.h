@@ -36,6 +36,7 @@
 #include <cmath>
 #include <string>
 #include <cstring> // for memcpy
+#include <algorithm>
 #include <sstream>
 #include "pq_merge_heap.h"
 #include <tpie/err.h>
@@ -83,13 +84,20 @@ public:
 	///
 	/// \param f Factor of memory that the priority queue is allowed to use.
 	/// \param b Block factor
+	/// \param compressionFlags Compression of the slot and group files.
+	/// Compressed streams can only seek to remembered positions, so with
+	/// compression the group buffers on disk are rewritten instead of
+	/// appended to circularly.
 	///////////////////////////////////////////////////////////////////////////
-	priority_queue(double f=1.0, float b=0.0625);
+	priority_queue(double f=1.0, float b=0.0625,
+				   compression_flags compressionFlags=compression_none);
 
 #ifndef DOXYGEN
 	// \param mmavail Number of bytes the priority queue is allowed to use.
 	// \param b Block factor
-	priority_queue(memory_size_type mm_avail, float b=0.0625);
+	// \param compressionFlags Compression of the slot and group files.
+	priority_queue(memory_size_type mm_avail, float b=0.0625,
+				   compression_flags compressionFlags=compression_none);
 #endif
 
 
@@ -109,6 +117,51 @@ public:
     /////////////////////////////////////////////////////////
     void push(const T& x);
 
+    /////////////////////////////////////////////////////////
+    ///
+    /// Insert the elements of [begin, end) into the priority queue
+    ///
+    /// The elements are added to the insertion buffer a block
+    /// at a time, and the insertion buffer is flushed to group 0
+    /// whenever it is full.
+    ///
+    /// \param begin Random access iterator to the first element
+    /// \param end Random access iterator past the last element
+    ///
+    /////////////////////////////////////////////////////////
+    template <typename IT>
+    void push(IT begin, IT end);
+
+    /////////////////////////////////////////////////////////
+    ///
+    /// Insert a sorted run of elements directly into group 0,
+    /// bypassing the insertion buffer
+    ///
+    /// This lets elements that were collected and sorted
+    /// elsewhere, e.g. by another thread, join the queue in a
+    /// single merge.
+    ///
+    /// \param arr The elements in priority order; overwritten
+    /// \param len Number of elements, at most max_run_size()
+    ///
+    /////////////////////////////////////////////////////////
+    void push_sorted_run(T * arr, memory_size_type len);
+
+    /////////////////////////////////////////////////////////
+    ///
+    /// Returns the largest run accepted by push_sorted_run,
+    /// which is the size of the insertion buffer
+    ///
+    /////////////////////////////////////////////////////////
+    memory_size_type max_run_size() const;
+
+    /////////////////////////////////////////////////////////
+    ///
+    /// Returns the comparator that orders the queue
+    ///
+    /////////////////////////////////////////////////////////
+    const Comparator & get_comparator() const;
+
     /////////////////////////////////////////////////////////
     ///
     /// Remove the top element from the priority queue
@@ -156,6 +209,37 @@ public:
     /////////////////////////////////////////////////////////
     template <typename F> F pop_equals(F f);
 
+    /////////////////////////////////////////////////////////
+    ///
+    /// Pop up to n elements in priority order.
+    ///
+    /// Runs of elements in the deletion buffer are copied to the
+    /// output as blocks.
+    ///
+    /// \param n Maximum number of elements to pop
+    /// \param out Output iterator receiving the popped elements
+    ///
+    /// \return The output iterator past the last popped element
+    ///
+    /////////////////////////////////////////////////////////
+    template <typename OutputIterator>
+    OutputIterator pop_n(stream_size_type n, OutputIterator out);
+
+    /////////////////////////////////////////////////////////
+    ///
+    /// Pop all elements that have a higher priority than key,
+    /// that is, the elements x for which comp(x, key) holds,
+    /// in priority order.
+    ///
+    /// \param key The bound
+    /// \param out Output iterator receiving the popped elements
+    ///
+    /// \return The output iterator past the last popped element
+    ///
+    /////////////////////////////////////////////////////////
+    template <typename OutputIterator>
+    OutputIterator pop_all_less_than(const T & key, OutputIterator out);
+
 private:
     Comparator comp_;
     T dummy;
@@ -183,10 +267,17 @@ private:
 	 * Its data is in data file index slot_state[3*i+2]. */
 	tpie::array<memory_size_type> slot_state;
 
-	/** 2*(#groups) integers. Group buffer i has its elements in cyclic ascending order,
-	 * starting at index group_state[2*i]. Gbuffer i contains group_state[2*i+1] elements. */
+	/** 3*(#groups) integers. Group buffer i has its elements in cyclic ascending order,
+	 * starting at index group_state[3*i]. Gbuffer i contains group_state[3*i+1] elements.
+	 * Its data is in group data file index group_state[3*i+2]. */
 	tpie::array<memory_size_type> group_state;
 
+	/** With compression, the stream position of the first element of each
+	 * slot and of each group buffer, since compressed streams cannot seek
+	 * to an offset. Empty without compression. */
+	tpie::array<stream_position> slot_positions;
+	tpie::array<stream_position> group_positions;
+
 	/** k, the fanout of each group and the max fanout R. */
 	memory_size_type setting_k;
 	/** Number of groups in use. */
@@ -203,6 +294,7 @@ private:
     memory_size_type buffer_start;
 
 	float block_factor;
+	compression_flags m_compressionFlags;
 
 	void init(memory_size_type mm_avail);
 
@@ -221,6 +313,12 @@ private:
     temp_file & slot_data(slot_type slotid);
     void slot_data_set(slot_type slotid, memory_size_type n);
     temp_file & group_data(group_type groupid);
+    bool use_compression() const;
+    void open_slot(file_stream<T> & stream, slot_type slotid);
+    T read_slot(file_stream<T> & stream, slot_type slotid);
+    void open_group(file_stream<T> & stream, group_type groupid);
+    T read_group(file_stream<T> & stream, group_type groupid);
+    void rewrite_group(file_stream<T> & out, group_type groupid);
     memory_size_type slot_max_size(slot_type slotid);
     void write_slot(slot_type slotid, T* arr, memory_size_type len);
     slot_type free_slot(group_type group);
@@ -230,6 +328,12 @@ private:
     void compact(slot_type slot);
     void validate();
     void remove_group_buffer(group_type group);
+    void flush_insertion_buffer();
+    void insert_run(T * arr, memory_size_type len);
+    template <typename OutputIterator>
+    OutputIterator pop_bounded(stream_size_type n, const T * key, OutputIterator out);
+    void linearize_group_buffer_0();
+    void merge_sorted(T * low, memory_size_type lowSize, T * high, memory_size_type highSize);
     void dump();
 };
 
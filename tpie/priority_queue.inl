@@ -18,8 +18,8 @@
 // along with TPIE.  If not, see <http://www.gnu.org/licenses/>
 
 template<typename T, typename Comparator, typename OPQType>
-priority_queue<T, Comparator, OPQType>::priority_queue(double f, float b) :
-block_factor(b) { // constructor mem fraction
+priority_queue<T, Comparator, OPQType>::priority_queue(double f, float b, compression_flags compressionFlags) :
+block_factor(b), m_compressionFlags(compressionFlags) { // constructor mem fraction
 	assert(f<= 1.0 && f > 0);
 	assert(b > 0.0);
 	memory_size_type mm_avail = consecutive_memory_available();
@@ -32,8 +32,8 @@ block_factor(b) { // constructor mem fraction
 
 #ifndef DOXYGEN
 template<typename T, typename Comparator, typename OPQType>
-priority_queue<T, Comparator, OPQType>::priority_queue(memory_size_type mm_avail, float b) :
-block_factor(b) { // constructor absolute mem
+priority_queue<T, Comparator, OPQType>::priority_queue(memory_size_type mm_avail, float b, compression_flags compressionFlags) :
+block_factor(b), m_compressionFlags(compressionFlags) { // constructor absolute mem
 	assert(mm_avail <= get_memory_manager().limit() && mm_avail > 0);
 	assert(b > 0.0);
 	TP_LOG_DEBUG("priority_queue: Memory limit: " 
@@ -65,11 +65,16 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail) { /
 		memory_size_type alloc_overhead = 0;
 
 
+		//Stream positions of slots and group buffers are only kept with compression
+		const memory_size_type position_overhead = use_compression() ? sizeof(stream_position) : 0;
+
 		//Compute overhead of the parameters
-		const memory_size_type fanout_overhead = 2*sizeof(stream_size_type)// group state
+		const memory_size_type fanout_overhead = 3*sizeof(stream_size_type)// group state
+			+ position_overhead //group_positions
 			+ (usage+sizeof(file_stream<T>*)+alloc_overhead) //temporary streams
 			+ (sizeof(T)+sizeof(group_type)); //mergeheap
-		const memory_size_type sq_fanout_overhead = 3*sizeof(stream_size_type); //slot_state
+		const memory_size_type sq_fanout_overhead = 3*sizeof(stream_size_type) //slot_state
+			+ position_overhead; //slot_positions
 		const memory_size_type heap_m_overhead = sizeof(T) //opg
 			+ sizeof(T) //gbuffer0
 			+ sizeof(T) //extra buffer for remove_group_buffer
@@ -174,9 +179,13 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail) { /
 	opq.reset(tpie_new<OPQType>(setting_m));
 	assert(OPQType::sorted_factor == 1);
 
-	// state arrays contain: start + size
+	// state arrays contain: start + size + data file index
 	slot_state.resize(setting_k*setting_k*3);
-	group_state.resize(setting_k*2);
+	group_state.resize(setting_k*3);
+	if(use_compression()) {
+		slot_positions.resize(setting_k*setting_k, stream_position::beginning());
+		group_positions.resize(setting_k, stream_position::beginning());
+	}
 
 	buffer.resize(setting_mmark);
 	gbuffer0.resize(setting_m);
@@ -190,14 +199,17 @@ void priority_queue<T, Comparator, OPQType>::init(memory_size_type mm_avail) { /
 	}
 	slot_data_id = setting_k*setting_k+1;
 
-	for(memory_size_type i = 0; i< setting_k*2; i++) {
-		group_state[i] = 0;
+	for(memory_size_type i = 0; i< setting_k; i++) {
+		group_state[i*3] = 0;
+		group_state[i*3+1] = 0;
+		group_state[i*3+2] = i;
 	}
 
 	std::stringstream ss;
 	ss << tempname::tpie_name("pq_data");
 	datafiles.resize(setting_k*setting_k);
-	groupdatafiles.resize(setting_k);
+	// with compression, each group buffer alternates between two files
+	groupdatafiles.resize(use_compression() ? setting_k*2 : setting_k);
 	TP_LOG_DEBUG("memory after alloc: " 
 				 << get_memory_manager().available() << "b" << "\n");
 }
@@ -214,84 +226,110 @@ priority_queue<T, Comparator, OPQType>::~priority_queue() { // destructor
 
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::push(const T& x) {
-
 	if(opq->full()) {
-		// When the overflow priority queue (aka. insertion buffer) is full,
-		// insert its contents into a new slot in group 0.
-		//
-		// To maintain the heap invariant
-		//     deletion buffer <= group buffer 0 <= group 0 slots
-		// we bubble lesser elements from insertion buffer down into
-		// deletion buffer and group buffer 0.
-
-		slot_type slot = free_slot(0); // (if group 0 is full, we recursively empty group i
-		                               // by merging it into a slot in group i+1)
-
-		assert(opq->sorted_size() == setting_m);
-		T* arr = opq->sorted_array();
-
-		// Bubble lesser elements down into deletion buffer
-		if(buffer_size > 0) {
-
-			// fetch insertion buffer
-			memcpy(&mergebuffer[0], &arr[0], sizeof(T)*opq->sorted_size());
-
-			// fetch deletion buffer
-			memcpy(&mergebuffer[opq->sorted_size()], &buffer[buffer_start], sizeof(T)*buffer_size);
-
-			// sort buffer elements
-			std::sort(mergebuffer.get(), mergebuffer.get()+(buffer_size+opq->sorted_size()), comp_);
+		flush_insertion_buffer();
+	}
 
-			// smaller elements go in deletion buffer
-			memcpy(buffer.get()+buffer_start, mergebuffer.get(), sizeof(T)*buffer_size);
+	// insertion buffer is non-full. insert element.
+	opq->push(x);
+	m_size++;
+#ifndef NDEBUG
+	validate();
+#endif
+}
 
-			// larger elements go in insertion buffer
-			memcpy(&arr[0], mergebuffer.get()+buffer_size, sizeof(T)*opq->sorted_size());
+template <typename T, typename Comparator, typename OPQType>
+template <typename IT>
+void priority_queue<T, Comparator, OPQType>::push(IT begin, IT end) {
+	while(begin != end) {
+		if(opq->full()) {
+			flush_insertion_buffer();
 		}
 
-		// Bubble lesser elements down into group buffer 0
-		if(group_size(0)> 0) {
-
-			// Merge insertion buffer and group buffer 0
-			assert(group_size(0)+opq->sorted_size() <= setting_m*2);
-			memory_size_type j = 0;
-
-			// fetch gbuffer0
-			for(stream_size_type i = group_start(0); i < group_start(0)+group_size(0); i++) {
-				mergebuffer[j] = gbuffer0[static_cast<memory_size_type>(i%setting_m)];
-				++j;
-			}
-
-			// fetch insertion buffer
-			memcpy(&mergebuffer[j], &arr[0], sizeof(T)*opq->sorted_size());
+		// fill the insertion buffer with as many elements as it can take
+		memory_size_type n = opq->free_space();
+		if(static_cast<memory_size_type>(end - begin) < n) {
+			n = static_cast<memory_size_type>(end - begin);
+		}
+		opq->push(begin, begin + n);
+		m_size += n;
+		begin += n;
+	}
+#ifndef NDEBUG
+	validate();
+#endif
+}
 
-			// sort
-			std::sort(mergebuffer.get(), mergebuffer.get()+(group_size(0)+opq->sorted_size()), comp_);
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::push_sorted_run(T * arr, memory_size_type len) {
+	if(len == 0) {
+		return;
+	}
+	if(len > setting_m) {
+		throw priority_queue_error("push_sorted_run() given more than max_run_size() elements");
+	}
+	insert_run(arr, len);
+	m_size += len;
+#ifndef NDEBUG
+	validate();
+#endif
+}
 
-			// smaller elements go in gbuffer0
-			memcpy(gbuffer0.get(), mergebuffer.get(), static_cast<size_t>(sizeof(T)*group_size(0)));
-			group_start_set(0,0);
+template <typename T, typename Comparator, typename OPQType>
+memory_size_type priority_queue<T, Comparator, OPQType>::max_run_size() const {
+	return setting_m;
+}
 
-			// larger elements go in insertion buffer (actually a free group 0 slot)
-			memcpy(&arr[0], &mergebuffer[group_size(0)], sizeof(T)*opq->sorted_size());
-		}
+template <typename T, typename Comparator, typename OPQType>
+const Comparator & priority_queue<T, Comparator, OPQType>::get_comparator() const {
+	return comp_;
+}
 
-		// move insertion buffer (which has elements larger than all of
-		// gbuffer0 and deletion buffer) into a free group 0 slot
+// When the overflow priority queue (aka. insertion buffer) is full,
+// insert its contents into a new slot in group 0.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::flush_insertion_buffer() {
+	assert(opq->sorted_size() == setting_m);
+	insert_run(opq->sorted_array(), opq->sorted_size());
+	opq->sorted_pop();
 
-		write_slot(slot, arr, opq->sorted_size());
-		opq->sorted_pop();
+	// insertion buffer is now empty
+}
 
-		// insertion buffer is now empty
+// Insert the sorted array arr of len <= setting_m elements into a new slot
+// in group 0.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::insert_run(T * arr, memory_size_type len) {
+	// To maintain the heap invariant
+	//     deletion buffer <= group buffer 0 <= group 0 slots
+	// we bubble lesser elements from insertion buffer down into
+	// deletion buffer and group buffer 0.
+
+	slot_type slot = free_slot(0); // (if group 0 is full, we recursively empty group i
+	                               // by merging it into a slot in group i+1)
+
+	assert(len <= setting_m);
+
+	// Bubble lesser elements down into deletion buffer
+	if(buffer_size > 0) {
+		// smaller elements go in deletion buffer,
+		// larger elements go in insertion buffer
+		merge_sorted(&buffer[buffer_start], buffer_size, arr, len);
+	}
 
+	// Bubble lesser elements down into group buffer 0
+	if(group_size(0)> 0) {
+		// smaller elements go in gbuffer0,
+		// larger elements go in insertion buffer (actually a free group 0 slot)
+		assert(group_size(0)+len <= setting_m*2);
+		linearize_group_buffer_0();
+		merge_sorted(gbuffer0.get(), group_size(0), arr, len);
 	}
 
-	// insertion buffer is non-full. insert element.
-	opq->push(x);
-	m_size++;
-#ifndef NDEBUG
-	validate();
-#endif
+	// move insertion buffer (which has elements larger than all of
+	// gbuffer0 and deletion buffer) into a free group 0 slot
+
+	write_slot(slot, arr, len);
 }
 
 template <typename T, typename Comparator, typename OPQType>
@@ -374,6 +412,62 @@ F priority_queue<T, Comparator, OPQType>::pop_equals(F f) {
 	return f;
 }
 
+template <typename T, typename Comparator, typename OPQType>
+template <typename OutputIterator>
+OutputIterator priority_queue<T, Comparator, OPQType>::pop_n(stream_size_type n, OutputIterator out) {
+	return pop_bounded(n, 0, out);
+}
+
+template <typename T, typename Comparator, typename OPQType>
+template <typename OutputIterator>
+OutputIterator priority_queue<T, Comparator, OPQType>::pop_all_less_than(const T & key, OutputIterator out) {
+	return pop_bounded(m_size, &key, out);
+}
+
+// Pop up to n elements, stopping at the first element that is not less than
+// *key if key is not null.
+template <typename T, typename Comparator, typename OPQType>
+template <typename OutputIterator>
+OutputIterator priority_queue<T, Comparator, OPQType>::pop_bounded(stream_size_type n, const T * key, OutputIterator out) {
+	while(n > 0 && !empty()) {
+		// Freshen deletion buffer (if empty) and min_in_buffer
+		const T & x = top();
+		if(key != 0 && !comp_(x, *key)) break;
+
+		if(!min_in_buffer) {
+			// Top element in insertion buffer
+			*out = x;
+			++out;
+			opq->pop();
+			m_size--;
+			n--;
+			continue;
+		}
+
+		// Copy the elements of the deletion buffer that precede the top of
+		// the insertion buffer and the key
+		memory_size_type count = 1;
+		const T * b = &buffer[buffer_start];
+		while(count < buffer_size && count < n
+			  && (opq->size() == 0 || !comp_(opq->top(), b[count]))
+			  && (key == 0 || comp_(b[count], *key))) {
+			count++;
+		}
+		out = std::copy(b, b + count, out);
+		buffer_start += count;
+		buffer_size -= count;
+		if(buffer_size == 0) {
+			buffer_start = 0;
+		}
+		m_size -= count;
+		n -= count;
+	}
+#ifndef NDEBUG
+	validate();
+#endif
+	return out;
+}
+
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::dump() {
 	TP_LOG_DEBUG( "--------------------------------------------------------------" << "\n"
@@ -420,7 +514,7 @@ void priority_queue<T, Comparator, OPQType>::dump() {
 		} else {
 			// output group buffer contents
 			file_stream<T> instream(block_factor);
-			instream.open(group_data(i));
+			instream.open(group_data(i), m_compressionFlags);
 			memory_size_type k = 0;
 			if(group_size(i) > 0) {
 				for(k = 0; k < setting_m; k++) {
@@ -440,7 +534,7 @@ void priority_queue<T, Comparator, OPQType>::dump() {
 					<< " start: " << slot_start(j) << "):");
 
 			file_stream<T> instream(block_factor);
-			instream.open(slot_data(j));
+			instream.open(slot_data(j), m_compressionFlags);
 			stream_size_type k;
 			for(k = 0; k < slot_start(j)+slot_size(j); k++) {
 				TP_LOG_DEBUG((k>=slot_start(j)?"":"(") <<
@@ -534,9 +628,8 @@ void priority_queue<T, Comparator, OPQType>::fill_buffer() {
 		if(i == 0 && group_size(i)>0) {
 			heap.push(gbuffer0[group_start(0)], 0);
 		} else if(group_size(i)>0) {
-			data[i]->open(group_data(i));
-			data[i]->seek(group_start(i));
-			heap.push(data[i]->read(), i);
+			open_group(*data[i], i);
+			heap.push(read_group(*data[i], i), i);
 		} else if(i > 0) {
 			// dummy, well :o/
 		}
@@ -544,7 +637,7 @@ void priority_queue<T, Comparator, OPQType>::fill_buffer() {
 
 	while(!heap.empty() && buffer_size!=setting_mmark) {
 		group_type current_group = heap.top_run();
-		if(current_group!= 0 && data[current_group]->offset() == setting_m) {
+		if(current_group!= 0 && !use_compression() && data[current_group]->offset() == setting_m) {
 			data[current_group]->seek(0);
 		}
 		buffer[(buffer_size+buffer_start)%setting_m] = heap.top();
@@ -559,7 +652,7 @@ void priority_queue<T, Comparator, OPQType>::fill_buffer() {
 			if(current_group == 0) {
 				heap.pop_and_push(gbuffer0[group_start(0)], 0);
 			} else {
-				heap.pop_and_push(data[current_group]->read(), current_group);
+				heap.pop_and_push(read_group(*data[current_group], current_group), current_group);
 			}
 		}
 	}
@@ -593,9 +686,18 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 		//group output stream, not used if group==0 in this case 
 		//the in-memory gbuffer0 is used
 		file_stream<T> out(block_factor);
-		out.open(group_data(group));
-		if(group > 0) {
+		if(group == 0) {
+			out.open(group_data(group), m_compressionFlags);
+		} else if(!use_compression()) {
+			out.open(group_data(group), m_compressionFlags);
 			out.seek((group_start(group)+group_size(group))%setting_m);
+		} else {
+			bool slots_empty = true;
+			for(memory_size_type i = 0; i<setting_k; i++) {
+				if(slot_size(group*setting_k+i)>0) slots_empty = false;
+			}
+			// rewriting the group buffer is only worth it if it is refilled
+			if(!slots_empty) rewrite_group(out, group);
 		}
 
 		//merge heap for the setting_k slots
@@ -611,13 +713,10 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 			if(slot_size(group*setting_k+i)>0) {
 				//slot is non-empry, opening stream
 				slot_type slotid = group*setting_k+i;
-				data[i]->open(slot_data(slotid));
-
-				//seek to start of slot
-				data[i]->seek(slot_start(slotid));
+				open_slot(*data[i], slotid);
 
 				//push first item of slot on the stream
-				heap.push(data[i]->read(), slotid);
+				heap.push(read_slot(*data[i], slotid), slotid);
 			}
 		}
 
@@ -649,7 +748,7 @@ void priority_queue<T, Comparator, OPQType>::fill_group_buffer(group_type group)
 			if(slot_size(current_slot) == 0) {
 				heap.pop();
 			} else {
-				heap.pop_and_push(data[current_slot-group*setting_k]->read(), current_slot);
+				heap.pop_and_push(read_slot(*data[current_slot-group*setting_k], current_slot), current_slot);
 			}
 		}
 
@@ -700,20 +799,24 @@ void priority_queue<T, Comparator, OPQType>::empty_group(group_type group) {
 	{
 
 		file_stream<T> newstream(block_factor);
-		newstream.open(slot_data(newslot));
+		newstream.open(slot_data(newslot), m_compressionFlags);
+		if(use_compression()) {
+			// A compressed stream cannot be overwritten in place.
+			newstream.truncate(0);
+			slot_positions[newslot] = stream_position::beginning();
+		}
 		pq_merge_heap<T, Comparator> heap(setting_k);
 
 		// Open streams to slots in group `group', push top element to merge heap
 		tpie::array<tpie::auto_ptr<file_stream<T> > > data(setting_k);
 		for(memory_size_type i = 0; i<setting_k; i++) {
 			data[i].reset(tpie_new<file_stream<T> >(block_factor));
-			data[i]->open(slot_data(group*setting_k+i));
 			if(slot_size(group*setting_k+i) == 0) {
 				ret = true;
 				break;
 			}
 			assert(slot_size(group*setting_k+i)>0);
-			data[i]->seek(slot_start(group*setting_k+i));
+			open_slot(*data[i], group*setting_k+i);
 			heap.push(data[i]->read(), group*setting_k+i);
 		}
 
@@ -900,8 +1003,7 @@ void priority_queue<T, Comparator, OPQType>::remove_group_buffer(group_type grou
 	assert(group < setting_k);
 	array<T> arr(static_cast<size_t>(group_size(group)));
 	file_stream<T> data(block_factor);
-	data.open(group_data(group));
-	data.seek(group_start(group));
+	open_group(data, group);
 	memory_size_type size = group_size(group);
 	if(group_start(group) + group_size(group) <= static_cast<stream_size_type>(setting_m)) {
 		data.read(arr.begin(), arr.find(size));
@@ -918,16 +1020,8 @@ void priority_queue<T, Comparator, OPQType>::remove_group_buffer(group_type grou
 
 	// make sure that the new slot in group 0 is heap ordered with gbuffer0
 	if(group > 0 && group_size(0) != 0) {
-		memory_size_type j = 0;
-		for(memory_size_type i = group_start(0); i < group_start(0)+group_size(0); i++) {
-			mergebuffer[j] = gbuffer0[i%setting_m];
-			++j;
-		}
-		memcpy(&mergebuffer[j], &arr[0], static_cast<size_t>(sizeof(T)*group_size(group)));
-		std::sort(&mergebuffer[0], &mergebuffer[0]+(group_size(0)+group_size(group)), comp_);
-		memcpy(&gbuffer0[0], &mergebuffer[0], static_cast<size_t>(sizeof(T)*group_size(0)));
-		group_start_set(0,0);
-		memcpy(&arr[0], &mergebuffer[group_size(0)], static_cast<size_t>(sizeof(T)*group_size(group)));
+		linearize_group_buffer_0();
+		merge_sorted(gbuffer0.get(), group_size(0), arr.get(), group_size(group));
 	}
 
 	write_slot(slot, arr.get(), group_size(group));
@@ -935,6 +1029,29 @@ void priority_queue<T, Comparator, OPQType>::remove_group_buffer(group_type grou
 	group_size_set(group, 0);
 }
 
+// Move the elements of group buffer 0 to the start of gbuffer0.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::linearize_group_buffer_0() {
+	if(group_start(0) == 0) return;
+	std::rotate(gbuffer0.begin(), gbuffer0.find(group_start(0)), gbuffer0.end());
+	group_start_set(0, 0);
+}
+
+// Merge the sorted arrays low and high in linear time, leaving the lowSize
+// least elements in low and the rest in high.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::merge_sorted(T * low, memory_size_type lowSize,
+														  T * high, memory_size_type highSize) {
+	if(lowSize == 0 || highSize == 0) return;
+	// no element of high is less than the greatest element of low
+	if(!comp_(high[0], low[lowSize-1])) return;
+
+	assert(lowSize+highSize <= mergebuffer.size());
+	std::merge(low, low+lowSize, high, high+highSize, mergebuffer.get(), comp_);
+	std::copy(mergebuffer.get(), mergebuffer.get()+lowSize, low);
+	std::copy(mergebuffer.get()+lowSize, mergebuffer.get()+lowSize+highSize, high);
+}
+
 //////////////////
 // TPIE wrappers
 template <typename T, typename Comparator, typename OPQType>
@@ -960,23 +1077,23 @@ memory_size_type priority_queue<T, Comparator, OPQType>::slot_size(slot_type slo
 
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::group_start_set(group_type group, memory_size_type n) {
-	group_state[group*2] = n;
+	group_state[group*3] = n;
 }
 
 template <typename T, typename Comparator, typename OPQType>
 memory_size_type priority_queue<T, Comparator, OPQType>::group_start(group_type group) const {
-	return group_state[group*2];
+	return group_state[group*3];
 }
 
 template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::group_size_set(group_type group, memory_size_type n) {
 	assert(group<setting_k);
-	group_state[group*2+1] = n;
+	group_state[group*3+1] = n;
 }
 
 template <typename T, typename Comparator, typename OPQType>
 memory_size_type priority_queue<T, Comparator, OPQType>::group_size(group_type group) const {
-	return group_state[group*2+1];
+	return group_state[group*3+1];
 }
 
 template <typename T, typename Comparator, typename OPQType>
@@ -991,7 +1108,74 @@ void priority_queue<T, Comparator, OPQType>::slot_data_set(slot_type slotid, mem
 
 template <typename T, typename Comparator, typename OPQType>
 temp_file & priority_queue<T, Comparator, OPQType>::group_data(group_type groupid) {
-	return groupdatafiles[groupid];
+	return groupdatafiles[group_state[groupid*3+2]];
+}
+
+template <typename T, typename Comparator, typename OPQType>
+bool priority_queue<T, Comparator, OPQType>::use_compression() const {
+	return m_compressionFlags != compression_none;
+}
+
+// Open the data file of a slot positioned at its first element.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::open_slot(file_stream<T> & stream, slot_type slotid) {
+	stream.open(slot_data(slotid), m_compressionFlags);
+	if(use_compression()) {
+		stream.set_position(slot_positions[slotid]);
+	} else {
+		stream.seek(slot_start(slotid));
+	}
+}
+
+// Read the next element of a slot, remembering where it starts
+// since it is the first element of the slot until it is consumed.
+template <typename T, typename Comparator, typename OPQType>
+T priority_queue<T, Comparator, OPQType>::read_slot(file_stream<T> & stream, slot_type slotid) {
+	if(use_compression()) {
+		slot_positions[slotid] = stream.get_position();
+	}
+	return stream.read();
+}
+
+// Open the data file of a group buffer positioned at its first element.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::open_group(file_stream<T> & stream, group_type groupid) {
+	stream.open(group_data(groupid), m_compressionFlags);
+	if(use_compression()) {
+		stream.set_position(group_positions[groupid]);
+	} else {
+		stream.seek(group_start(groupid));
+	}
+}
+
+template <typename T, typename Comparator, typename OPQType>
+T priority_queue<T, Comparator, OPQType>::read_group(file_stream<T> & stream, group_type groupid) {
+	if(use_compression()) {
+		group_positions[groupid] = stream.get_position();
+	}
+	return stream.read();
+}
+
+// A compressed stream can only be written at its end, so instead of
+// appending to a group buffer circularly, copy its elements to the start
+// of the other data file of the group and leave `out' open for appending.
+template <typename T, typename Comparator, typename OPQType>
+void priority_queue<T, Comparator, OPQType>::rewrite_group(file_stream<T> & out, group_type groupid) {
+	assert(use_compression());
+	memory_size_type file = group_state[groupid*3+2];
+	memory_size_type other = file < setting_k ? file + setting_k : file - setting_k;
+	out.open(groupdatafiles[other], m_compressionFlags);
+	out.truncate(0);
+	if(group_size(groupid) > 0) {
+		file_stream<T> in(block_factor);
+		open_group(in, groupid);
+		for(memory_size_type i = 0; i < group_size(groupid); i++) {
+			out.write(in.read());
+		}
+	}
+	group_state[groupid*3+2] = other;
+	group_start_set(groupid, 0);
+	group_positions[groupid] = stream_position::beginning();
 }
 
 template <typename T, typename Comparator, typename OPQType>
@@ -1006,7 +1190,12 @@ template <typename T, typename Comparator, typename OPQType>
 void priority_queue<T, Comparator, OPQType>::write_slot(slot_type slotid, T* arr, memory_size_type len) {
 	assert(len > 0);
 	file_stream<T> data(block_factor);
-	data.open(slot_data(slotid));
+	data.open(slot_data(slotid), m_compressionFlags);
+	if(use_compression()) {
+		// A compressed stream cannot be overwritten in place.
+		data.truncate(0);
+		slot_positions[slotid] = stream_position::beginning();
+	}
 	data.write(arr+0, arr+len);
 	slot_start_set(slotid, 0);
 	slot_size_set(slotid, len);
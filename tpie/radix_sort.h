@@ -0,0 +1,270 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; c-file-style: "stroustrup"; -*-
+// vi:set ts=4 sts=4 sw=4 noet cino+=(0 :
+// Copyright 2014, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file radix_sort.h
+/// In-place radix sort of items with an integral key.
+///
+/// To sort by radix instead of by comparisons, use a radix_less as the
+/// comparator. radix_less compares the keys given by a key extractor, so it
+/// can be used wherever a comparator is expected, and parallel_sort, and
+/// thereby tpie::sort and pipelining::pipesort, sort runs of items by radix
+/// when given a radix_less.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TPIE_RADIX_SORT_H__
+#define __TPIE_RADIX_SORT_H__
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/iterator/iterator_traits.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/make_unsigned.hpp>
+#include <tpie/job.h>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Key extractor for items that are their own integral key.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+struct identity_radix_key {
+	typedef T key_type;
+
+	const key_type & operator()(const T & item) const {
+		return item;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Comparator that orders items by an integral key and selects radix
+/// sorting.
+///
+/// The key extractor is a function object that returns the key of an item
+/// and has a typedef key_type naming the integral type of the key, as in
+/// identity_radix_key.
+///////////////////////////////////////////////////////////////////////////////
+template <typename key_extractor_t>
+class radix_less {
+public:
+	typedef key_extractor_t key_extractor;
+	typedef typename key_extractor_t::key_type key_type;
+
+	radix_less(key_extractor_t key = key_extractor_t())
+		: m_key(key)
+	{
+	}
+
+	template <typename T>
+	bool operator()(const T & a, const T & b) const {
+		return m_key(a) < m_key(b);
+	}
+
+	const key_extractor_t & key() const {
+		return m_key;
+	}
+
+private:
+	key_extractor_t m_key;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Most significant digit first radix sort that permutes the items
+/// in place.
+///
+/// Each pass counts the items per byte of the key and moves every item
+/// directly to its bucket by following permutation cycles (American flag
+/// sort), so no memory besides the items is used. Bytes that are equal in
+/// all keys of a range are skipped, and small buckets are finished with
+/// std::sort.
+///////////////////////////////////////////////////////////////////////////////
+template <typename iterator_type, typename key_extractor_t>
+class radix_sort_impl {
+	typedef typename boost::iterator_value<iterator_type>::type value_type;
+	typedef typename key_extractor_t::key_type key_type;
+	typedef typename boost::make_unsigned<key_type>::type unsigned_key_type;
+
+	BOOST_STATIC_ASSERT(boost::is_integral<key_type>::value);
+
+	static const size_t digitBits = 8;
+	static const size_t buckets = 1 << digitBits;
+	static const size_t keyBits = sizeof(key_type) * 8;
+
+	/** Ranges shorter than this are sorted with std::sort. */
+	static const size_t comparisonSortLimit = 64;
+
+public:
+	radix_sort_impl(key_extractor_t key = key_extractor_t())
+		: m_key(key)
+	{
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sort the items in the range [a,b).
+	///////////////////////////////////////////////////////////////////////////
+	void operator()(iterator_type a, iterator_type b) {
+		sort(a, b, keyBits - digitBits);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sort the items in the range [a,b), sorting the buckets of the
+	/// first distinguishing byte as concurrent jobs.
+	///
+	/// The calling thread runs jobs while it waits, so this may be called
+	/// from within a job.
+	///////////////////////////////////////////////////////////////////////////
+	void parallel(iterator_type a, iterator_type b) {
+		if (static_cast<size_t>(b - a) < comparisonSortLimit) {
+			std::sort(a, b, radix_less<key_extractor_t>(m_key));
+			return;
+		}
+		size_t bounds[buckets + 1];
+		size_t shift = keyBits - digitBits;
+		if (!distribute(a, b, shift, bounds)) return;
+		if (shift == 0) return;
+
+		std::vector<bucket_job *> jobs;
+		for (size_t d = 0; d < buckets; ++d) {
+			iterator_type first = a + bounds[d];
+			iterator_type last = a + bounds[d+1];
+			if (static_cast<size_t>(last - first) < comparisonSortLimit) {
+				std::sort(first, last, radix_less<key_extractor_t>(m_key));
+				continue;
+			}
+			bucket_job * j = new bucket_job(*this, first, last, shift - digitBits);
+			j->enqueue();
+			jobs.push_back(j);
+		}
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			jobs[i]->join();
+			delete jobs[i];
+		}
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sorts one bucket of the first pass of parallel().
+	///////////////////////////////////////////////////////////////////////////
+	class bucket_job : public job {
+	public:
+		bucket_job(radix_sort_impl & impl, iterator_type a, iterator_type b, size_t shift)
+			: impl(impl), a(a), b(b), shift(shift) {
+		}
+
+		virtual void operator()() override {
+			impl.sort(a, b, shift);
+		}
+
+	private:
+		radix_sort_impl & impl;
+		iterator_type a;
+		iterator_type b;
+		size_t shift;
+	};
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Map the key to an unsigned integer of the same order.
+	///////////////////////////////////////////////////////////////////////////
+	inline unsigned_key_type key(const value_type & item) const {
+		unsigned_key_type k = static_cast<unsigned_key_type>(m_key(item));
+		if (std::numeric_limits<key_type>::is_signed)
+			k ^= static_cast<unsigned_key_type>(1) << (keyBits - 1);
+		return k;
+	}
+
+	inline size_t digit(const value_type & item, size_t shift) const {
+		return static_cast<size_t>(key(item) >> shift) & (buckets - 1);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sort [a,b), whose keys agree on the bits above shift+digitBits.
+	///////////////////////////////////////////////////////////////////////////
+	void sort(iterator_type a, iterator_type b, size_t shift) {
+		if (static_cast<size_t>(b - a) < comparisonSortLimit) {
+			std::sort(a, b, radix_less<key_extractor_t>(m_key));
+			return;
+		}
+		size_t bounds[buckets + 1];
+		if (!distribute(a, b, shift, bounds)) return;
+		if (shift == 0) return;
+		for (size_t d = 0; d < buckets; ++d) {
+			if (bounds[d+1] - bounds[d] > 1)
+				sort(a + bounds[d], a + bounds[d+1], shift - digitBits);
+		}
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Move the items of [a,b) to their buckets by the byte at shift,
+	/// first lowering shift past bytes that are equal in all keys.
+	/// \param bounds  Receives the offset of each bucket in [a,b) and the
+	/// offset b-a at the end.
+	/// \returns False if all keys are equal.
+	///////////////////////////////////////////////////////////////////////////
+	bool distribute(iterator_type a, iterator_type b, size_t & shift, size_t * bounds) {
+		const size_t n = static_cast<size_t>(b - a);
+		size_t count[buckets];
+		while (true) {
+			std::fill(count, count + buckets, 0);
+			for (iterator_type i = a; i != b; ++i) ++count[digit(*i, shift)];
+			if (count[digit(*a, shift)] != n) break;
+			if (shift == 0) return false;
+			shift -= digitBits;
+		}
+
+		bounds[0] = 0;
+		for (size_t d = 0; d < buckets; ++d) bounds[d+1] = bounds[d] + count[d];
+
+		// next[d] is the first position in bucket d whose item may belong
+		// elsewhere.
+		size_t next[buckets];
+		std::copy(bounds, bounds + buckets, next);
+		for (size_t d = 0; d < buckets; ++d) {
+			while (next[d] < bounds[d+1]) {
+				value_type item = *(a + next[d]);
+				size_t e = digit(item, shift);
+				while (e != d) {
+					std::swap(item, *(a + next[e]++));
+					e = digit(item, shift);
+				}
+				*(a + next[d]++) = item;
+			}
+		}
+		return true;
+	}
+
+	key_extractor_t m_key;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sort the items in the range [a,b) by radix on the keys given by
+/// the key extractor.
+/// \sa radix_sort_impl
+///////////////////////////////////////////////////////////////////////////////
+template <typename iterator_type, typename key_extractor_t>
+void radix_sort(iterator_type a, iterator_type b, key_extractor_t key) {
+	radix_sort_impl<iterator_type, key_extractor_t> s(key);
+	s(a, b);
+}
+
+} // namespace tpie
+
+#endif // __TPIE_RADIX_SORT_H__
@@ -0,0 +1,501 @@
+// -*- mode: c++; tab-width: 4; indent-tabs-mode: t; eval: (progn (c-set-style "stroustrup") (c-set-offset 'innamespace 0)); -*-
+// vi:set ts=4 sts=4 sw=4 noet :
+// Copyright 2026, The TPIE development team
+//
+// This file is part of TPIE.
+//
+// TPIE is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// TPIE is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with TPIE.  If not, see <http://www.gnu.org/licenses/>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \file serialization_priority_queue.h
+/// \brief External memory priority queue of variable-length items.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TPIE_SERIALIZATION_PRIORITY_QUEUE_H
+#define TPIE_SERIALIZATION_PRIORITY_QUEUE_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include <tpie/array.h>
+#include <tpie/exception.h>
+#include <tpie/tempname.h>
+#include <tpie/tpie_log.h>
+#include <tpie/loser_tree.h>
+
+#include <tpie/serialization2.h>
+#include <tpie/serialization_stream.h>
+
+namespace tpie {
+
+///////////////////////////////////////////////////////////////////////////////
+/// \class serialization_priority_queue
+/// \brief External memory priority queue of items that are stored with the
+/// serialization framework, such as strings or vectors.
+///
+/// The structure follows priority_queue (Sanders, Fast priority queues for
+/// cached memory, 1999): Inserted items are collected in an insertion heap,
+/// which is sorted and written as a run in level 0 when full. When a level
+/// has k runs, they are merged into a single run in the next level. Each
+/// level has a group buffer on disk holding the smallest items of its runs,
+/// and the deletion buffer is refilled by merging the group buffers. Since
+/// serialization streams cannot be written in place, a group buffer is
+/// refilled by writing its remaining items and the next items of its runs
+/// to a new file, at least k blocks at a time.
+///
+/// Half of the memory is used by the blocks of the streams that are open
+/// during a merge, so the fanout k is the memory divided by four times the
+/// serialization block size. The insertion heap and the deletion buffer each
+/// use a fourth of the memory. As in serialization_sorter, half of that is
+/// an array of items, and the rest holds the parts of the items that are
+/// stored outside the array, where an item is assumed to use as much memory
+/// as its serialized size, or sizeof(T) if that is larger.
+///////////////////////////////////////////////////////////////////////////////
+template <typename T, typename pred_t = std::less<T> >
+class serialization_priority_queue {
+public:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Constructor.
+	///
+	/// \param memory Number of bytes the priority queue is allowed to use;
+	/// at least minimum_memory().
+	/// \param pred Comparator; the smallest item is on top.
+	///////////////////////////////////////////////////////////////////////////
+	serialization_priority_queue(memory_size_type memory, pred_t pred = pred_t())
+		: m_pred(pred)
+		, m_insertionItems(0)
+		, m_insertionBytes(0)
+		, m_bufferItems(0)
+		, m_bufferIndex(0)
+		, m_largestItem(sizeof(T))
+		, m_size(0)
+	{
+		if (memory < minimum_memory())
+			throw exception("serialization_priority_queue: Not enough memory");
+		m_fanout = memory / 2 / stream_memory() - 2;
+		m_insertionCapacity = memory / 4;
+		m_bufferCapacity = memory / 4;
+		m_insertionHeap.resize(m_insertionCapacity / 2 / sizeof(T));
+		m_buffer.resize(m_bufferCapacity / 2 / sizeof(T));
+		log_debug() << "serialization_priority_queue: fanout " << m_fanout
+					<< ", insertion heap " << m_insertionCapacity
+					<< " bytes, deletion buffer " << m_bufferCapacity
+					<< " bytes" << std::endl;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The least amount of memory the priority queue can use, which
+	/// gives a fanout of two.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type minimum_memory() {
+		return 8 * stream_memory();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Insert an item into the priority queue.
+	///////////////////////////////////////////////////////////////////////////
+	void push(const T & x) {
+		memory_size_type serSize = serialized_size(x);
+		if (serSize > m_largestItem) m_largestItem = serSize;
+		memory_size_type usage = extra_usage(x);
+		if (m_insertionItems == m_insertionHeap.size()
+			|| (m_insertionItems > 0
+				&& m_insertionBytes + usage > m_insertionCapacity - array_bytes(m_insertionHeap)))
+			flush_insertion_heap();
+		m_insertionHeap[m_insertionItems++] = x;
+		std::push_heap(m_insertionHeap.get(), m_insertionHeap.get() + m_insertionItems, heap_pred(m_pred));
+		m_insertionBytes += usage;
+		++m_size;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The smallest item. The queue must not be empty.
+	///////////////////////////////////////////////////////////////////////////
+	const T & top() {
+		if (top_in_buffer()) return m_buffer[m_bufferIndex];
+		return m_insertionHeap[0];
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Remove the smallest item. The queue must not be empty.
+	///////////////////////////////////////////////////////////////////////////
+	void pop() {
+		if (top_in_buffer()) {
+			m_buffer[m_bufferIndex] = T();
+			if (++m_bufferIndex == m_bufferItems) {
+				m_bufferItems = 0;
+				m_bufferIndex = 0;
+			}
+		} else {
+			std::pop_heap(m_insertionHeap.get(), m_insertionHeap.get() + m_insertionItems, heap_pred(m_pred));
+			T & last = m_insertionHeap[--m_insertionItems];
+			m_insertionBytes -= extra_usage(last);
+			last = T();
+		}
+		--m_size;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Number of items in the priority queue.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type size() const {
+		return m_size;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether the priority queue is empty.
+	///////////////////////////////////////////////////////////////////////////
+	bool empty() const {
+		return m_size == 0;
+	}
+
+private:
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief The remaining items of a serialization stream on disk.
+	///////////////////////////////////////////////////////////////////////////
+	struct run {
+		run() : offset(0), end(0), items(0) {}
+
+		boost::shared_ptr<temp_file> file;
+		/** Byte offset of the first remaining item. */
+		stream_size_type offset;
+		/** Size in bytes of the items written to the file. */
+		stream_size_type end;
+		/** Number of remaining items. */
+		stream_size_type items;
+	};
+
+	struct level {
+		/** At most k runs. */
+		std::vector<run> runs;
+		/** Items that are no greater than the items in the runs. */
+		run buffer;
+		/** The largest item in buffer. */
+		T bufferMax;
+	};
+
+	/** Orders the insertion heap with the smallest item on top. */
+	struct heap_pred {
+		heap_pred(const pred_t & pred) : pred(pred) {}
+
+		bool operator()(const T & a, const T & b) const {
+			return pred(b, a);
+		}
+
+		pred_t pred;
+	};
+
+	static memory_size_type stream_memory() {
+		return serialization_writer::memory_usage();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Memory used by an item outside the array holding it.
+	///////////////////////////////////////////////////////////////////////////
+	static memory_size_type extra_usage(const T & x) {
+		memory_size_type serSize = serialized_size(x);
+		return serSize > sizeof(T) ? serSize - sizeof(T) : 0;
+	}
+
+	static memory_size_type array_bytes(const tpie::array<T> & a) {
+		return a.size() * sizeof(T);
+	}
+
+	static stream_size_type unlimited() {
+		return std::numeric_limits<stream_size_type>::max();
+	}
+
+	stream_size_type items_on_disk() const {
+		return m_size - m_insertionItems - (m_bufferItems - m_bufferIndex);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Whether the smallest item is in the deletion buffer rather than
+	/// in the insertion heap. Refills an empty deletion buffer.
+	///////////////////////////////////////////////////////////////////////////
+	bool top_in_buffer() {
+		if (m_bufferIndex == m_bufferItems && items_on_disk() > 0)
+			refill_buffer();
+		if (m_bufferIndex == m_bufferItems) return false;
+		if (m_insertionItems == 0) return true;
+		return !m_pred(m_insertionHeap[0], m_buffer[m_bufferIndex]);
+	}
+
+	static void new_run(run & r) {
+		r = run();
+		r.file.reset(new temp_file());
+	}
+
+	static void remove_empty_runs(std::vector<run> & runs) {
+		memory_size_type j = 0;
+		for (memory_size_type i = 0; i < runs.size(); ++i)
+			if (runs[i].items > 0) runs[j++] = runs[i];
+		runs.resize(j);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Merge the remaining items of the given runs and the sorted
+	/// items [first, last) into the run being written by out.
+	///
+	/// Stops when the written run is at least limit bytes; the items of
+	/// [first, last) must fit within the limit. The runs are advanced past
+	/// the items that were written.
+	///
+	/// \param maxItem Receives the last item written.
+	///////////////////////////////////////////////////////////////////////////
+	void merge(const std::vector<run *> & sources, const T * first, const T * last,
+			   serialization_writer & out, run & result, stream_size_type limit,
+			   T & maxItem)
+	{
+		const memory_size_type n = sources.size();
+		tpie::array<serialization_reader> readers(n);
+		loser_tree<T, pred_t> tree(n + 1, m_pred);
+		for (memory_size_type i = 0; i < n; ++i) {
+			if (sources[i]->items == 0) continue;
+			readers[i].open(*sources[i]->file);
+			readers[i].seek(sources[i]->offset);
+			T x;
+			readers[i].unserialize(x);
+			tree.unsafe_set(i, x);
+		}
+		if (first != last) tree.unsafe_set(n, *first);
+		tree.make_safe();
+
+		while (!tree.empty() && result.end < limit) {
+			maxItem = tree.top();
+			out.serialize(maxItem);
+			result.end += serialized_size(maxItem);
+			++result.items;
+
+			memory_size_type idx = tree.top_index();
+			if (idx == n) {
+				if (++first != last) tree.pop_and_push(*first);
+				else tree.pop();
+				continue;
+			}
+			run & r = *sources[idx];
+			r.offset = readers[idx].offset();
+			if (--r.items > 0) {
+				T x;
+				readers[idx].unserialize(x);
+				tree.pop_and_push(x);
+			} else {
+				tree.pop();
+			}
+		}
+
+		for (memory_size_type i = 0; i < n; ++i) readers[i].close();
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Sort the insertion heap and write it as a run in level 0.
+	///////////////////////////////////////////////////////////////////////////
+	void flush_insertion_heap() {
+		T * h = m_insertionHeap.get();
+		const memory_size_type hn = m_insertionItems;
+		std::sort(h, h + hn, m_pred);
+
+		// The deletion buffer must keep the smallest items.
+		if (m_bufferIndex < m_bufferItems && m_pred(h[0], m_buffer[m_bufferItems - 1]))
+			exchange_with_buffer(h, hn);
+
+		make_room(0);
+		level & l = m_levels[0];
+		std::vector<run *> sources;
+		// The group buffer must not have items greater than the new run.
+		bool mergeBuffer = l.buffer.items > 0 && m_pred(h[0], l.bufferMax);
+		if (mergeBuffer) sources.push_back(&l.buffer);
+
+		run r;
+		new_run(r);
+		serialization_writer out;
+		out.open(*r.file);
+		T maxItem;
+		merge(sources, h, h + hn, out, r, unlimited(), maxItem);
+		out.close();
+
+		if (mergeBuffer) l.buffer = run();
+		l.runs.push_back(r);
+		std::fill(h, h + hn, T());
+		m_insertionItems = 0;
+		m_insertionBytes = 0;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Move the smallest of the items in the deletion buffer and the
+	/// sorted items [h, h+hn) to the deletion buffer, and the rest to h.
+	///
+	/// Works in place, so that no memory beyond the two arrays is used.
+	///////////////////////////////////////////////////////////////////////////
+	void exchange_with_buffer(T * h, memory_size_type hn) {
+		T * b = m_buffer.get();
+		const memory_size_type keep = m_bufferItems - m_bufferIndex;
+		std::rotate(b, b + m_bufferIndex, b + m_bufferItems);
+		m_bufferItems = keep;
+		m_bufferIndex = 0;
+
+		// The smallest keep items are b[0, i) and h[0, j) with i + j = keep.
+		memory_size_type i = 0;
+		memory_size_type j = 0;
+		while (i + j < keep) {
+			if (j < hn && m_pred(h[j], b[i])) ++j;
+			else ++i;
+		}
+		std::swap_ranges(b + i, b + keep, h);
+		std::sort(b, b + keep, m_pred);
+		std::sort(h, h + hn, m_pred);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Ensure that level l has room for another run by merging its
+	/// runs into a run in level l+1.
+	///////////////////////////////////////////////////////////////////////////
+	void make_room(memory_size_type l) {
+		if (l == m_levels.size()) m_levels.push_back(level());
+		if (m_levels[l].runs.size() < m_fanout) return;
+		make_room(l + 1);
+
+		level & cur = m_levels[l];
+		level & next = m_levels[l + 1];
+		std::vector<run *> sources;
+		for (memory_size_type i = 0; i < cur.runs.size(); ++i)
+			sources.push_back(&cur.runs[i]);
+		if (next.buffer.items > 0) sources.push_back(&next.buffer);
+
+		run r;
+		new_run(r);
+		serialization_writer out;
+		out.open(*r.file);
+		T maxItem;
+		merge(sources, 0, 0, out, r, unlimited(), maxItem);
+		out.close();
+
+		cur.runs.clear();
+		next.buffer = run();
+		next.runs.push_back(r);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Write the remaining items of the group buffer of level l and
+	/// the next items of its runs to a new group buffer.
+	///////////////////////////////////////////////////////////////////////////
+	void refill_group(memory_size_type l, stream_size_type lowWater) {
+		level & lv = m_levels[l];
+		run g;
+		new_run(g);
+		serialization_writer out;
+		out.open(*g.file);
+		T maxItem = lv.bufferMax;
+
+		// The items of the old group buffer are no greater than the items of
+		// the runs, so they are written first.
+		std::vector<run *> sources;
+		if (lv.buffer.items > 0) {
+			sources.push_back(&lv.buffer);
+			merge(sources, 0, 0, out, g, unlimited(), maxItem);
+			sources.clear();
+		}
+		for (memory_size_type i = 0; i < lv.runs.size(); ++i)
+			sources.push_back(&lv.runs[i]);
+		merge(sources, 0, 0, out, g,
+			  lowWater + m_fanout * serialization_writer::block_size(), maxItem);
+		out.close();
+
+		lv.buffer = g;
+		lv.bufferMax = maxItem;
+		remove_empty_runs(lv.runs);
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Fill the empty deletion buffer by merging the group buffers.
+	///////////////////////////////////////////////////////////////////////////
+	void refill_buffer() {
+		// A group buffer with at least this many bytes cannot be emptied
+		// below while it still has items in its runs.
+		const stream_size_type lowWater = m_bufferCapacity + m_largestItem;
+		std::vector<memory_size_type> groups;
+		for (memory_size_type l = 0; l < m_levels.size(); ++l) {
+			level & lv = m_levels[l];
+			if (!lv.runs.empty() && lv.buffer.end - lv.buffer.offset < lowWater)
+				refill_group(l, lowWater);
+			if (lv.buffer.items > 0) groups.push_back(l);
+		}
+
+		const memory_size_type n = groups.size();
+		tpie::array<serialization_reader> readers(n);
+		loser_tree<T, pred_t> tree(n, m_pred);
+		for (memory_size_type i = 0; i < n; ++i) {
+			run & g = m_levels[groups[i]].buffer;
+			readers[i].open(*g.file);
+			readers[i].seek(g.offset);
+			T x;
+			readers[i].unserialize(x);
+			tree.unsafe_set(i, x);
+		}
+		tree.make_safe();
+
+		m_bufferItems = 0;
+		m_bufferIndex = 0;
+		const memory_size_type extraCapacity = m_bufferCapacity - array_bytes(m_buffer);
+		memory_size_type bytes = 0;
+		while (!tree.empty() && m_bufferItems < m_buffer.size() && bytes < extraCapacity) {
+			m_buffer[m_bufferItems] = tree.top();
+			bytes += extra_usage(m_buffer[m_bufferItems++]);
+
+			memory_size_type idx = tree.top_index();
+			run & g = m_levels[groups[idx]].buffer;
+			g.offset = readers[idx].offset();
+			if (--g.items > 0) {
+				T x;
+				readers[idx].unserialize(x);
+				tree.pop_and_push(x);
+			} else {
+				tree.pop();
+			}
+		}
+
+		for (memory_size_type i = 0; i < n; ++i) {
+			readers[i].close();
+			run & g = m_levels[groups[i]].buffer;
+			if (g.items == 0) g = run();
+		}
+	}
+
+	pred_t m_pred;
+
+	/** Insertion heap of m_insertionItems items, using m_insertionBytes
+	 * outside the array and at most m_insertionCapacity in total. */
+	tpie::array<T> m_insertionHeap;
+	memory_size_type m_insertionItems;
+	memory_size_type m_insertionBytes;
+	memory_size_type m_insertionCapacity;
+
+	/** Deletion buffer: The smallest items outside the insertion heap, in
+	 * sorted order in [m_bufferIndex, m_bufferItems). */
+	tpie::array<T> m_buffer;
+	memory_size_type m_bufferItems;
+	memory_size_type m_bufferIndex;
+	memory_size_type m_bufferCapacity;
+
+	std::vector<level> m_levels;
+	memory_size_type m_fanout;
+	memory_size_type m_largestItem;
+	stream_size_type m_size;
+};
+
+} // namespace tpie
+
+#endif // TPIE_SERIALIZATION_PRIORITY_QUEUE_H
@@ -20,7 +20,6 @@
 #ifndef TPIE_SERIALIZATION_SORTER_H
 #define TPIE_SERIALIZATION_SORTER_H
 
-#include <queue>
 #include <boost/filesystem.hpp>
 
 #include <tpie/array.h>
@@ -29,6 +28,7 @@
 #include <tpie/tpie_log.h>
 #include <tpie/stats.h>
 #include <tpie/parallel_sort.h>
+#include <tpie/loser_tree.h>
 
 #include <tpie/serialization2.h>
 #include <tpie/serialization_stream.h>
@@ -402,72 +402,48 @@ private:
 
 template <typename T, typename pred_t>
 class merger {
-	class mergepred_t {
-		pred_t m_pred;
-
-	public:
-		typedef std::pair<T, size_t> item_type;
-
-		mergepred_t(const pred_t & pred) : m_pred(pred) {}
-
-		// Used with std::priority_queue, so invert the original relation.
-		bool operator()(const item_type & a, const item_type & b) const {
-			return m_pred(b.first, a.first);
-		}
-	};
-
-	typedef typename mergepred_t::item_type item_type;
-
 	file_handler<T> & files;
-	pred_t pred;
 	std::vector<serialization_reader> rd;
-	typedef std::priority_queue<item_type, std::vector<item_type>, mergepred_t> priority_queue_type;
-	priority_queue_type pq;
+	loser_tree<T, pred_t> tree;
 
 public:
 	merger(file_handler<T> & files, const pred_t & pred)
 		: files(files)
-		, pred(pred)
-		, pq(mergepred_t(pred))
+		, tree(0, pred)
 	{
 	}
 
 	// Assume files.open_readers(fanout) has just been called
 	void init(size_t fanout) {
 		rd.resize(fanout);
+		tree.resize(fanout);
 		for (size_t i = 0; i < fanout; ++i)
-			push_from(i);
+			if (files.can_read(i))
+				tree.unsafe_set(i, files.read(i));
+		tree.make_safe();
 	}
 
 	bool empty() const {
-		return pq.empty();
+		return tree.empty();
 	}
 
 	const T & top() const {
-		return pq.top().first;
+		return tree.top();
 	}
 
 	void pop() {
-		size_t idx = pq.top().second;
-		pq.pop();
-		push_from(idx);
+		size_t idx = tree.top_index();
+		if (files.can_read(idx))
+			tree.pop_and_push(files.read(idx));
+		else
+			tree.pop();
 	}
 
 	// files.close_readers_and_delete() should be called after this
 	void free() {
-		{
-			priority_queue_type tmp(pred);
-			std::swap(pq, tmp);
-		}
+		tree.resize(0);
 		rd.resize(0);
 	}
-
-private:
-	void push_from(size_t idx) {
-		if (files.can_read(idx)) {
-			pq.push(std::make_pair(files.read(idx), idx));
-		}
-	}
 };
 
 } // namespace serialization_bits
@@ -52,8 +52,7 @@ public:
 	}
 
 	void read() {
-		m_fileAccessor.seek_i(0);
-		m_fileAccessor.read_i(&m_header, sizeof(m_header));
+		m_fileAccessor.pread_i(0, &m_header, sizeof(m_header));
 	}
 
 	void write(bool cleanClose) {
@@ -65,8 +64,7 @@ public:
 		std::copy(headerData, sizeof(m_header) + headerData,
 				  headerArea.begin());
 
-		m_fileAccessor.seek_i(0);
-		m_fileAccessor.write_i(&headerArea[0], headerArea.size());
+		m_fileAccessor.pwrite_i(0, &headerArea[0], headerArea.size());
 	}
 
 	void verify() {
@@ -198,8 +196,7 @@ void serialization_writer_base::open(temp_file & tempFile, bool reverse) {
 void serialization_writer_base::write_block(const char * const s, const memory_size_type n) {
 	assert(n <= block_size());
 	stream_size_type offset = m_blocksWritten * block_size();
-	m_fileAccessor.seek_i(bits::serialization_header::header_size() + offset);
-	m_fileAccessor.write_i(s, n);
+	m_fileAccessor.pwrite_i(bits::serialization_header::header_size() + offset, s, n);
 	++m_blocksWritten;
 	m_size = offset + n;
 	if (m_tempFile)
@@ -327,9 +324,8 @@ void serialization_reader_base::read_block(const stream_size_type blk) {
 	if (to <= from) throw end_of_stream_exception();
 	m_index = 0;
 	m_blockSize = to-from;
-	m_fileAccessor.seek_i(bits::serialization_header::header_size()
-						  + from);
-	m_fileAccessor.read_i(m_block.get(), m_blockSize);
+	m_fileAccessor.pread_i(bits::serialization_header::header_size() + from,
+						   m_block.get(), m_blockSize);
 }
 
 void serialization_reader_base::close() {
@@ -379,6 +375,30 @@ stream_size_type serialization_reader::offset() {
 	return m_blockNumber * block_size() + m_index;
 }
 
+void serialization_reader::seek(stream_size_type offset) {
+	if (offset > m_size)
+		throw stream_exception("Seek past the end of the serialization stream");
+
+	if (offset == 0) {
+		m_blockNumber = 0;
+		m_index = m_blockSize = 0;
+		return;
+	}
+
+	stream_size_type blk = offset / block_size();
+	memory_size_type index = static_cast<memory_size_type>(offset % block_size());
+	if (index == 0) {
+		// Position at the end of the previous block, so the block is only
+		// read if there are more items.
+		m_blockNumber = blk - 1;
+		m_index = m_blockSize = block_size();
+		return;
+	}
+	read_block(blk);
+	m_blockNumber = blk;
+	m_index = index;
+}
+
 void serialization_reverse_reader::next_block() /*override*/ {
 	if (m_blockNumber == 0)
 		throw end_of_stream_exception();
@@ -375,6 +375,14 @@ public:
 	/// For progress reporting.
 	///////////////////////////////////////////////////////////////////////////
 	stream_size_type offset();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Continue reading at the given byte offset.
+	///
+	/// The offset must be the start of an item, that is, a value previously
+	/// returned by offset().
+	///////////////////////////////////////////////////////////////////////////
+	void seek(stream_size_type offset);
 };
 
 class serialization_reverse_reader : public bits::serialization_reader_base {
@@ -23,6 +23,8 @@
 /// given an internal sort implementation and merge heap implementation.
 /// The merge heap classes can be found in the file \ref mergeheap.h, and the
 /// internal sort classes can be found in the file \ref internal_sort.h.
+/// Unless another merge heap is given, the runs are merged with
+/// ami::merge_loser_tree_op.
 ///////////////////////////////////////////////////////////////////////////////
 
 #ifndef _TPIE_AMI_SORT_MANAGER_H
@@ -56,7 +58,7 @@ typedef TPIE_OS_SIZE_T arity_t;
 /// comparison object, or the binary comparison operator &lt;.
 ///////////////////////////////////////////////////////////////////////////////
 
-template <class T, class I, class M>
+template <class T, class I, class M = ami::merge_loser_tree_op<T> >
 class sort_manager {
 	    
 public:
@@ -22,28 +22,105 @@
 
 #include <tpie/stats.h>
 #include <tpie/atomic.h>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <new>
 
 namespace {
-	tpie::atomic_stream_size_type temp_file_usage;
-	tpie::atomic_stream_size_type bytes_read;
-	tpie::atomic_stream_size_type bytes_written;
+	///////////////////////////////////////////////////////////////////////////
+	/// Number of threads that have been given a stats shard so far.
+	///////////////////////////////////////////////////////////////////////////
+	boost::atomic<size_t> threadsSeen(0);
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Index of the calling thread among the threads that have updated a
+	/// sharded counter. Assigned on the first update in each thread.
+	///////////////////////////////////////////////////////////////////////////
+	boost::thread_specific_ptr<size_t> threadIndex;
+
+	size_t thread_index() {
+		size_t * index = threadIndex.get();
+		if (index == 0) {
+			index = new size_t(threadsSeen.fetch_add(1));
+			threadIndex.reset(index);
+		}
+		return *index;
+	}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// Counter that is incremented by many threads and read rarely. Each
+	/// thread adds to one of a number of shards, each on its own cache line,
+	/// so that threads doing I/O at the same time do not contend on a single
+	/// atomic. Reading the counter sums the shards.
+	///////////////////////////////////////////////////////////////////////////
+	class sharded_counter {
+	public:
+		static const size_t shards = 32;
+
+		sharded_counter() {
+			// Round the storage up to the next cache line so no shard
+			// straddles two lines or shares one with its neighbour.
+			size_t address = reinterpret_cast<size_t>(m_storage);
+			size_t offset = (cacheLine - address % cacheLine) % cacheLine;
+			m_shards = reinterpret_cast<shard_t *>(m_storage + offset);
+			for (size_t i = 0; i < shards; ++i) new (&m_shards[i]) shard_t();
+		}
+
+		void add(tpie::stream_size_type delta) {
+			m_shards[shard()].value.add(delta);
+		}
+
+		tpie::stream_size_type fetch() const {
+			tpie::stream_size_type sum = 0;
+			for (size_t i = 0; i < shards; ++i) sum += m_shards[i].value.fetch();
+			return sum;
+		}
+
+		static size_t shard() {
+			return thread_index() % shards;
+		}
+
+	private:
+		static const size_t cacheLine = 64;
+
+		struct shard_t {
+			tpie::atomic_stream_size_type value;
+			char padding[cacheLine - sizeof(tpie::atomic_stream_size_type)];
+		};
+
+		char m_storage[(shards + 1) * cacheLine];
+		shard_t * m_shards;
+
+		sharded_counter(const sharded_counter &);
+		sharded_counter & operator=(const sharded_counter &);
+	};
+
+	sharded_counter temp_file_usage;
+	sharded_counter bytes_read;
+	sharded_counter bytes_written;
+	sharded_counter direct_io_requests;
 	tpie::atomic_stream_size_type user[20];
+	const size_t userCount = sizeof(user) / sizeof(user[0]);
 } // unnamed namespace
 
 namespace tpie {
 
 	stream_size_type get_temp_file_usage() {
-		return temp_file_usage.fetch();
+		stream_size_type x = temp_file_usage.fetch();
+		if (static_cast<stream_offset_type>(x) < 0) return 0;
+		return x;
 	}
 
 	void increment_temp_file_usage(stream_offset_type delta) {
-		stream_size_type x = temp_file_usage.add_and_fetch(delta);
+		temp_file_usage.add(delta);
+		if (delta >= 0) return;
+		stream_size_type x = temp_file_usage.fetch();
 		if (static_cast<stream_offset_type>(x) < 0) {
 			// Somebody has a net negative temp_file_usage!
 			// This is a race, but this branch is only taken when
 			// the application has a negative temp_file_usage,
 			// which is a bug in the stats reporting of the application.
-			temp_file_usage.sub(x);
+			temp_file_usage.add(-x);
 		}
 	}
 
@@ -63,12 +140,27 @@ namespace tpie {
 		bytes_written.add(delta);
 	}
 
+	stream_size_type get_direct_io_requests() {
+		return direct_io_requests.fetch();
+	}
+
+	void increment_direct_io_requests(stream_size_type delta) {
+		direct_io_requests.add(delta);
+	}
+
 	stream_size_type get_user(size_t i) {
-		return (i < sizeof(user)) ? user[i].fetch() : 0;
+		return (i < userCount) ? user[i].fetch() : 0;
 	}
 
 	void increment_user(size_t i, stream_size_type delta) {
-		if (i < sizeof(user)) user[i].add(delta);
+		if (i < userCount) user[i].add(delta);
 	}
-}  //  tpie namespace
 
+namespace bits {
+
+	size_t stats_shard() {
+		return sharded_counter::shard();
+	}
+
+} // namespace bits
+}  //  tpie namespace
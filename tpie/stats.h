@@ -24,6 +24,7 @@
 #ifndef _TPIE_STATS_H
 #define _TPIE_STATS_H
 #include <tpie/types.h>
+#include <tpie/atomic.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace tpie {
@@ -61,9 +62,77 @@ namespace tpie {
 	///////////////////////////////////////////////////////////////////////////
 	void increment_bytes_written(stream_size_type delta);
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the number of reads and writes that bypassed the page
+	/// cache through an O_DIRECT descriptor since program start.
+	///////////////////////////////////////////////////////////////////////////
+	stream_size_type get_direct_io_requests();
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Inform the stats module that a read or write was issued
+	/// through an O_DIRECT descriptor.
+	///////////////////////////////////////////////////////////////////////////
+	void increment_direct_io_requests(stream_size_type delta);
+
 	stream_size_type get_user(size_t i);
 	void increment_user(size_t i, stream_size_type delta);
 
+namespace bits {
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Return the shard of the global counters that the calling
+	/// thread updates. Threads are numbered in the order they first update
+	/// a counter, so up to 32 threads get a shard of their own.
+	///////////////////////////////////////////////////////////////////////////
+	size_t stats_shard();
+
+} // namespace bits
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Number of bytes read from and written to disk through a single
+/// file.
+///
+/// Recording I/O here also updates the global counters. The counters are
+/// atomic since a file may be read by several threads at once, but they are
+/// only shared by the threads using the same file.
+///////////////////////////////////////////////////////////////////////////////
+class file_io_stats {
+public:
+	void record_read(stream_size_type delta) {
+		m_bytesRead.add(delta);
+		increment_bytes_read(delta);
+	}
+
+	void record_write(stream_size_type delta) {
+		m_bytesWritten.add(delta);
+		increment_bytes_written(delta);
+	}
+
+	void record_direct_io() {
+		m_directIoRequests.add(1);
+		increment_direct_io_requests(1);
+	}
+
+	stream_size_type bytes_read() const {return m_bytesRead.fetch();}
+	stream_size_type bytes_written() const {return m_bytesWritten.fetch();}
+	stream_size_type direct_io_requests() const {return m_directIoRequests.fetch();}
+
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief Set the counters of this file to zero. Must not be called
+	/// while the file is in use by other threads.
+	///////////////////////////////////////////////////////////////////////////
+	void reset() {
+		m_bytesRead.sub(m_bytesRead.fetch());
+		m_bytesWritten.sub(m_bytesWritten.fetch());
+		m_directIoRequests.sub(m_directIoRequests.fetch());
+	}
+
+private:
+	atomic_stream_size_type m_bytesRead;
+	atomic_stream_size_type m_bytesWritten;
+	atomic_stream_size_type m_directIoRequests;
+};
+
 class ptime {
 public:
 	ptime()
@@ -30,6 +30,7 @@
 
 namespace {
 static tpie::memory_size_type the_block_size=0;
+static int the_direct_io_temp_files=-1;
 }
 
 namespace tpie {
@@ -101,4 +102,22 @@ void set_block_size(memory_size_type block_size) {
 	the_block_size=block_size;
 }
 
+static void log_direct_io_enabled() {
+	log_info() << "Direct I/O temp files enabled; merge sort runs are stored uncompressed" << std::endl;
+}
+
+bool get_direct_io_temp_files() {
+	if (the_direct_io_temp_files == -1) {
+		const char * v = getenv("TPIE_DIRECT_IO");
+		the_direct_io_temp_files = (v != NULL && atoi(v) != 0) ? 1 : 0;
+		if (the_direct_io_temp_files == 1) log_direct_io_enabled();
+	}
+	return the_direct_io_temp_files == 1;
+}
+
+void set_direct_io_temp_files(bool directIo) {
+	if (directIo && the_direct_io_temp_files != 1) log_direct_io_enabled();
+	the_direct_io_temp_files = directIo ? 1 : 0;
+}
+
 }
@@ -87,6 +87,30 @@ memory_size_type get_block_size();
 ///////////////////////////////////////////////////////////////////////////////
 void set_block_size(memory_size_type block_size);
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get whether temporary streams use direct I/O.
+///
+/// With direct I/O, block reads and writes of temporary file_streams bypass
+/// the operating system page cache, so temporary data that is only read once
+/// does not evict other cached data. This can be enabled by setting the
+/// TPIE_DIRECT_IO environment variable to 1 or by calling
+/// set_direct_io_temp_files.
+///
+/// Only whole uncompressed blocks can bypass the page cache, since
+/// compressed blocks are not aligned to disk sectors. The merge sorter
+/// therefore stores its runs uncompressed when direct I/O is enabled.
+///
+/// The default is false.
+///////////////////////////////////////////////////////////////////////////////
+bool get_direct_io_temp_files();
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Set whether temporary streams use direct I/O.
+///
+/// The setting takes effect for streams opened after the call.
+///////////////////////////////////////////////////////////////////////////////
+void set_direct_io_temp_files(bool directIo);
+
 } //namespace tpie
 
 #endif //__TPIE_TPIE_H__
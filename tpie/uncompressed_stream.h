@@ -22,6 +22,7 @@
 #include <tpie/file.h>
 #include <tpie/memory.h>
 #include <tpie/file_stream_base.h>
+#include <tpie/array_view.h>
 ///////////////////////////////////////////////////////////////////////////////
 /// \file uncompressed_stream.h
 /// \brief Simple class acting both as a tpie::file and a
@@ -131,6 +132,23 @@ public:
 		return reinterpret_cast<item_type*>(m_block.data)[m_index];
 	}
 
+	///////////////////////////////////////////////////////////////////////////
+	/// \brief  Read the items from the current position to the end of the
+	/// current block without copying them.
+	///
+	/// When the stream is memory mapped (see set_memory_mapped), the view
+	/// points directly into the mapped file. The view is valid until the
+	/// stream moves to another block or is closed.
+	///////////////////////////////////////////////////////////////////////////
+	array_view<const item_type> read_block_view() {
+		assert(m_open);
+		peek();
+		const item_type * items = reinterpret_cast<const item_type *>(m_block.data);
+		array_view<const item_type> view(items + m_index, items + m_block.size);
+		m_index = m_block.size;
+		return view;
+	}
+
 	///////////////////////////////////////////////////////////////////////////
 	/// \brief  Advance the stream position to the next item.
 	///////////////////////////////////////////////////////////////////////////